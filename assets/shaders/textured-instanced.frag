@@ -0,0 +1,28 @@
+#version 330 core
+
+in Varyings {
+    vec4 color;
+    flat uint material;
+    vec2 tex_coord;
+} fs_in;
+
+out vec4 frag_color;
+
+// The instanced and indirect draws can draw the objects of many materials at once,
+// so the instances read their material from a table (see "source/common/shader/uniform-blocks.hpp")
+struct MaterialData {
+    vec4 tint;
+    float alpha_threshold;
+};
+
+layout(std140) uniform Materials {
+    MaterialData materials[256];
+};
+
+// Samplers can't be stored in uniform blocks, so the texture is shared by every material of the draw
+uniform sampler2D tex;
+
+void main(){
+    MaterialData material = materials[fs_in.material];
+    frag_color = texture(tex, fs_in.tex_coord) * fs_in.color * material.tint;
+}
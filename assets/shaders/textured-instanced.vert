@@ -0,0 +1,29 @@
+#version 330 core
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec4 color;
+layout(location = 2) in vec2 tex_coord;
+// The model matrix of the instance (it takes the locations 4 to 7, one per column)
+layout(location = 4) in mat4 instance_transform;
+// The index of the instance's material in the "Materials" table
+layout(location = 8) in uint instance_material;
+
+out Varyings {
+    vec4 color;
+    flat uint material;
+    vec2 tex_coord;
+} vs_out;
+
+// The view projection matrix comes from the frame block (see "source/common/shader/uniform-blocks.hpp")
+// and the model matrix comes from the instance attribute
+layout(std140) uniform Frame {
+    mat4 view_projection;
+    vec4 camera_position;
+};
+
+void main(){
+    gl_Position = view_projection * instance_transform * vec4(position, 1.0);
+    vs_out.color = color;
+    vs_out.material = instance_material;
+    vs_out.tex_coord = tex_coord;
+}
\ No newline at end of file
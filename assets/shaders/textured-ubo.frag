@@ -0,0 +1,21 @@
+#version 330 core
+
+in Varyings {
+    vec4 color;
+    vec2 tex_coord;
+} fs_in;
+
+out vec4 frag_color;
+
+// The data of the material (see "source/common/shader/uniform-blocks.hpp")
+layout(std140) uniform Material {
+    vec4 tint;
+    float alpha_threshold;
+};
+
+// Samplers can't be stored in uniform blocks, so the texture unit is still a regular uniform
+uniform sampler2D tex;
+
+void main(){
+    frag_color = texture(tex, fs_in.tex_coord) * fs_in.color * tint;
+}
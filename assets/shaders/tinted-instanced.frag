@@ -0,0 +1,23 @@
+#version 330 core
+
+in Varyings {
+    vec4 color;
+    flat uint material;
+} fs_in;
+
+out vec4 frag_color;
+
+// The instanced and indirect draws can draw the objects of many materials at once,
+// so the instances read their material from a table (see "source/common/shader/uniform-blocks.hpp")
+struct MaterialData {
+    vec4 tint;
+    float alpha_threshold;
+};
+
+layout(std140) uniform Materials {
+    MaterialData materials[256];
+};
+
+void main(){
+    frag_color = fs_in.color * materials[fs_in.material].tint;
+}
@@ -0,0 +1,17 @@
+#version 330 core
+
+in Varyings {
+    vec4 color;
+} fs_in;
+
+out vec4 frag_color;
+
+// The data of the material (see "source/common/shader/uniform-blocks.hpp")
+layout(std140) uniform Material {
+    vec4 tint;
+    float alpha_threshold;
+};
+
+void main(){
+    frag_color = fs_in.color * tint;
+}
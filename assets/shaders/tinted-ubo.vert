@@ -0,0 +1,24 @@
+#version 330 core
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec4 color;
+
+out Varyings {
+    vec4 color;
+} vs_out;
+
+// The data shared by every draw in the frame (see "source/common/shader/uniform-blocks.hpp")
+layout(std140) uniform Frame {
+    mat4 view_projection;
+    vec4 camera_position;
+};
+
+// The data of the drawn object (the renderer binds its block in the per-draw ring buffer)
+layout(std140) uniform Object {
+    mat4 object_to_world;
+};
+
+void main(){
+    gl_Position = view_projection * object_to_world * vec4(position, 1.0);
+    vs_out.color = color;
+}
@@ -23,6 +23,7 @@
 #endif
 
 #include "texture/screenshot.hpp"
+#include "gl/state-cache.hpp"
 
 std::string default_screenshot_filepath() {
     std::stringstream stream;
@@ -196,6 +197,11 @@ int our::Application::run(int run_for_frames) {
     glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
 #endif
 
+    // The state cache can be disabled (to measure what it saves) or set to validate its shadow state against OpenGL (to debug it)
+    auto gl_state_config = app_config.value("gl-state", nlohmann::json::object());
+    our::GLStateCache::get().setEnabled(gl_state_config.value("cache", true));
+    our::GLStateCache::get().setValidation(gl_state_config.value("validate", false));
+
     setupCallbacks();
     keyboard.enable(window);
     mouse.enable(window);
@@ -267,6 +273,11 @@ int our::Application::run(int run_for_frames) {
         // Get the current time (the time at which we are starting the current frame).
         double current_frame_time = glfwGetTime();
 
+        // ImGui (and the states initialization) may have changed the OpenGL state behind the state cache's back, so we make it forget
+        // what it knows before drawing. Its counters are reset too so that they only count the calls of one frame.
+        our::GLStateCache::get().invalidate();
+        our::GLStateCache::get().resetStatistics();
+
         // Call onDraw, in which we will draw the current frame, and send to it the time difference between the last and current frame
         if(currentState) currentState->onDraw(current_frame_time - last_frame_time);
         last_frame_time = current_frame_time; // Then update the last frame start time (this frame is now the last frame)
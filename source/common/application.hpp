@@ -12,6 +12,7 @@
 
 #include "input/keyboard.hpp"
 #include "input/mouse.hpp"
+#include "jobs/job-system.hpp"
 
 namespace our {
 
@@ -59,6 +60,8 @@ namespace our {
 
         nlohmann::json app_config;           // A Json file that contains all application configuration
 
+        JobSystem jobSystem;                // The thread pool shared by the states and the systems to split their work across the cores
+
         std::unordered_map<std::string, State*> states;   // This will store all the states that the application can run
         State * currentState = nullptr;         // This will store the current scene that is being run
         State * nextState = nullptr;            // If it is requested to go to another scene, this will contain a pointer to that scene
@@ -73,7 +76,9 @@ namespace our {
     public:
 
         // Create an application with following configuration
-        Application(const nlohmann::json& app_config) : app_config(app_config) {}
+        // The number of worker threads is read from "jobs.workers" in the config (a negative number or no value means one per core)
+        Application(const nlohmann::json& app_config) : app_config(app_config),
+            jobSystem(app_config.value("jobs", nlohmann::json::object()).value("workers", -1)) {}
         // On destruction, delete all the states
         ~Application(){ for (auto &it : states) delete it.second; }
 
@@ -119,6 +124,8 @@ namespace our {
 
         [[nodiscard]] const nlohmann::json& getConfig() const { return app_config; }
 
+        JobSystem& getJobSystem() { return jobSystem; }
+
         // Get the size of the frame buffer of the window in pixels.
         glm::ivec2 getFrameBufferSize() {
             glm::ivec2 size;
@@ -6,6 +6,7 @@
 #include "texture/sampler.hpp"
 #include "mesh/mesh.hpp"
 #include "mesh/mesh-utils.hpp"
+#include "mesh/mesh-simplify.hpp"
 #include "material/material.hpp"
 #include "deserialize-utils.hpp"
 
@@ -63,12 +64,40 @@ namespace our {
     // This will load all the meshes defined in "data"
     // data must be in the form:
     //    { mesh_name : "path/to/3d-model-file", ... }
+    // or, to generate simplified levels of detail (see "Mesh::addLod"), a mesh description can be an object in the form:
+    //    { "path": "path/to/3d-model-file", "lods": [ { "ratio": 0.5, "screen-size": 0.2 }, ... ] }
+    // where each level keeps "ratio" of the triangles of the model and is drawn when the object covers less than
+    // "screen-size" of the screen height (the levels go from the most to the least detailed)
     template<>
     void AssetLoader<Mesh>::deserialize(const nlohmann::json& data) {
         if(data.is_object()){
             for(auto& [name, desc] : data.items()){
-                std::string path = desc.get<std::string>();
-                assets[name] = mesh_utils::loadOBJ(path);
+                if(desc.is_string()){
+                    assets[name] = mesh_utils::loadOBJ(desc.get<std::string>());
+                    continue;
+                }
+                std::vector<Vertex> vertices;
+                std::vector<GLuint> elements;
+                Bounds bounds;
+                if(!mesh_utils::readOBJ(desc.value("path", ""), vertices, elements, bounds)){
+                    assets[name] = nullptr;
+                    continue;
+                }
+                Mesh* mesh = new Mesh(vertices, elements, bounds);
+                // Every level is simplified from the original model (so the errors of the levels don't add up)
+                // and keeps the bounds of the original model, which contain the simplified vertices
+                for(const auto& lod : desc.value("lods", nlohmann::json::array())){
+                    if(mesh->getLodCount() == Mesh::MAX_LODS) break;
+                    size_t targetTriangles = static_cast<size_t>(lod.value("ratio", 0.5f) * (elements.size() / 3));
+                    std::vector<Vertex> simplifiedVertices;
+                    std::vector<GLuint> simplifiedElements;
+                    mesh_utils::simplify(vertices, elements, targetTriangles, simplifiedVertices, simplifiedElements);
+                    // A level that lost every triangle or that is not simpler than the previous one is not worth drawing
+                    Mesh* previous = mesh->getLod(mesh->getLodCount() - 1);
+                    if(simplifiedElements.empty() || simplifiedElements.size() >= static_cast<size_t>(previous->getElementCount())) break;
+                    mesh->addLod(new Mesh(simplifiedVertices, simplifiedElements, bounds), lod.value("screen-size", 0.0f));
+                }
+                assets[name] = mesh;
             }
         }
     };
@@ -82,6 +111,8 @@ namespace our {
     //      "type" where the value is a string defining the type of the material.
     //              the type will decide which class will be instanced in the function "createMaterialFromType" found in "material.hpp"
     //      "shader" where the value must be the name of a loaded shader
+    //      "instancedShader" (optional) where the value is the name of a loaded shader that reads the model matrix from a per-instance attribute
+    //              (e.g. "assets/shaders/tinted-instanced.vert"), it allows the renderer to draw the objects sharing this material and a mesh together
     //      "pipelineState" (optional) where the value is a json object that can be read by "PipelineState::deserialize"
     //      "transparent" (optional, default=false) where the value is a boolean indicating whether the material is transparent or not
     //      ... more keys/values can be added depending on the material type (e.g. "texture", "sampler", "tint")
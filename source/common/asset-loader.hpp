@@ -32,6 +32,14 @@ namespace our {
             }
             return nullptr;
         };
+        // This function finds the name of an asset (the reverse of "get") and returns an empty string if it is not held by this class
+        // It searches every asset, so it should only be used when the assets are cooked (not every frame)
+        static std::string getName(const T* asset) {
+            for(auto& [name, held] : assets){
+                if(held == asset) return name;
+            }
+            return "";
+        }
         // This function deletes all the assets held by this class and clear the assets map 
         static void clear(){
             for(auto& [name, asset] : assets){
@@ -13,6 +13,10 @@ namespace our {
         // Look at "source/common/asset-loader.hpp" to know how to use the static class AssetLoader.
         this->mesh = AssetLoader<Mesh>::get(data["mesh"].get<std::string>());
         this->material = AssetLoader<Material>::get(data["material"].get<std::string>());
+        // The level geometry is marked as static so that the static batcher can merge it
+        this->isStatic = data.value("static", false);
+        // and the large objects that hide others are marked as occluders
+        this->isOccluder = data.value("occluder", false);
 
     }
 }
\ No newline at end of file
@@ -12,9 +12,15 @@ namespace our {
     public:
         Mesh* mesh; // The mesh that should be drawn
         Material* material; // The material used to draw the mesh
+        // If true, the owner never moves, so the mesh can be merged with the other static meshes of its material
+        // when the scene is loaded (see "StaticBatcher"), and the render list never checks it after building its command. The default is false.
+        bool isStatic = false;
+        // If true, the mesh is drawn into the CPU occlusion buffer to hide the objects behind it (see "OcclusionBuffer")
+        // It should be set for a few large opaque objects (e.g. walls). The default is false.
+        bool isOccluder = false;
 
         // The ID of this component type is "Mesh Renderer"
-        static std::string getID() { return "Mesh Renderer"; }
+        static constexpr std::string_view getID() { return "Mesh Renderer"; }
 
         // Receives the mesh & material from the AssetLoader by the names given in the json object
         void deserialize(const nlohmann::json& data) override;
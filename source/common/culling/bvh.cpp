@@ -0,0 +1,273 @@
+#include "bvh.hpp"
+
+#include <algorithm>
+
+namespace our {
+
+    // The number of bins used to evaluate the candidate splits along each axis
+    static constexpr int BIN_COUNT = 12;
+
+    void BoundingVolumeHierarchy::build(const std::vector<BoundingBox>& boxes) {
+        std::vector<uint32_t> treeItems(boxes.size());
+        for(uint32_t item = 0; item < treeItems.size(); ++item) treeItems[item] = item;
+        build(boxes, treeItems);
+    }
+
+    void BoundingVolumeHierarchy::build(const std::vector<BoundingBox>& boxes, const std::vector<uint32_t>& treeItems) {
+        uint32_t count = static_cast<uint32_t>(treeItems.size());
+        nodes.clear();
+        parents.clear();
+        items = treeItems;
+        itemLeaves.assign(boxes.size(), NO_LEAF);
+        itemCount = count;
+        unusedSlots = 0;
+        if(count == 0){
+            builtCost = 0.0f;
+            builtNodeCount = 0;
+            return;
+        }
+        // We split the items using their box centers
+        std::vector<glm::vec3> centers(boxes.size());
+        for(uint32_t item : items) centers[item] = boxes[item].getCenter();
+        // A binary tree with n leaves has 2n - 1 nodes
+        nodes.reserve(2 * (count / MAX_LEAF_SIZE + 1));
+        nodes.push_back({});
+        parents.push_back(0);
+        buildNode(0, 0, count, 0, boxes, centers);
+        builtCost = getCost();
+        builtNodeCount = nodes.size();
+    }
+
+    void BoundingVolumeHierarchy::makeLeaf(uint32_t node, uint32_t start, uint32_t count) {
+        nodes[node].start = start;
+        nodes[node].count = count;
+        nodes[node].leaf = true;
+        for(uint32_t index = start; index < start + count; ++index) itemLeaves[items[index]] = node;
+    }
+
+    void BoundingVolumeHierarchy::buildNode(uint32_t node, uint32_t start, uint32_t count, uint32_t depth,
+                                            const std::vector<BoundingBox>& boxes, const std::vector<glm::vec3>& centers) {
+        // The node box contains all of its items and the centroid box contains all of their centers
+        BoundingBox box, centroidBox;
+        for(uint32_t index = start; index < start + count; ++index){
+            box.expand(boxes[items[index]]);
+            centroidBox.expand(centers[items[index]]);
+        }
+        nodes[node].box = box;
+        if(count <= MAX_LEAF_SIZE || depth >= MAX_DEPTH){
+            makeLeaf(node, start, count);
+            return;
+        }
+
+        // We distribute the item centers into bins along each axis, then we evaluate the SAH cost of splitting between every two bins:
+        // cost = area(left) * count(left) + area(right) * count(right) (relative to the area of the node)
+        int bestAxis = -1, bestSplit = 0;
+        float bestCost = std::numeric_limits<float>::infinity();
+        glm::vec3 extent = centroidBox.max - centroidBox.min;
+        for(int axis = 0; axis < 3; ++axis){
+            if(extent[axis] <= 0.0f) continue;
+            BoundingBox binBoxes[BIN_COUNT];
+            uint32_t binCounts[BIN_COUNT] = {};
+            float scale = BIN_COUNT / extent[axis];
+            for(uint32_t index = start; index < start + count; ++index){
+                int bin = std::min(BIN_COUNT - 1, static_cast<int>((centers[items[index]][axis] - centroidBox.min[axis]) * scale));
+                binBoxes[bin].expand(boxes[items[index]]);
+                ++binCounts[bin];
+            }
+            // We sweep from the right to compute the cost of the right side of each split, then from the left
+            float rightCosts[BIN_COUNT];
+            BoundingBox rightBox;
+            uint32_t rightCount = 0;
+            for(int bin = BIN_COUNT - 1; bin > 0; --bin){
+                rightBox.expand(binBoxes[bin]);
+                rightCount += binCounts[bin];
+                rightCosts[bin] = rightBox.getSurfaceArea() * rightCount;
+            }
+            BoundingBox leftBox;
+            uint32_t leftCount = 0;
+            for(int split = 1; split < BIN_COUNT; ++split){
+                leftBox.expand(binBoxes[split - 1]);
+                leftCount += binCounts[split - 1];
+                float cost = leftBox.getSurfaceArea() * leftCount + rightCosts[split];
+                if(cost < bestCost){
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = split;
+                }
+            }
+        }
+
+        uint32_t middle = start;
+        if(bestAxis >= 0){
+            float scale = BIN_COUNT / extent[bestAxis];
+            float minimum = centroidBox.min[bestAxis];
+            middle = static_cast<uint32_t>(std::partition(items.begin() + start, items.begin() + start + count, [&](uint32_t item){
+                return std::min(BIN_COUNT - 1, static_cast<int>((centers[item][bestAxis] - minimum) * scale)) < bestSplit;
+            }) - items.begin());
+        }
+        if(middle == start || middle == start + count){
+            // All the centers fell on one side (e.g. they are all at the same point), so we just split the items in half
+            int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+            middle = start + count / 2;
+            std::nth_element(items.begin() + start, items.begin() + middle, items.begin() + start + count, [&](uint32_t first, uint32_t second){
+                return centers[first][axis] < centers[second][axis];
+            });
+        }
+
+        // The two children are stored next to each other after all the existing nodes
+        uint32_t left = static_cast<uint32_t>(nodes.size());
+        nodes.push_back({});
+        nodes.push_back({});
+        parents.push_back(node);
+        parents.push_back(node);
+        nodes[node].start = left;
+        nodes[node].count = 0;
+        nodes[node].leaf = false;
+        buildNode(left, start, middle - start, depth + 1, boxes, centers);
+        buildNode(left + 1, middle, start + count - middle, depth + 1, boxes, centers);
+    }
+
+    bool BoundingVolumeHierarchy::refitNode(uint32_t index, const std::vector<BoundingBox>& boxes) {
+        Node& node = nodes[index];
+        BoundingBox box;
+        if(node.isLeaf()){
+            for(uint32_t item = node.start; item < node.start + node.count; ++item) box.expand(boxes[items[item]]);
+        } else {
+            box = nodes[node.start].box;
+            box.expand(nodes[node.start + 1].box);
+        }
+        if(box == node.box) return false;
+        node.box = box;
+        return true;
+    }
+
+    void BoundingVolumeHierarchy::refit(const std::vector<BoundingBox>& boxes) {
+        // The children always come after their parent, so iterating backwards refits the children first
+        for(size_t index = nodes.size(); index > 0; --index) refitNode(static_cast<uint32_t>(index - 1), boxes);
+    }
+
+    void BoundingVolumeHierarchy::refit(const std::vector<BoundingBox>& boxes, const std::vector<uint32_t>& changedItems) {
+        // We walk up from the leaf and stop when a node box does not change since its ancestors won't change either
+        for(uint32_t item : changedItems) refitUp(itemLeaves[item], boxes);
+    }
+
+    void BoundingVolumeHierarchy::refitUp(uint32_t node, const std::vector<BoundingBox>& boxes) {
+        while(refitNode(node, boxes) && node != 0) node = parents[node];
+    }
+
+    void BoundingVolumeHierarchy::appendToLeaf(uint32_t node, uint32_t item) {
+        Node& leaf = nodes[node];
+        if(leaf.start + leaf.count != items.size()){
+            // The slot after the leaf may belong to another leaf, so the leaf's items are moved to the end first
+            uint32_t start = static_cast<uint32_t>(items.size());
+            for(uint32_t index = 0; index < leaf.count; ++index) items.push_back(items[leaf.start + index]);
+            unusedSlots += leaf.count;
+            leaf.start = start;
+        }
+        items.push_back(item);
+        ++leaf.count;
+        itemLeaves[item] = node;
+    }
+
+    void BoundingVolumeHierarchy::splitLeaf(uint32_t node, uint32_t item, const std::vector<BoundingBox>& boxes) {
+        // The leaf's items and the new one are sorted along the longest axis of their centers and split in half
+        std::vector<uint32_t> split(items.begin() + nodes[node].start, items.begin() + nodes[node].start + nodes[node].count);
+        split.push_back(item);
+        BoundingBox centroidBox;
+        for(uint32_t splitItem : split) centroidBox.expand(boxes[splitItem].getCenter());
+        glm::vec3 extent = centroidBox.max - centroidBox.min;
+        int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+        std::sort(split.begin(), split.end(), [&](uint32_t first, uint32_t second){
+            return boxes[first].getCenter()[axis] < boxes[second].getCenter()[axis];
+        });
+        unusedSlots += nodes[node].count;
+
+        // The two new leaves are stored after all the existing nodes (so they still come after their parent)
+        uint32_t left = static_cast<uint32_t>(nodes.size());
+        uint32_t half = static_cast<uint32_t>(split.size() / 2);
+        nodes.push_back({});
+        nodes.push_back({});
+        parents.push_back(node);
+        parents.push_back(node);
+        nodes[node].start = left;
+        nodes[node].count = 0;
+        nodes[node].leaf = false;
+        uint32_t start = static_cast<uint32_t>(items.size());
+        items.insert(items.end(), split.begin(), split.end());
+        makeLeaf(left, start, half);
+        makeLeaf(left + 1, start + half, static_cast<uint32_t>(split.size()) - half);
+        refitNode(left, boxes);
+        refitNode(left + 1, boxes);
+    }
+
+    void BoundingVolumeHierarchy::compactItems() {
+        std::vector<uint32_t> packed;
+        packed.reserve(itemCount);
+        for(Node& node : nodes){
+            if(!node.isLeaf()) continue;
+            uint32_t start = static_cast<uint32_t>(packed.size());
+            packed.insert(packed.end(), items.begin() + node.start, items.begin() + node.start + node.count);
+            node.start = start;
+        }
+        items.swap(packed);
+        unusedSlots = 0;
+    }
+
+    void BoundingVolumeHierarchy::insert(uint32_t item, const std::vector<BoundingBox>& boxes) {
+        if(item >= itemLeaves.size()) itemLeaves.resize(item + 1, NO_LEAF);
+        ++itemCount;
+        if(nodes.empty()){
+            nodes.push_back({ BoundingBox(), static_cast<uint32_t>(items.size()), 0, true });
+            parents.push_back(0);
+        }
+        // We go down to the leaf whose box grows the least when the item is added (which keeps the node areas small)
+        const BoundingBox& box = boxes[item];
+        uint32_t node = 0, depth = 0;
+        while(!nodes[node].isLeaf()){
+            uint32_t left = nodes[node].start;
+            auto growth = [&](uint32_t child){
+                BoundingBox grown = nodes[child].box;
+                grown.expand(box);
+                return grown.getSurfaceArea() - nodes[child].box.getSurfaceArea();
+            };
+            node = growth(left) <= growth(left + 1) ? left : left + 1;
+            ++depth;
+        }
+        if(nodes[node].count >= MAX_LEAF_SIZE && depth < MAX_DEPTH) splitLeaf(node, item, boxes);
+        else appendToLeaf(node, item);
+        refitUp(node, boxes);
+        // The moved ranges leave unused slots behind, so the array is packed once they outnumber the items
+        if(unusedSlots > itemCount + MAX_LEAF_SIZE) compactItems();
+    }
+
+    void BoundingVolumeHierarchy::remove(uint32_t item, const std::vector<BoundingBox>& boxes) {
+        if(item >= itemLeaves.size() || itemLeaves[item] == NO_LEAF) return;
+        uint32_t node = itemLeaves[item];
+        Node& leaf = nodes[node];
+        // The last item of the leaf takes the place of the removed one
+        uint32_t last = leaf.start + leaf.count - 1;
+        for(uint32_t index = leaf.start; index < last; ++index){
+            if(items[index] != item) continue;
+            items[index] = items[last];
+            break;
+        }
+        --leaf.count;
+        ++unusedSlots;
+        --itemCount;
+        itemLeaves[item] = NO_LEAF;
+        refitUp(node, boxes);
+    }
+
+    float BoundingVolumeHierarchy::getCost() const {
+        if(nodes.empty()) return 0.0f;
+        float rootArea = nodes[0].box.getSurfaceArea();
+        if(rootArea <= 0.0f) return static_cast<float>(items.size());
+        // Each internal node costs one traversal step and each leaf costs one test per item,
+        // weighted by the probability that a query reaching the root also reaches the node (the ratio of their areas)
+        float cost = 0.0f;
+        for(const Node& node : nodes)
+            cost += node.box.getSurfaceArea() / rootArea * (node.isLeaf() ? static_cast<float>(node.count) : 1.0f);
+        return cost;
+    }
+
+}
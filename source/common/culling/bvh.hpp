@@ -0,0 +1,216 @@
+#pragma once
+
+#include "frustum.hpp"
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+
+namespace our {
+
+    // The closest hit found by a ray cast
+    struct RayHit {
+        uint32_t item = std::numeric_limits<uint32_t>::max(); // The hit item (or the maximum uint32_t if nothing was hit)
+        float distance = std::numeric_limits<float>::infinity(); // The distance along the ray (in units of the ray direction)
+        bool hit() const { return item != std::numeric_limits<uint32_t>::max(); }
+    };
+
+    // Returns the distance along the ray at which it enters the box or a negative number if it misses the box
+    // "inverseDirection" is 1/direction (precomputed since it is the same for all the boxes tested by a ray)
+    inline float intersectRay(const BoundingBox& box, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance) {
+        glm::vec3 t0 = (box.min - origin) * inverseDirection;
+        glm::vec3 t1 = (box.max - origin) * inverseDirection;
+        glm::vec3 tNear = glm::min(t0, t1), tFar = glm::max(t0, t1);
+        float enter = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.0f));
+        float exit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, maxDistance));
+        return enter <= exit ? enter : -1.0f;
+    }
+
+    // A bounding volume hierarchy is a binary tree of boxes over a set of items (each item is identified by its index
+    // in the array of boxes given to "build", and the array can have unused indices that are not in the tree).
+    // Each node box contains the boxes of all the items below it, so a query can
+    // skip a whole subtree as soon as its node box does not pass the test, which makes queries on large sets much faster than a linear scan.
+    // The tree is built top-down using the surface area heuristic (SAH) which picks the splits that minimize the expected query cost.
+    // When items move, "refit" updates the node boxes without changing the tree. This is much cheaper than a rebuild,
+    // but the tree quality slowly degrades as the items drift away from each other, so "needsRebuild" compares the current
+    // cost of the tree to its cost right after the last build.
+    // A few items can also be inserted and removed without a rebuild: an item is inserted into the leaf whose box grows the least
+    // (a full leaf is split in two), and a removed item leaves its leaf smaller (or empty).
+    // The nodes are stored in a flat array where the children of a node come after it, so the tree can be refitted
+    // bottom-up by iterating backwards over the array.
+    class BoundingVolumeHierarchy {
+    public:
+        // A leaf holds at most this many items (unless the items can't be split)
+        static constexpr uint32_t MAX_LEAF_SIZE = 4;
+        // The tree is never deeper than this (so the queries can use a fixed size stack)
+        static constexpr uint32_t MAX_DEPTH = 48;
+        // Marks an item that is not in the tree
+        static constexpr uint32_t NO_LEAF = std::numeric_limits<uint32_t>::max();
+
+    private:
+        struct Node {
+            BoundingBox box;
+            uint32_t start; // For a leaf, the index of its first item in "items". Otherwise, the index of its left child (the right child is start + 1)
+            uint32_t count; // The number of items in a leaf (0 for an internal node, and a leaf can be empty after its items are removed)
+            bool leaf;
+            bool isLeaf() const { return leaf; }
+        };
+
+        std::vector<Node> nodes; // The nodes of the tree where nodes[0] is the root
+        std::vector<uint32_t> parents; // The index of the parent of each node (the root's parent is itself)
+        std::vector<uint32_t> items; // The items ordered such that every leaf refers to a contiguous range
+        std::vector<uint32_t> itemLeaves; // The leaf holding each item (indexed by the item, NO_LEAF if the item is not in the tree)
+        uint32_t itemCount = 0; // The number of items in the tree
+        // The number of slots of "items" that no leaf uses (a leaf that grows moves its range to the end of the array)
+        size_t unusedSlots = 0;
+        float builtCost = 0.0f; // The SAH cost of the tree after the last build
+        size_t builtNodeCount = 0; // The number of nodes after the last build
+
+        // Builds the subtree of the given node over items[start, start + count)
+        void buildNode(uint32_t node, uint32_t start, uint32_t count, uint32_t depth, const std::vector<BoundingBox>& boxes, const std::vector<glm::vec3>& centers);
+        // Turns the given node into a leaf over items[start, start + count)
+        void makeLeaf(uint32_t node, uint32_t start, uint32_t count);
+        // Recomputes the box of the given node from its items or its children and returns true if it changed
+        bool refitNode(uint32_t node, const std::vector<BoundingBox>& boxes);
+        // Refits the nodes from the given node up to the root (stopping at the first node whose box stays the same)
+        void refitUp(uint32_t node, const std::vector<BoundingBox>& boxes);
+        // Adds an item to the end of a leaf (moving the leaf's range to the end of "items" if needed)
+        void appendToLeaf(uint32_t node, uint32_t item);
+        // Turns a full leaf into an internal node whose two new leaves split its items and the given item along the longest axis
+        void splitLeaf(uint32_t node, uint32_t item, const std::vector<BoundingBox>& boxes);
+        // Packs the ranges of the leaves at the start of "items" to drop the unused slots
+        void compactItems();
+
+    public:
+        // Builds the tree from scratch over the given item boxes
+        void build(const std::vector<BoundingBox>& boxes);
+        // Builds the tree from scratch over the given items only (the other indices of "boxes" are not in the tree)
+        void build(const std::vector<BoundingBox>& boxes, const std::vector<uint32_t>& treeItems);
+        // Inserts an item (whose box is boxes[item]) into the tree
+        void insert(uint32_t item, const std::vector<BoundingBox>& boxes);
+        // Removes an item from the tree (the boxes of the other items must be the ones the tree was last refitted with)
+        void remove(uint32_t item, const std::vector<BoundingBox>& boxes);
+        // Updates the node boxes after all (or many) of the item boxes changed
+        void refit(const std::vector<BoundingBox>& boxes);
+        // Updates the node boxes after the boxes of the given items changed
+        // Only the nodes on the path from each item to the root are visited (and we stop as soon as a node box stays the same)
+        void refit(const std::vector<BoundingBox>& boxes, const std::vector<uint32_t>& changedItems);
+
+        // Returns the SAH cost of the tree (the expected cost of a query relative to testing the root)
+        float getCost() const;
+        // Returns true if the tree quality degraded enough (since the last build) that rebuilding it is worth it
+        // (or if the inserted items doubled its nodes, since the removed items leave empty leaves behind)
+        bool needsRebuild(float threshold = 1.5f) const { return getCost() > threshold * builtCost || nodes.size() > 2 * builtNodeCount + 2; }
+
+        size_t getItemCount() const { return itemCount; }
+        size_t getNodeCount() const { return nodes.size(); }
+        bool isEmpty() const { return itemCount == 0; }
+
+        // Calls visit(item) for each item whose box is inside or intersects the frustum
+        // If a node is completely inside the frustum, all the items below it are visited without any more tests
+        template<typename Visitor>
+        void queryFrustum(const Frustum& frustum, const std::vector<BoundingBox>& boxes, Visitor&& visit) const {
+            if(isEmpty()) return;
+            uint32_t stack[64];
+            size_t top = 0;
+            stack[top++] = 0;
+            while(top > 0){
+                const Node& node = nodes[stack[--top]];
+                Containment containment = frustum.classify(node.box);
+                if(containment == Containment::OUTSIDE) continue;
+                if(containment == Containment::INSIDE){
+                    visitAll(node, visit);
+                } else if(node.isLeaf()){
+                    for(uint32_t index = node.start; index < node.start + node.count; ++index)
+                        if(frustum.intersects(boxes[items[index]])) visit(items[index]);
+                } else {
+                    stack[top++] = node.start;
+                    stack[top++] = node.start + 1;
+                }
+            }
+        }
+
+        // Calls visit(item) for each item whose box overlaps the given box
+        template<typename Visitor>
+        void queryOverlap(const BoundingBox& box, const std::vector<BoundingBox>& boxes, Visitor&& visit) const {
+            if(isEmpty()) return;
+            uint32_t stack[64];
+            size_t top = 0;
+            stack[top++] = 0;
+            while(top > 0){
+                const Node& node = nodes[stack[--top]];
+                if(!node.box.overlaps(box)) continue;
+                if(node.isLeaf()){
+                    for(uint32_t index = node.start; index < node.start + node.count; ++index)
+                        if(boxes[items[index]].overlaps(box)) visit(items[index]);
+                } else {
+                    stack[top++] = node.start;
+                    stack[top++] = node.start + 1;
+                }
+            }
+        }
+
+        // Finds the closest item hit by the ray within maxDistance
+        // "intersect(item, maxDistance)" is called for each item whose box is hit and should return the distance at which
+        // the ray hits the item itself or a negative number if it misses it (returning the box distance gives a box-level ray cast)
+        // The children are visited nearest first so that the farther subtrees can be skipped once a hit is found.
+        template<typename Intersector>
+        RayHit raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, const std::vector<BoundingBox>& boxes, Intersector&& intersect) const {
+            RayHit result;
+            result.distance = maxDistance;
+            if(isEmpty()) return result;
+            glm::vec3 inverseDirection = 1.0f / direction;
+            uint32_t stack[64];
+            size_t top = 0;
+            if(intersectRay(nodes[0].box, origin, inverseDirection, maxDistance) >= 0) stack[top++] = 0;
+            while(top > 0){
+                const Node& node = nodes[stack[--top]];
+                if(node.isLeaf()){
+                    for(uint32_t index = node.start; index < node.start + node.count; ++index){
+                        uint32_t item = items[index];
+                        if(intersectRay(boxes[item], origin, inverseDirection, result.distance) < 0) continue;
+                        float distance = intersect(item, result.distance);
+                        if(distance >= 0 && distance <= result.distance){
+                            result.item = item;
+                            result.distance = distance;
+                        }
+                    }
+                    continue;
+                }
+                float left = intersectRay(nodes[node.start].box, origin, inverseDirection, result.distance);
+                float right = intersectRay(nodes[node.start + 1].box, origin, inverseDirection, result.distance);
+                // We push the farther child first so that the nearer child is popped first
+                if(left >= 0 && right >= 0){
+                    bool leftFirst = left <= right;
+                    stack[top++] = leftFirst ? node.start + 1 : node.start;
+                    stack[top++] = leftFirst ? node.start : node.start + 1;
+                } else if(left >= 0) stack[top++] = node.start;
+                else if(right >= 0) stack[top++] = node.start + 1;
+            }
+            return result;
+        }
+
+    private:
+        // Visits all the items below the given node
+        template<typename Visitor>
+        void visitAll(const Node& root, Visitor& visit) const {
+            uint32_t stack[64];
+            size_t top = 0;
+            const Node* node = &root;
+            while(true){
+                if(node->isLeaf()){
+                    for(uint32_t index = node->start; index < node->start + node->count; ++index) visit(items[index]);
+                } else {
+                    stack[top++] = node->start + 1;
+                    node = &nodes[node->start];
+                    continue;
+                }
+                if(top == 0) break;
+                node = &nodes[stack[--top]];
+            }
+        }
+    };
+
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "../mesh/bounds.hpp"
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OUR_CULLING_USE_SSE
+#endif
+
+namespace our {
+
+    // The result of testing a volume against a frustum
+    enum class Containment {
+        OUTSIDE,    // The volume is completely outside the frustum
+        INTERSECTS, // The volume is partially inside the frustum
+        INSIDE      // The volume is completely inside the frustum
+    };
+
+    // A frustum is the volume seen by a camera. It is defined by 6 planes (left, right, bottom, top, near, far)
+    // where each plane is stored as (normal, distance) with the normal pointing inside the frustum,
+    // so a point p is inside a plane if dot(normal, p) + distance >= 0.
+    struct Frustum {
+        glm::vec4 planes[6];
+
+        // Extracts the planes from a view projection matrix (the planes are in world space)
+        // Each plane is a sum or a difference of the last row of the matrix and one of the other rows
+        // since a point is inside the clip volume if -w <= x, y, z <= w (Gribb & Hartmann).
+        static Frustum fromMatrix(const glm::mat4& VP) {
+            // glm matrices are column-major, so row i is made from the i-th element of each column
+            auto row = [&VP](int i){ return glm::vec4(VP[0][i], VP[1][i], VP[2][i], VP[3][i]); };
+            Frustum frustum;
+            frustum.planes[0] = row(3) + row(0); // left
+            frustum.planes[1] = row(3) - row(0); // right
+            frustum.planes[2] = row(3) + row(1); // bottom
+            frustum.planes[3] = row(3) - row(1); // top
+            frustum.planes[4] = row(3) + row(2); // near
+            frustum.planes[5] = row(3) - row(2); // far
+            // We normalize the planes so that the plane equation gives the actual distance (which is compared to the sphere radius)
+            for(auto& plane : frustum.planes) plane /= glm::length(glm::vec3(plane));
+            return frustum;
+        }
+
+        // Returns true if the sphere is inside or intersects the frustum
+        bool intersects(const BoundingSphere& sphere) const {
+            for(const auto& plane : planes)
+                if(glm::dot(glm::vec3(plane), sphere.center) + plane.w < -sphere.radius) return false;
+            return true;
+        }
+
+        // Returns true if the box is inside or intersects the frustum
+        // For each plane, we only need to test the corner of the box that is farthest along the plane normal
+        bool intersects(const BoundingBox& box) const {
+            for(const auto& plane : planes){
+                glm::vec3 corner = glm::vec3(
+                    plane.x >= 0 ? box.max.x : box.min.x,
+                    plane.y >= 0 ? box.max.y : box.min.y,
+                    plane.z >= 0 ? box.max.z : box.min.z
+                );
+                if(glm::dot(glm::vec3(plane), corner) + plane.w < 0) return false;
+            }
+            return true;
+        }
+
+        // Returns whether the box is outside, inside or partially inside the frustum
+        // In addition to the farthest corner along each plane normal, we test the nearest corner to know if the box is inside the plane
+        Containment classify(const BoundingBox& box) const {
+            Containment result = Containment::INSIDE;
+            for(const auto& plane : planes){
+                glm::vec3 normal = glm::vec3(plane);
+                glm::vec3 farthest = glm::vec3(plane.x >= 0 ? box.max.x : box.min.x, plane.y >= 0 ? box.max.y : box.min.y, plane.z >= 0 ? box.max.z : box.min.z);
+                if(glm::dot(normal, farthest) + plane.w < 0) return Containment::OUTSIDE;
+                glm::vec3 nearest = glm::vec3(plane.x >= 0 ? box.min.x : box.max.x, plane.y >= 0 ? box.min.y : box.max.y, plane.z >= 0 ? box.min.z : box.max.z);
+                if(glm::dot(normal, nearest) + plane.w < 0) result = Containment::INTERSECTS;
+            }
+            return result;
+        }
+
+        // Tests a batch of spheres stored as separate arrays of x, y, z and radius (structure of arrays)
+        // and writes 1 in "visible" for each sphere that is inside or intersects the frustum (and 0 otherwise).
+        // When SSE is available, 4 spheres are tested against each plane at once.
+        void intersects(const float* x, const float* y, const float* z, const float* radius, size_t count, uint8_t* visible) const {
+            size_t index = 0;
+#if defined(OUR_CULLING_USE_SSE)
+            for(; index + 4 <= count; index += 4){
+                __m128 sphereX = _mm_loadu_ps(x + index), sphereY = _mm_loadu_ps(y + index), sphereZ = _mm_loadu_ps(z + index);
+                __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(radius + index));
+                __m128 outside = _mm_setzero_ps();
+                for(const auto& plane : planes){
+                    __m128 distance = _mm_add_ps(
+                        _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), sphereX), _mm_mul_ps(_mm_set1_ps(plane.y), sphereY)),
+                        _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), sphereZ), _mm_set1_ps(plane.w))
+                    );
+                    outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, negativeRadius));
+                }
+                int mask = _mm_movemask_ps(outside);
+                for(int lane = 0; lane < 4; ++lane) visible[index + lane] = (mask >> lane) & 1 ? 0 : 1;
+            }
+#endif
+            for(; index < count; ++index)
+                visible[index] = intersects(BoundingSphere{ glm::vec3(x[index], y[index], z[index]), radius[index] }) ? 1 : 0;
+        }
+    };
+
+    // Transforms a local bounding sphere to the space of the given matrix
+    // The radius is scaled by the largest scale of the matrix so that the sphere still contains the object
+    inline BoundingSphere transformSphere(const BoundingSphere& sphere, const glm::mat4& matrix) {
+        float scaleSquared = glm::max(glm::max(
+            glm::dot(glm::vec3(matrix[0]), glm::vec3(matrix[0])),
+            glm::dot(glm::vec3(matrix[1]), glm::vec3(matrix[1]))),
+            glm::dot(glm::vec3(matrix[2]), glm::vec3(matrix[2])));
+        return { glm::vec3(matrix * glm::vec4(sphere.center, 1.0f)), sphere.radius * glm::sqrt(scaleSquared) };
+    }
+
+    // Transforms a local bounding box to the space of the given matrix and returns the axis aligned box that contains it
+    // The new extents along each axis are the sum of the absolute projections of the old extents (Arvo's method)
+    inline BoundingBox transformBox(const BoundingBox& box, const glm::mat4& matrix) {
+        glm::vec3 center = glm::vec3(matrix * glm::vec4(box.getCenter(), 1.0f));
+        glm::vec3 extents = box.getExtents();
+        glm::vec3 newExtents =
+            glm::abs(glm::vec3(matrix[0])) * extents.x +
+            glm::abs(glm::vec3(matrix[1])) * extents.y +
+            glm::abs(glm::vec3(matrix[2])) * extents.z;
+        return { center - newExtents, center + newExtents };
+    }
+
+}
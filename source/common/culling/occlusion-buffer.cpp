@@ -0,0 +1,248 @@
+#include "occlusion-buffer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+namespace our {
+
+    // Clamps a screen coordinate to [-1, size] before it is converted to a pixel index.
+    // A vertex close to the camera plane can be projected very far away, and converting a float beyond the range of int is undefined.
+    // The clamped coordinate is still outside the screen if the original one was, so the pixel ranges stay the same.
+    static float clampToScreen(float coordinate, int size) {
+        return std::clamp(coordinate, -1.0f, static_cast<float>(size));
+    }
+
+    void OcclusionBuffer::resize(int width, int height) {
+        this->width = std::max(4, (width + 3) & ~3);
+        this->height = std::max(1, height);
+        levels.clear();
+        int levelWidth = this->width, levelHeight = this->height;
+        while(true){
+            Level level;
+            level.width = levelWidth;
+            level.height = levelHeight;
+            level.farthest.assign(size_t(levelWidth) * levelHeight, 1.0f);
+            // Level 0 only stores its depths once (they are both the farthest and the nearest depth of each pixel)
+            if(!levels.empty()) level.nearest.assign(size_t(levelWidth) * levelHeight, 1.0f);
+            levels.push_back(std::move(level));
+            if(levelWidth == 1 && levelHeight == 1) break;
+            levelWidth = (levelWidth + 1) / 2;
+            levelHeight = (levelHeight + 1) / 2;
+        }
+    }
+
+    void OcclusionBuffer::begin(const glm::mat4& viewProjection) {
+        this->viewProjection = viewProjection;
+        triangles.clear();
+        statistics = OcclusionStatistics();
+    }
+
+    void OcclusionBuffer::addOccluder(const OccluderGeometry& geometry, const glm::mat4& localToWorld) {
+        glm::mat4 MVP = viewProjection * localToWorld;
+        clipPositions.resize(geometry.positions.size());
+        for(size_t index = 0; index < geometry.positions.size(); ++index)
+            clipPositions[index] = MVP * glm::vec4(geometry.positions[index], 1.0f);
+
+        size_t added = 0;
+        for(size_t index = 0; index + 2 < geometry.indices.size(); index += 3){
+            const glm::vec4* corners[3] = { &clipPositions[geometry.indices[index]], &clipPositions[geometry.indices[index + 1]], &clipPositions[geometry.indices[index + 2]] };
+            // The triangles crossing the near plane are skipped instead of being clipped (an occluder can only hide less that way)
+            bool crossesNear = false;
+            // and the ones completely outside one of the side planes are not visible at all
+            int outsideMask = 0b1111;
+            for(const glm::vec4* corner : corners){
+                const glm::vec4& c = *corner;
+                if(c.w <= 0.0f || c.z < -c.w) crossesNear = true;
+                outsideMask &= (c.x < -c.w ? 1 : 0) | (c.x > c.w ? 2 : 0) | (c.y < -c.w ? 4 : 0) | (c.y > c.w ? 8 : 0);
+            }
+            if(crossesNear || outsideMask) continue;
+
+            ScreenTriangle triangle;
+            float minY = std::numeric_limits<float>::max(), maxY = -std::numeric_limits<float>::max();
+            for(int corner = 0; corner < 3; ++corner){
+                const glm::vec4& c = *corners[corner];
+                glm::vec3 ndc = glm::vec3(c) / c.w;
+                triangle.vertices[corner] = glm::vec3((ndc.x * 0.5f + 0.5f) * width, (ndc.y * 0.5f + 0.5f) * height, ndc.z * 0.5f + 0.5f);
+                minY = std::min(minY, triangle.vertices[corner].y);
+                maxY = std::max(maxY, triangle.vertices[corner].y);
+            }
+            // The rows are the ones whose centers can be inside the triangle
+            triangle.minY = std::max(0, static_cast<int>(std::ceil(clampToScreen(minY, height) - 0.5f)));
+            triangle.maxY = std::min(height - 1, static_cast<int>(std::floor(clampToScreen(maxY, height) - 0.5f)));
+            if(triangle.minY > triangle.maxY) continue;
+            triangles.push_back(triangle);
+            ++added;
+        }
+        statistics.triangles += added;
+        ++statistics.occluders;
+    }
+
+    void OcclusionBuffer::rasterizeBand(int firstRow, int lastRow) {
+        float* depths = levels.front().farthest.data();
+        for(const ScreenTriangle& triangle : triangles){
+            if(triangle.maxY < firstRow || triangle.minY >= lastRow) continue;
+            glm::vec3 v0 = triangle.vertices[0], v1 = triangle.vertices[1], v2 = triangle.vertices[2];
+            // The triangle is made counter clockwise so that the inside of every edge is where its edge function is positive
+            float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+            if(area == 0.0f) continue;
+            if(area < 0.0f){
+                std::swap(v1, v2);
+                area = -area;
+            }
+            // Each edge (a, b) gives E(x, y) = A * x + B * y + C which is positive on the left of the edge
+            auto edge = [](const glm::vec3& a, const glm::vec3& b){
+                float A = a.y - b.y, B = b.x - a.x;
+                return glm::vec3(A, B, -(A * a.x + B * a.y));
+            };
+            glm::vec3 e0 = edge(v1, v2), e1 = edge(v2, v0), e2 = edge(v0, v1);
+            // The depth is an affine function of the screen position, and each edge function is the barycentric weight
+            // of the opposite vertex (times the area), so z = zx * x + zy * y + zc
+            glm::vec3 depthPlane = (e0 * v0.z + e1 * v1.z + e2 * v2.z) / area;
+            // The functions are evaluated at the pixel centers, but a pixel is only covered if all of it is inside the triangle,
+            // so each edge function is moved to the corner of the pixel where it is the smallest. Likewise, the pixel gets
+            // the farthest depth of the triangle inside it (the depth at the corner where it is the largest).
+            auto toWorstCorner = [](glm::vec3& plane, float sign){ plane.z += sign * 0.5f * (std::abs(plane.x) + std::abs(plane.y)); };
+            toWorstCorner(e0, -1.0f);
+            toWorstCorner(e1, -1.0f);
+            toWorstCorner(e2, -1.0f);
+            toWorstCorner(depthPlane, 1.0f);
+
+            float minX = std::min(v0.x, std::min(v1.x, v2.x)), maxX = std::max(v0.x, std::max(v1.x, v2.x));
+            int firstColumn = std::max(0, static_cast<int>(std::ceil(clampToScreen(minX, width) - 0.5f))) & ~3;
+            int lastColumn = std::min(width - 1, static_cast<int>(std::floor(clampToScreen(maxX, width) - 0.5f)));
+            int rowBegin = std::max(firstRow, triangle.minY), rowEnd = std::min(lastRow - 1, triangle.maxY);
+            for(int y = rowBegin; y <= rowEnd; ++y){
+                float centerY = y + 0.5f;
+                float* row = depths + size_t(y) * width;
+#if defined(OUR_CULLING_USE_SSE)
+                // The 4 pixels of a group are tested and written at once (the groups start at multiples of 4 and the width is one too)
+                __m128 x = _mm_add_ps(_mm_set1_ps(firstColumn + 0.5f), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+                __m128 four = _mm_set1_ps(4.0f), zero = _mm_setzero_ps();
+                __m128 a0 = _mm_set1_ps(e0.x), a1 = _mm_set1_ps(e1.x), a2 = _mm_set1_ps(e2.x), zx = _mm_set1_ps(depthPlane.x);
+                __m128 c0 = _mm_set1_ps(e0.y * centerY + e0.z), c1 = _mm_set1_ps(e1.y * centerY + e1.z), c2 = _mm_set1_ps(e2.y * centerY + e2.z);
+                __m128 cz = _mm_set1_ps(depthPlane.y * centerY + depthPlane.z);
+                for(int column = firstColumn; column <= lastColumn; column += 4, x = _mm_add_ps(x, four)){
+                    __m128 w0 = _mm_add_ps(_mm_mul_ps(a0, x), c0);
+                    __m128 w1 = _mm_add_ps(_mm_mul_ps(a1, x), c1);
+                    __m128 w2 = _mm_add_ps(_mm_mul_ps(a2, x), c2);
+                    __m128 inside = _mm_and_ps(_mm_cmpge_ps(w0, zero), _mm_and_ps(_mm_cmpge_ps(w1, zero), _mm_cmpge_ps(w2, zero)));
+                    if(_mm_movemask_ps(inside) == 0) continue;
+                    __m128 depth = _mm_add_ps(_mm_mul_ps(zx, x), cz);
+                    __m128 current = _mm_loadu_ps(row + column);
+                    __m128 nearer = _mm_min_ps(current, depth);
+                    _mm_storeu_ps(row + column, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, current)));
+                }
+#else
+                for(int column = firstColumn; column <= lastColumn; ++column){
+                    float centerX = column + 0.5f;
+                    if(e0.x * centerX + e0.y * centerY + e0.z < 0.0f) continue;
+                    if(e1.x * centerX + e1.y * centerY + e1.z < 0.0f) continue;
+                    if(e2.x * centerX + e2.y * centerY + e2.z < 0.0f) continue;
+                    float depth = depthPlane.x * centerX + depthPlane.y * centerY + depthPlane.z;
+                    row[column] = std::min(row[column], depth);
+                }
+#endif
+            }
+        }
+    }
+
+    void OcclusionBuffer::reduceRows(size_t level, int firstRow, int lastRow) {
+        const Level& below = levels[level - 1];
+        Level& current = levels[level];
+        // The nearest depths of level 0 are its depths
+        const std::vector<float>& belowNearest = level == 1 ? below.farthest : below.nearest;
+        for(int y = firstRow; y < lastRow; ++y){
+            int y0 = 2 * y, y1 = std::min(2 * y + 1, below.height - 1);
+            for(int x = 0; x < current.width; ++x){
+                int x0 = 2 * x, x1 = std::min(2 * x + 1, below.width - 1);
+                size_t i00 = size_t(y0) * below.width + x0, i01 = size_t(y0) * below.width + x1;
+                size_t i10 = size_t(y1) * below.width + x0, i11 = size_t(y1) * below.width + x1;
+                size_t index = size_t(y) * current.width + x;
+                current.farthest[index] = std::max(std::max(below.farthest[i00], below.farthest[i01]), std::max(below.farthest[i10], below.farthest[i11]));
+                current.nearest[index] = std::min(std::min(belowNearest[i00], belowNearest[i01]), std::min(belowNearest[i10], belowNearest[i11]));
+            }
+        }
+    }
+
+    void OcclusionBuffer::rasterize(JobSystem* jobSystem) {
+        auto start = std::chrono::high_resolution_clock::now();
+        std::fill(levels.front().farthest.begin(), levels.front().farthest.end(), 1.0f);
+        if(!triangles.empty()){
+            // Each band is only written by the thread that draws it, so the bands don't need any locking
+            int bandCount = (height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+            auto drawBands = [&](size_t begin, size_t end){
+                for(size_t band = begin; band < end; ++band)
+                    rasterizeBand(static_cast<int>(band) * BAND_HEIGHT, std::min(height, static_cast<int>(band + 1) * BAND_HEIGHT));
+            };
+            if(jobSystem) jobSystem->parallelFor(0, bandCount, drawBands);
+            else drawBands(0, bandCount);
+            // The first level of the hierarchy is the largest, so its rows are split between the threads too
+            // (without triangles, the hierarchy is not needed since "isVisible" does not read it)
+            for(size_t level = 1; level < levels.size(); ++level){
+                auto reduce = [&](size_t begin, size_t end){ reduceRows(level, static_cast<int>(begin), static_cast<int>(end)); };
+                if(jobSystem && level == 1) jobSystem->parallelFor(0, levels[level].height, reduce, BAND_HEIGHT);
+                else reduce(0, levels[level].height);
+            }
+        }
+        statistics.rasterizationTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    bool OcclusionBuffer::isTexelVisible(size_t level, int x, int y, const glm::ivec4& rectangle, float depth) const {
+        const Level& current = levels[level];
+        size_t index = size_t(y) * current.width + x;
+        // Every pixel of the texel has an occluder in front of the object
+        if(current.farthest[index] < depth) return false;
+        // No pixel of the texel has an occluder in front of the object (for level 0, this is the only other case)
+        const std::vector<float>& nearest = level == 0 ? current.farthest : current.nearest;
+        if(nearest[index] >= depth) return true;
+        // Otherwise, the texels below it that overlap the rectangle decide
+        int shift = static_cast<int>(level) - 1;
+        int minX = std::max(2 * x, rectangle.x >> shift), maxX = std::min(2 * x + 1, rectangle.z >> shift);
+        int minY = std::max(2 * y, rectangle.y >> shift), maxY = std::min(2 * y + 1, rectangle.w >> shift);
+        for(int childY = minY; childY <= maxY; ++childY){
+            for(int childX = minX; childX <= maxX; ++childX){
+                if(isTexelVisible(level - 1, childX, childY, rectangle, depth)) return true;
+            }
+        }
+        return false;
+    }
+
+    bool OcclusionBuffer::isVisible(const BoundingBox& box) const {
+        if(triangles.empty() || levels.empty()) return true;
+        // The box is projected to the screen and replaced by the rectangle around its corners at the depth of its nearest corner
+        glm::vec2 minimum(std::numeric_limits<float>::max()), maximum(-std::numeric_limits<float>::max());
+        float depth = std::numeric_limits<float>::max();
+        for(int corner = 0; corner < 8; ++corner){
+            glm::vec3 point((corner & 1) ? box.max.x : box.min.x, (corner & 2) ? box.max.y : box.min.y, (corner & 4) ? box.max.z : box.min.z);
+            glm::vec4 clip = viewProjection * glm::vec4(point, 1.0f);
+            // A box crossing the near plane could cover the whole screen, so it is always visible
+            if(clip.w <= 0.0f || clip.z < -clip.w) return true;
+            glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            glm::vec2 screen((ndc.x * 0.5f + 0.5f) * width, (ndc.y * 0.5f + 0.5f) * height);
+            minimum = glm::min(minimum, screen);
+            maximum = glm::max(maximum, screen);
+            depth = std::min(depth, ndc.z * 0.5f + 0.5f);
+        }
+        // The rectangle covers every pixel that the box touches (even partially)
+        minimum = glm::vec2(clampToScreen(minimum.x, width), clampToScreen(minimum.y, height));
+        maximum = glm::vec2(clampToScreen(maximum.x, width), clampToScreen(maximum.y, height));
+        glm::ivec4 rectangle(
+            std::max(0, static_cast<int>(std::floor(minimum.x))), std::max(0, static_cast<int>(std::floor(minimum.y))),
+            std::min(width - 1, static_cast<int>(std::floor(maximum.x))), std::min(height - 1, static_cast<int>(std::floor(maximum.y)))
+        );
+        // The boxes outside the screen are left to the frustum culling
+        if(rectangle.x > rectangle.z || rectangle.y > rectangle.w) return true;
+        // We start from the level where the rectangle covers at most 2x2 texels and refine the texels that can't decide
+        size_t level = 0;
+        while(level + 1 < levels.size() && ((rectangle.z >> level) - (rectangle.x >> level) > 1 || (rectangle.w >> level) - (rectangle.y >> level) > 1)) ++level;
+        for(int y = rectangle.y >> level; y <= (rectangle.w >> level); ++y){
+            for(int x = rectangle.x >> level; x <= (rectangle.z >> level); ++x){
+                if(isTexelVisible(level, x, y, rectangle, depth)) return true;
+            }
+        }
+        return false;
+    }
+
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "../mesh/bounds.hpp"
+#include "../jobs/job-system.hpp"
+#include "frustum.hpp"
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+
+namespace our {
+
+    // The triangles of an occluder in its local space (a copy of its mesh kept on the RAM for the rasterizer)
+    struct OccluderGeometry {
+        std::vector<glm::vec3> positions;
+        std::vector<uint32_t> indices;
+    };
+
+    // The statistics of the last frame of an occlusion buffer
+    struct OcclusionStatistics {
+        size_t occluders = 0; // The number of occluders drawn into the buffer
+        size_t triangles = 0; // The number of occluder triangles that reached the rasterizer (the ones crossing the near plane are skipped)
+        double rasterizationTime = 0.0; // The time spent rasterizing the occluders and building the hierarchy (in milliseconds)
+    };
+
+    // The occlusion buffer is a small depth buffer drawn on the CPU that holds the depth of a few large objects (the occluders)
+    // so that the objects hidden behind them can be skipped before they are sent to the GPU.
+    // Every frame:
+    //   1- "begin" clears the buffer for the view projection matrix of the camera,
+    //   2- "addOccluder" transforms the triangles of each occluder to the screen,
+    //   3- "rasterize" draws them (the buffer is split into bands of rows that are drawn by the job system's threads,
+    //      and each row is filled 4 pixels at a time with SSE) then builds a hierarchy of the depths,
+    //   4- "isVisible" tests the bounds of the other objects (it is read only, so any thread can call it).
+    // The depths are the window depths in [0, 1] (0 at the near plane). A pixel holds the nearest occluder depth, and each level
+    // of the hierarchy holds the farthest and the nearest depths of the 2x2 pixels below it. An object is hidden if the nearest
+    // point of its bounding box is behind the farthest occluder depth of every pixel its box covers on the screen.
+    // The buffer is conservative, so the test never hides anything that could be seen: a pixel is only covered by a triangle
+    // that covers all of it (and it gets the farthest depth of the triangle inside it), the triangles crossing the near plane
+    // are skipped, and the objects crossing the near plane are always visible. The price is that the pixels along the edges
+    // of the triangles stay empty, including the edges shared by two triangles of the same occluder, so the occluders
+    // made of a few large triangles (e.g. boxes and walls) hide the most.
+    class OcclusionBuffer {
+    public:
+        // The number of rows in a band (a band is drawn by a single thread)
+        static constexpr int BAND_HEIGHT = 8;
+
+    private:
+        // A level of the depth hierarchy (level 0 is the buffer itself, so its farthest and nearest depths are the same)
+        struct Level {
+            int width = 0, height = 0;
+            std::vector<float> farthest, nearest;
+        };
+        // A triangle in the buffer space: x and y are in pixels and z is the window depth
+        struct ScreenTriangle {
+            glm::vec3 vertices[3];
+            int minY, maxY; // The rows covered by the triangle (used to find the bands it crosses)
+        };
+
+        int width = 0, height = 0; // The width is a multiple of 4 (since the rows are filled 4 pixels at a time)
+        std::vector<Level> levels;
+        glm::mat4 viewProjection = glm::mat4(1.0f);
+        std::vector<ScreenTriangle> triangles;
+        std::vector<glm::vec4> clipPositions; // The vertices of the occluder being added (kept to avoid reallocating them)
+        OcclusionStatistics statistics;
+
+        // Draws the triangles that cross the rows [firstRow, lastRow) into level 0
+        void rasterizeBand(int firstRow, int lastRow);
+        // Fills the given rows of a level from the level below it
+        void reduceRows(size_t level, int firstRow, int lastRow);
+        // Returns true if a part of the rectangle of pixels [minX, maxX] x [minY, maxY] inside the given texel of a level
+        // is not hidden at the given depth (the texels that can't decide are refined using the 4 texels below them)
+        bool isTexelVisible(size_t level, int x, int y, const glm::ivec4& rectangle, float depth) const;
+
+    public:
+        // Sets the size of the buffer in pixels (the width is rounded up to a multiple of 4)
+        void resize(int width, int height);
+        // Clears the buffer and the triangles for a new frame seen through the given view projection matrix
+        void begin(const glm::mat4& viewProjection);
+        // Transforms the triangles of an occluder drawn at the given local to world matrix to the screen
+        void addOccluder(const OccluderGeometry& geometry, const glm::mat4& localToWorld);
+        // Draws the occluders and builds the hierarchy. If a job system is given, the bands and the rows are split between its threads.
+        void rasterize(JobSystem* jobSystem = nullptr);
+        // Returns false if the box (in world space) is hidden behind the occluders
+        bool isVisible(const BoundingBox& box) const;
+
+        int getWidth() const { return width; }
+        int getHeight() const { return height; }
+        // Returns the depths of the buffer (row by row, from the bottom row of the screen)
+        const std::vector<float>& getDepths() const { return levels.front().farthest; }
+        const OcclusionStatistics& getStatistics() const { return statistics; }
+    };
+
+}
@@ -0,0 +1,82 @@
+#include "occlusion-queries.hpp"
+
+namespace our {
+
+    void OcclusionQueries::poll(Object& object) {
+        if(!object.pending) return;
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(object.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if(!available) return;
+        GLuint anySamples = GL_FALSE;
+        glGetQueryObjectuiv(object.query, GL_QUERY_RESULT, &anySamples);
+        object.pending = false;
+        if(anySamples){
+            object.visible = true;
+            object.hiddenResults = 0;
+        } else if(++object.hiddenResults >= hysteresis){
+            object.visible = false;
+        }
+    }
+
+    void OcclusionQueries::beginFrame() {
+        ++frame;
+        issued = 0;
+        // Ending a query does not wait for its result, so a forgotten object's query can be reused right away
+        // (beginning it again discards the old result)
+        for(auto it = objects.begin(); it != objects.end();){
+            if(frame - it->second.lastFrame > EVICTION_FRAMES){
+                if(it->second.query) freeQueries.push_back(it->second.query);
+                it = objects.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    OcclusionQueries::Object& OcclusionQueries::get(uint64_t key) {
+        Object& object = objects[key];
+        // An object that was culled in the previous frame may have moved or been uncovered since its last result,
+        // so its old state is dropped instead of hiding it for a frame by mistake
+        if(object.lastFrame + 1 < frame){
+            object.pending = false;
+            object.visible = true;
+            object.hiddenResults = 0;
+        }
+        object.lastFrame = frame;
+        poll(object);
+        return object;
+    }
+
+    void OcclusionQueries::markVisible(Object& object) {
+        object.visible = true;
+        object.hiddenResults = 0;
+    }
+
+    void OcclusionQueries::begin(Object& object) {
+        if(object.query == 0){
+            if(!freeQueries.empty()){
+                object.query = freeQueries.back();
+                freeQueries.pop_back();
+            } else {
+                glGenQueries(1, &object.query);
+            }
+        }
+        glBeginQuery(GL_ANY_SAMPLES_PASSED, object.query);
+        object.pending = true;
+        ++issued;
+    }
+
+    void OcclusionQueries::end() {
+        glEndQuery(GL_ANY_SAMPLES_PASSED);
+    }
+
+    void OcclusionQueries::clear() {
+        for(auto& [key, object] : objects)
+            if(object.query) freeQueries.push_back(object.query);
+        if(!freeQueries.empty()) glDeleteQueries(static_cast<GLsizei>(freeQueries.size()), freeQueries.data());
+        freeQueries.clear();
+        objects.clear();
+        issued = 0;
+    }
+
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace our {
+
+    // Keeps what the GPU reported about the visibility of the objects tested with occlusion queries (GL_ANY_SAMPLES_PASSED).
+    // A visible object is tested by a query around its own draw, and a hidden one by a query around the draw of its bounding box
+    // (see "ForwardRenderer::render"). The results are never waited for: a query is only read once the GPU says it is available
+    // (usually a frame or two later), and an object whose query is still pending keeps its last state and is not tested again.
+    // To avoid objects that pop in and out every frame, a visible object only becomes hidden after "hysteresis" results in a row
+    // found no visible sample, while a hidden object becomes visible as soon as a single sample of its box passes.
+    class OcclusionQueries {
+    public:
+        // The state of a tested object (the objects are identified by a key chosen by the caller, e.g. the handle of their entity)
+        struct Object {
+            GLuint query = 0; // The query of the last test (0 if the object was never tested)
+            bool pending = false; // True if the result of the last test was not read yet
+            bool visible = true;
+            uint32_t hiddenResults = 0; // The number of results in a row that found no visible sample
+            uint64_t lastFrame = 0; // The last frame in which the object was looked up
+        };
+
+    private:
+        // An object that was not looked up for this many frames is forgotten (and its query is reused by other objects)
+        static constexpr uint64_t EVICTION_FRAMES = 120;
+
+        std::unordered_map<uint64_t, Object> objects;
+        std::vector<GLuint> freeQueries; // The queries of the forgotten objects
+        uint64_t frame = 1;
+        uint32_t hysteresis = 2;
+        size_t issued = 0; // The number of queries issued in the current frame
+
+        // Reads the result of the object's query if the GPU already has it
+        void poll(Object& object);
+
+    public:
+        // Sets how many hidden results in a row make a visible object hidden (at least 1)
+        void setHysteresis(uint32_t results) { hysteresis = results > 0 ? results : 1; }
+        // Starts a new frame (the objects that were not looked up for a while are forgotten)
+        void beginFrame();
+        // Returns the state of the object with the given key after reading its last result (if it is available)
+        // An object seen for the first time, or that was not looked up in the previous frame, is visible
+        Object& get(uint64_t key);
+        // Marks the object as visible without testing it (e.g. if the camera is inside its bounding box)
+        void markVisible(Object& object);
+        // Starts and ends the query of an object (the samples drawn in between decide its next state)
+        void begin(Object& object);
+        void end();
+        // Deletes all the queries
+        void clear();
+
+        // Returns the number of queries issued since "beginFrame"
+        size_t getIssuedCount() const { return issued; }
+        // Returns the number of objects whose state is kept
+        size_t size() const { return objects.size(); }
+    };
+
+}
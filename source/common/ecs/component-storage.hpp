@@ -0,0 +1,215 @@
+#pragma once
+
+#include "component.hpp"
+#include "pool-allocator.hpp"
+
+#include <vector>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include <type_traits>
+#include <string_view>
+
+namespace our {
+
+    // When a component is removed from a storage, the last component in the storage is moved into the hole it left behind
+    // so that the storage stays densely packed. This struct tells the caller which component was moved and where,
+    // so that the owner of the moved component can update the pointer it holds.
+    // If no component was moved, both pointers are null.
+    struct ComponentRelocation {
+        Component* from = nullptr;
+        Component* to = nullptr;
+    };
+
+    // A change made to a component storage (see "ComponentStorage::getChangesSince")
+    // An added component is created at "index" (the end of the storage). A removed component was at "index",
+    // and the last component of the storage (if it was not the removed one) was moved there.
+    struct ComponentChange {
+        uint32_t index;
+        bool added;
+    };
+
+    // The memory statistics of a component storage (see "World::getComponentStatistics")
+    struct ComponentStatistics {
+        std::string_view name; // The ID of the component type (see "Component::getID")
+        size_t live = 0;       // The number of components of this type that currently exist
+        size_t peak = 0;       // The maximum number of components of this type that existed at the same time
+        size_t chunks = 0;     // The number of chunks currently used by the storage
+        size_t slabs = 0;      // The number of slabs the storage's chunk pool requested from the heap
+        size_t bytes = 0;      // The memory held by these slabs
+    };
+
+    // This is the base class of all the component storages.
+    // It allows the entities and the world to remove components without knowing their concrete type.
+    class ComponentStorageBase {
+    public:
+        // Destroys the given component (which must be held by this storage) and returns the relocation (if any) it caused
+        virtual ComponentRelocation remove(Component* component) = 0;
+        // Destroys all the components in this storage
+        virtual void clear() = 0;
+        // Returns the number of live components in this storage
+        virtual size_t size() const = 0;
+        // Returns the memory statistics of this storage
+        virtual ComponentStatistics getStatistics() const = 0;
+        virtual ~ComponentStorageBase() = default;
+    };
+
+    // This class stores all the components of type T in a world.
+    // The components are stored by value in fixed-size chunks so that components of the same type are contiguous in memory
+    // and a system that is only interested in one component type can scan them without chasing pointers all over the heap.
+    // Chunks are never reallocated, so adding a component never moves the existing ones.
+    // On removal, the last component is moved into the hole so the live components are always packed in [0, size()).
+    // WARNING: This means that removing a component of type T may change the address of another component of type T,
+    // so pointers to components should not be kept across component removals.
+    // The chunks come from a pool allocator that recycles them, so adding and removing components
+    // (or clearing and reloading a world) only touches the heap when the storage grows beyond its previous peak.
+    template<typename T>
+    class ComponentStorage : public ComponentStorageBase {
+        static_assert(std::is_base_of<Component, T>::value, "T must inherit from Component");
+    public:
+        // Each chunk holds around 16KB of components (and at least one component)
+        static constexpr size_t CHUNK_CAPACITY = sizeof(T) >= 16384 ? 1 : 16384 / sizeof(T);
+        // The number of chunks requested from the heap at once
+        static constexpr size_t CHUNKS_PER_SLAB = 4;
+        // The storage remembers at most this many of its last changes (older ones are forgotten in halves)
+        static constexpr size_t MAX_LOGGED_CHANGES = 4096;
+
+    private:
+        // A chunk is just raw memory that is suitably aligned to hold CHUNK_CAPACITY components of type T
+        struct Chunk {
+            alignas(T) unsigned char data[sizeof(T) * CHUNK_CAPACITY];
+            T* at(size_t index) { return reinterpret_cast<T*>(data) + index; }
+            const T* at(size_t index) const { return reinterpret_cast<const T*>(data) + index; }
+        };
+
+        PoolAllocator<Chunk, CHUNKS_PER_SLAB> chunkPool; // The pool from which the chunks are allocated
+        std::vector<Chunk*> chunks; // The chunks in use
+        size_t count = 0; // The number of live components. They occupy the first "count" slots.
+        size_t peak = 0; // The maximum value that "count" has reached
+        uint64_t version = 0; // Incremented whenever a component is added or removed (so the components may have moved)
+        // The last changes made to the storage (one per version), where "changes[i]" moved the storage to version "firstLoggedVersion + i + 1"
+        std::vector<ComponentChange> changes;
+        uint64_t firstLoggedVersion = 0;
+
+        // Records a change and moves the storage to the next version
+        void logChange(size_t index, bool added) {
+            if(changes.size() == MAX_LOGGED_CHANGES){
+                changes.erase(changes.begin(), changes.begin() + MAX_LOGGED_CHANGES / 2);
+                firstLoggedVersion += MAX_LOGGED_CHANGES / 2;
+            }
+            changes.push_back({ static_cast<uint32_t>(index), added });
+            ++version;
+        }
+
+        // Returns the chunks that are no longer needed to the pool.
+        // We keep one empty chunk at the end so that a component that is removed then added again does not hit the pool.
+        void releaseUnusedChunks() {
+            while(chunks.size() > getChunkCount() + 1){
+                chunkPool.deallocate(chunks.back());
+                chunks.pop_back();
+            }
+        }
+
+    public:
+        ComponentStorage() = default;
+        ~ComponentStorage() override { clear(); }
+
+        // Constructs a new component at the end of the storage and returns a pointer to it
+        T* create() {
+            if(count == chunks.size() * CHUNK_CAPACITY) chunks.push_back(chunkPool.allocate());
+            T* component = new (chunks[count / CHUNK_CAPACITY]->at(count % CHUNK_CAPACITY)) T();
+            logChange(count, true);
+            if(++count > peak) peak = count;
+            return component;
+        }
+
+        ComponentRelocation remove(Component* component) override {
+            T* hole = static_cast<T*>(component);
+            T* last = &(*this)[count - 1];
+            ComponentRelocation relocation;
+            size_t index = count - 1;
+            if(hole != last){
+                // Fill the hole with the last component to keep the storage packed
+                *hole = std::move(*last);
+                relocation = { last, hole };
+                index = indexOf(hole);
+            }
+            last->~T();
+            --count;
+            logChange(index, false);
+            releaseUnusedChunks();
+            return relocation;
+        }
+
+        void clear() override {
+            for(size_t index = 0; index < count; ++index) (*this)[index].~T();
+            count = 0;
+            ++version;
+            // The consumers of the change log start over after a clear
+            changes.clear();
+            firstLoggedVersion = version;
+            for(Chunk* chunk : chunks) chunkPool.deallocate(chunk);
+            chunks.clear();
+        }
+
+        size_t size() const override { return count; }
+        // Returns a number that changes whenever a component is added to or removed from this storage
+        // Pointers to the components stay valid as long as it doesn't change
+        uint64_t getVersion() const { return version; }
+        // Gives the changes made since the storage had the given version (in the order in which they were made), so a system that
+        // mirrors the storage order can replay them instead of matching all of its entries again. Returns false if they are not known
+        // (the storage was cleared or too many changes were made since), in which case the caller should start over.
+        bool getChangesSince(uint64_t since, const ComponentChange*& first, size_t& changeCount) const {
+            if(since < firstLoggedVersion || since > version) return false;
+            first = changes.data() + (since - firstLoggedVersion);
+            changeCount = static_cast<size_t>(version - since);
+            return true;
+        }
+
+        ComponentStatistics getStatistics() const override {
+            ComponentStatistics statistics;
+            statistics.name = T::getID();
+            statistics.live = count;
+            statistics.peak = peak;
+            statistics.chunks = chunks.size();
+            statistics.slabs = chunkPool.getStatistics().slabs;
+            statistics.bytes = statistics.slabs * CHUNKS_PER_SLAB * sizeof(Chunk);
+            return statistics;
+        }
+
+        // Returns the component at the given index where index is in the range [0, size())
+        T& operator[](size_t index) { return *chunks[index / CHUNK_CAPACITY]->at(index % CHUNK_CAPACITY); }
+        // Returns the index of the given component (which must be held by this storage) by looking for its chunk
+        size_t indexOf(const T* component) const {
+            for(size_t chunk = 0; chunk < chunks.size(); ++chunk){
+                const T* first = chunks[chunk]->at(0);
+                if(component >= first && component < first + CHUNK_CAPACITY) return chunk * CHUNK_CAPACITY + static_cast<size_t>(component - first);
+            }
+            return count;
+        }
+
+        // These allow systems to process the components chunk by chunk (e.g. to split the work between threads)
+        // Every chunk except the last one holds exactly CHUNK_CAPACITY live components.
+        size_t getChunkCount() const { return (count + CHUNK_CAPACITY - 1) / CHUNK_CAPACITY; }
+        T* getChunk(size_t chunk) { return chunks[chunk]->at(0); }
+        size_t getChunkSize(size_t chunk) const {
+            return chunk + 1 < getChunkCount() ? CHUNK_CAPACITY : count - chunk * CHUNK_CAPACITY;
+        }
+
+        // Calls the given function on every live component in this storage
+        template<typename Function>
+        void forEach(Function&& function) {
+            for(size_t chunk = 0, chunkCount = getChunkCount(); chunk < chunkCount; ++chunk){
+                T* components = getChunk(chunk);
+                for(size_t index = 0, size = getChunkSize(chunk); index < size; ++index)
+                    function(components[index]);
+            }
+        }
+
+        // The storage should not be copyable
+        ComponentStorage(const ComponentStorage&) = delete;
+        ComponentStorage &operator=(ComponentStorage const &) = delete;
+    };
+
+}
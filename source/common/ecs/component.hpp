@@ -1,12 +1,54 @@
 #pragma once
 
 #include <json/json.hpp>
-#include <string>
+#include <string_view>
+#include <bitset>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
 
 namespace our {
 
     class Entity; // A forward declaration of the Entity Class
 
+    // Every component type gets a small integer ID that is used to index the per-type storages and the entity component masks
+    typedef uint32_t ComponentTypeID;
+    // The maximum number of component types (it is the number of bits in a component mask)
+    constexpr ComponentTypeID MAX_COMPONENT_TYPES = 64;
+    // A component mask has the bit "getComponentTypeID<T>()" set if an entity has a component of type T
+    typedef std::bitset<MAX_COMPONENT_TYPES> ComponentMask;
+
+    namespace internal {
+        // The next component type ID to be assigned
+        inline ComponentTypeID nextComponentTypeID = 0;
+        // Returns the next free ID. An ID past the end of the component masks would silently corrupt them,
+        // so the program stops with a clear message instead (this check is done in every build since it runs once per type).
+        inline ComponentTypeID takeComponentTypeID() {
+            if(nextComponentTypeID >= MAX_COMPONENT_TYPES){
+                std::cerr << "Too many component types: at most " << MAX_COMPONENT_TYPES
+                          << " are supported (increase MAX_COMPONENT_TYPES in \"component.hpp\")" << std::endl;
+                std::abort();
+            }
+            return nextComponentTypeID++;
+        }
+        // Each instantiation of this variable template takes the next free ID once (during static initialization)
+        // so reading it later is just a load from a static variable (no RTTI and no lookup)
+        template<typename T>
+        inline const ComponentTypeID componentTypeID = takeComponentTypeID();
+    }
+
+    // Returns the ID of the component type T
+    template<typename T>
+    inline ComponentTypeID getComponentTypeID() { return internal::componentTypeID<T>; }
+
+    // Returns a mask in which the bits of all the given component types are set
+    template<typename... T>
+    inline ComponentMask getComponentMask() {
+        ComponentMask mask;
+        (mask.set(getComponentTypeID<T>()), ...);
+        return mask;
+    }
+
     // A component is a data container that can be added to an entity.
     // The role of the entity in the world is defined by the components it holds.
     // For example, an entity with a camera component specifies that this entity should be used as a camera
@@ -16,9 +58,10 @@ namespace our {
         friend Entity; // The entity is a friend since it is the only one allowed to set itself as an owner of a certain component.
     public:
         // This static method returns a unique string that identifies each type of components
-        // This ID will be used as the key to store a component into the entity's component map 
+        // This ID will be used as the key to find the component type while deserializing
         // When you create a new type of components, override this function to return a new unique ID
-        static std::string getID() { return "Component"; }
+        // It returns a view on a string literal so calling it does not allocate a new string
+        static constexpr std::string_view getID() { return "Component"; }
         // Reads the data of the component from a json object
         // It is abstract since it must be overriden by derived components
         virtual void deserialize(const nlohmann::json& data) = 0;
@@ -28,4 +71,4 @@ namespace our {
         virtual ~Component(){}
     };
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+namespace our {
+
+    // A handle is a weak reference to an entity that can be safely kept after the entity is deleted.
+    // "index" is the slot of the entity in the world's entity pool and "generation" counts how many times that slot was reused.
+    // When an entity is deleted, the generation of its slot is incremented so any handle to it becomes stale,
+    // and "World::get" returns a nullptr for it instead of another entity that reused the slot.
+    // A default constructed handle is null (generations start from 1).
+    struct EntityHandle {
+        uint32_t index = 0;
+        uint32_t generation = 0;
+
+        bool operator==(const EntityHandle& other) const { return index == other.index && generation == other.generation; }
+        bool operator!=(const EntityHandle& other) const { return !(*this == other); }
+    };
+
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "component.hpp"
+
+#include <vector>
+#include <unordered_map>
+
+namespace our {
+
+    class Entity; // A forward declaration of the Entity Class
+
+    // An entity view is a cached list of the entities that hold all the component types in a given mask.
+    // Views are created and owned by the world (see "World::view") which keeps their membership up to date
+    // whenever a component is added to or removed from an entity, so reading a view costs nothing.
+    class EntityView {
+        ComponentMask mask; // The component types that an entity must have to be in this view
+        std::vector<Entity*> entities; // The matching entities packed together
+        std::unordered_map<Entity*, size_t> indices; // The index of each matching entity in "entities"
+    public:
+        explicit EntityView(const ComponentMask& mask) : mask(mask) {}
+
+        // Returns true if an entity with the given component mask belongs to this view
+        bool matches(const ComponentMask& entityMask) const {
+            return (entityMask & mask) == mask;
+        }
+
+        // Adds the entity to this view if it is not already in it
+        void insert(Entity* entity){
+            if(indices.emplace(entity, entities.size()).second) entities.push_back(entity);
+        }
+
+        // Removes the entity from this view (if it is in it)
+        // The last entity takes its place so the list stays packed
+        void erase(Entity* entity){
+            auto it = indices.find(entity);
+            if(it == indices.end()) return;
+            size_t index = it->second;
+            indices.erase(it);
+            if(index + 1 != entities.size()){
+                entities[index] = entities.back();
+                indices[entities[index]] = index;
+            }
+            entities.pop_back();
+        }
+
+        // Removes all the entities from this view
+        void clear(){
+            entities.clear();
+            indices.clear();
+        }
+
+        const ComponentMask& getMask() const { return mask; }
+        // Returns the matching entities. The order is not guaranteed to stay the same after the world changes
+        const std::vector<Entity*>& getEntities() const { return entities; }
+    };
+
+}
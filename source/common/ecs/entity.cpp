@@ -10,24 +10,60 @@ namespace our {
     // Remember that you can get the transformation matrix from this entity to its parent from "localTransform"
     // To get the local to world matrix, you need to combine this entities matrix with its parent's matrix and
     // its parent's parent's matrix and so on till you reach the root.
-    glm::mat4 Entity::getLocalToWorldMatrix() const {
-        //TODO: (Req 8) Write this function
-        // calculate localToWorld matrix recursively
-        // first set it to localTranfrom which is matrix relative to your parent
-        glm::mat4 localToWorld = this->localTransform.toMat4();
-        Entity* current = this->parent;
-        // loop till parent is null (root)
-        while(current){
-            // multiply the current localTransform from the left to preserve order
-            // since to go from leaf to root
-            // we do M1 * P to go up one level relative to parent
-            // then to go up one more level again we multiply by M2 the same way
-            // M2 * (M1 * P) and so on ..
-            localToWorld = current->localTransform.toMat4() * localToWorld;
-            // go up one level
-            current = current->parent;
+    // Instead of recomputing this chain on every call, each entity caches its local and world matrices:
+    // - The local matrix is recomputed only if "localTransform" differs from the transform it was computed from.
+    // - The world matrix is recomputed only if the local matrix changed, the parent changed
+    //   or the parent's world matrix changed (which we know from the parent's "worldVersion").
+    const glm::mat4& Entity::updateWorldMatrix() const {
+        // First, we make sure the parent is up to date (this walks up to the root)
+        // The parent is refreshed before its version is read (the order in which the arguments of a call are evaluated is unspecified)
+        if(parent){
+            const glm::mat4& parentMatrix = parent->updateWorldMatrix();
+            return refreshWorldMatrix(parent, parentMatrix, parent->worldVersion);
         }
-        return localToWorld;
+        return refreshWorldMatrix(nullptr, localMatrix, 0);
+    }
+
+    const glm::mat4& Entity::refreshWorldMatrix(const Entity* parent, const glm::mat4& parentMatrix, uint32_t parentVersion) const {
+        bool dirty = false;
+        if(localTransform != cachedTransform){
+            cachedTransform = localTransform;
+            localMatrix = localTransform.toMat4();
+            dirty = true;
+        }
+        if(parent){
+            if(dirty || parent != cachedParent || parentVersion != cachedParentVersion){
+                // We multiply the parent matrix from the left since we go from our local space to the parent's space then to the world
+                worldMatrix = parentMatrix * localMatrix;
+                cachedParent = parent;
+                cachedParentVersion = parentVersion;
+                ++worldVersion;
+            }
+        } else if(dirty || cachedParent){
+            // A root entity's local space is relative to the world
+            worldMatrix = localMatrix;
+            cachedParent = nullptr;
+            ++worldVersion;
+        }
+        return worldMatrix;
+    }
+
+    // Destroys the component in the given slot via the storage that holds it
+    // The storage may move another component into the freed slot, so we fix the pointer held by that component's owner
+    void Entity::removeComponentAt(size_t index){
+        ComponentSlot slot = components[index];
+        components.erase(components.begin() + index);
+        ComponentMask oldMask = componentMask;
+        componentMask.reset(slot.type);
+        world->onComponentMaskChanged(this, oldMask);
+        ComponentRelocation relocation = world->getStorage(slot.type)->remove(slot.component);
+        if(relocation.from) relocation.to->getOwner()->relocateComponent(slot.type, relocation.to);
+    }
+
+    // Since the entity owns its components, they should be deleted alongside the entity
+    Entity::~Entity(){
+        // We remove the components from the last to the first to avoid shifting the list
+        while(!components.empty()) removeComponentAt(components.size() - 1);
     }
 
     // Deserializes the entity data and components from a json object
@@ -1,9 +1,10 @@
 #pragma once
 
 #include "component.hpp"
+#include "component-storage.hpp"
+#include "entity-handle.hpp"
 #include "transform.hpp"
-#include <list>
-#include <iterator>
+#include <vector>
 #include <string>
 #include <glm/glm.hpp>
 
@@ -12,129 +13,155 @@ namespace our {
     class World; // A forward declaration of the World Class
 
     class Entity{
+        // Each entry pairs a component owned by this entity with its type ID
+        struct ComponentSlot {
+            Component* component;
+            ComponentTypeID type;
+        };
+
         World *world; // This defines what world own this entity
-        std::list<Component*> components; // A list of components that are owned by this entity
+        EntityHandle handle; // The handle of this entity (which also locates it in the world's entity pool)
+        uint32_t listIndex; // The index of this entity in the world's list of live entities
+        bool markedForRemoval = false; // Whether this entity is in the world's "markedForRemoval" list (see "WorldCommandBuffer::destroy")
+        Entity* parent = nullptr; // The parent of the entity (see "getParent")
+        // The number of entities whose parent is this entity, so the world only looks for the children
+        // of a deleted entity (to make them root entities) when it has any
+        uint32_t childCount = 0;
+        // A bit mask of the component types owned by this entity (an entity holds at most one component of each type)
+        ComponentMask componentMask;
+        // A list of components that are owned by this entity sorted by their type ID
+        // The components themselves live in the world's component storages (see "component-storage.hpp")
+        std::vector<ComponentSlot> components;
+
+        // The cached transformation matrices of this entity (see "getLocalToWorldMatrix")
+        // They are mutable since they are refreshed lazily from the const getters.
+        mutable Transform cachedTransform; // The value of "localTransform" from which "localMatrix" was computed
+        mutable glm::mat4 localMatrix = glm::mat4(1.0f); // The cached value of "localTransform.toMat4()"
+        mutable glm::mat4 worldMatrix = glm::mat4(1.0f); // The cached local to world matrix
+        mutable const Entity* cachedParent = nullptr; // The parent from which "worldMatrix" was computed
+        mutable uint32_t cachedParentVersion = 0; // The "worldVersion" of that parent when "worldMatrix" was computed
+        mutable uint32_t worldVersion = 0; // This is incremented whenever "worldMatrix" changes so the children know they are stale
+
+        // Refreshes the cached matrices of this entity (and its ancestors) if needed and returns the local to world matrix
+        const glm::mat4& updateWorldMatrix() const;
+        // Refreshes the cached matrices of this entity if needed assuming that the given parent is already up to date
+        // "parentMatrix" and "parentVersion" are the world matrix and the world version of that parent (they are ignored for a root)
+        const glm::mat4& refreshWorldMatrix(const Entity* parent, const glm::mat4& parentMatrix, uint32_t parentVersion) const;
 
-        friend World; // The world is a friend since it is the only class that is allowed to instantiate an entity
+        // The world is a friend since it is the only class that is allowed to instantiate an entity
+        friend World;
+        friend class TransformHierarchy; // The hierarchy refreshes the cached matrices of all the entities in bulk
         Entity() = default; // The entity constructor is private since only the world is allowed to instantiate an entity
+
+        // Since the components list is sorted by type, the slot of a component type is the number of
+        // component types with a smaller ID that this entity has. So this is just a mask and a population count.
+        size_t getSlotIndex(ComponentTypeID type) const {
+            return (componentMask << (MAX_COMPONENT_TYPES - type)).count();
+        }
+        // Destroys the component in the given slot and fixes the owner of any component moved by its storage
+        void removeComponentAt(size_t index);
+        // Called when a storage moves our component of the given type to a new address
+        void relocateComponent(ComponentTypeID type, Component* to){
+            components[getSlotIndex(type)].component = to;
+        }
     public:
         std::string name; // The name of the entity. It could be useful to refer to an entity by its name
-        Entity* parent;   // The parent of the entity. The transform of the entity is relative to its parent.
-                          // If parent is null, the entity is a root entity (has no parent).
         Transform localTransform; // The transform of this entity relative to its parent.
 
+        // Returns the parent of the entity. The transform of the entity is relative to its parent.
+        // If parent is null, the entity is a root entity (has no parent).
+        Entity* getParent() const { return parent; }
+        // Changes the parent of the entity (null makes it a root entity) and keeps the child counts of the old and new parents
+        void setParent(Entity* newParent){
+            if(parent) --parent->childCount;
+            parent = newParent;
+            if(parent) ++parent->childCount;
+        }
+        // Returns the number of entities whose parent is this entity
+        uint32_t getChildCount() const { return childCount; }
+
         World* getWorld() const { return world; } // Returns the world to which this entity belongs
+        EntityHandle getHandle() const { return handle; } // Returns a handle that can be used to check if this entity still exists
 
-        glm::mat4 getLocalToWorldMatrix() const; // Computes and returns the transformation from the entities local space to the world space
+        // Returns the transformation from the entities local space to the world space
+        // The matrices are cached, so they are only recomputed when "localTransform" or "parent" changes
+        // (for this entity or any of its ancestors). Checking an unchanged entity only costs a comparison per ancestor.
+        glm::mat4 getLocalToWorldMatrix() const { return updateWorldMatrix(); }
+        // Returns a number that changes whenever the local to world matrix changes
+        // It is only up to date after "getLocalToWorldMatrix" (or the world's transform update) is called
+        uint32_t getWorldVersion() const { return worldVersion; }
+        // Returns the transformation from the entities local space to its parent's space (the cached "localTransform.toMat4()")
+        glm::mat4 getLocalMatrix() const { updateWorldMatrix(); return localMatrix; }
         void deserialize(const nlohmann::json&); // Deserializes the entity data and components from a json object
-        
-        // This template method create a component of type T,
-        // adds it to the components map and returns a pointer to it 
+
+        // Returns a mask of the component types owned by this entity
+        const ComponentMask& getComponentMask() const { return componentMask; }
+
+        // Returns true if this entity has a component of type T
         template<typename T>
-        T* addComponent(){
-            static_assert(std::is_base_of<Component, T>::value, "T must inherit from Component");
-            //TODO: (Req 8) Create an component of type T, set its "owner" to be this entity, then push it into the component's list
-            // Create an component of type T
-            T* newComponent = new T();
-            // Set its "owner" to be this entity
-            newComponent->owner = this;
-            // then push it into the component's list
-            this->components.push_back(newComponent);
-            // Don't forget to return a pointer to the new component
-            return newComponent;
+        bool hasComponent() const {
+            return componentMask.test(getComponentTypeID<T>());
         }
 
+        // This template method create a component of type T,
+        // adds it to the components list and returns a pointer to it
+        // If the entity already has a component of type T, the existing component is returned instead
+        // NOTE: This template allocates the component from the world's storage,
+        // so it is defined at the end of "world.hpp" after the World class is complete.
+        template<typename T>
+        T* addComponent();
+
         // This template method searhes for a component of type T and returns a pointer to it
-        // If no component of type T was found, it returns a nullptr 
+        // If no component of type T was found, it returns a nullptr
+        // NOTE: The lookup is done in constant time using the component type ID, so only components whose type is exactly T are found
         template<typename T>
         T* getComponent(){
-            //TODO: (Req 8) Go through the components list and find the first component that can be dynamically cast to "T*".
-            // Return the component you found, or return null of nothing was found.
-            auto it = components.begin();
-            while(it != components.end()){
-                // used dynamic_cast<T*>(*it) != NULL as the bad cast check 
-                // could have used try and catch for the bad cast but this check satisfy our need 
-                if (dynamic_cast<T*>(*it) != NULL)
-                {
-                    return dynamic_cast<T*>(*it);
-                }
-                it++;
-            }
-            // return null of nothing was found.
-            return nullptr;
+            ComponentTypeID type = getComponentTypeID<T>();
+            if(!componentMask.test(type)) return nullptr;
+            return static_cast<T*>(components[getSlotIndex(type)].component);
         }
 
-        // This template method dynami and returns a pointer to it
-        // If no component of type T was found, it returns a nullptr 
+        // This template method returns the component at the given index if its type is T
+        // (the components are ordered by their type ID)
+        // If no such component was found, it returns a nullptr
         template<typename T>
         T* getComponent(size_t index){
-            auto it = components.begin();
-            std::advance(it, index);
-            if(it != components.end())
-                return dynamic_cast<T*>(*it);
+            if(index < components.size() && components[index].type == getComponentTypeID<T>())
+                return static_cast<T*>(components[index].component);
             return nullptr;
         }
 
         // This template method searhes for a component of type T and deletes it
         template<typename T>
         void deleteComponent(){
-            //TODO: (Req 8) Go through the components list and find the first component that can be dynamically cast to "T*".
-            // If found, delete the found component and remove it from the components list
-            
-            // could have done it in one loop only but this is better for code reusability
-            
-            // find the first component that can be dynamically cast to "T*".
-            T* firstFound = getComponent<T*>();
-            if(firstFound){
-                // reuse function deleteComponent which take T* and delete it
-                deleteComponent<T*>(firstFound);
-            }
+            if(ComponentTypeID type = getComponentTypeID<T>(); componentMask.test(type))
+                removeComponentAt(getSlotIndex(type));
         }
 
-        // This template method searhes for a component of type T and deletes it
+        // This method deletes the component at the given index
         void deleteComponent(size_t index){
-            auto it = components.begin();
-            std::advance(it, index);
-            if(it != components.end()) {
-                delete *it;
-                components.erase(it);
-            }
+            if(index < components.size()) removeComponentAt(index);
         }
 
         // This template method searhes for the given component and deletes it
         template<typename T>
         void deleteComponent(T const* component){
-            //TODO: (Req 8) Go through the components list and find the given component "component".
-            // If found, delete the found component and remove it from the components list
-            auto it = components.begin();
-            while(it != components.end()){
-                if (dynamic_cast<T*>(*it) != NULL && (*it) == component)
-                {
-                    // first deallocate the component
-                    delete *it;
-                    // Erase :: Removes from the vector container and calls its destructor 
-                    // but If the contained object is a pointer it doesnt take ownership of destroying it.
-                    // so we have to explicitly call delete on each contained pointer to delete the content
-                    components.erase(it);
-                    return;
-                }
-                it++;
+            if(ComponentTypeID type = getComponentTypeID<T>(); componentMask.test(type)){
+                size_t index = getSlotIndex(type);
+                if(components[index].component == component) removeComponentAt(index);
             }
         }
 
         // Since the entity owns its components, they should be deleted alongside the entity
-        ~Entity(){
-            //TODO: (Req 8) Delete all the components in "components".
-            // looping over every one and delete it manually then clear
-            for (Component* component : components){
-                delete component;
-            }
-            components.clear();
-        }
+        ~Entity();
 
         // Entities should not be copyable
         Entity(const Entity&) = delete;
         Entity &operator=(Entity const &) = delete;
     };
 
-}
\ No newline at end of file
+}
+
+// "addComponent" needs the complete World class so we include it here.
+// If "world.hpp" was included first, this include is skipped and the template is defined once World is complete.
+#include "world.hpp"
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+namespace our {
+
+    // The allocation statistics of a pool allocator
+    struct PoolStatistics {
+        size_t live = 0;  // The number of blocks currently allocated from the pool
+        size_t peak = 0;  // The maximum value "live" has reached since the pool was created
+        size_t slabs = 0; // The number of slabs the pool requested from the heap
+    };
+
+    // A pool allocator hands out fixed-size blocks that are big enough (and aligned enough) to hold a T.
+    // The blocks are carved from larger slabs of SLAB_CAPACITY blocks each. A freed block goes to a free list and is
+    // handed out again before any new slab is allocated, so steady allocate/free cycles never touch the heap.
+    // The slabs are only given back to the heap when the pool is destroyed.
+    // NOTE: The pool only manages memory, constructing and destroying the T objects is up to the caller.
+    template<typename T, size_t SLAB_CAPACITY = 16>
+    class PoolAllocator {
+        // A free block stores a pointer to the next free block, a used block stores a T
+        union Block {
+            Block* next;
+            alignas(T) unsigned char storage[sizeof(T)];
+        };
+
+        std::vector<std::unique_ptr<Block[]>> slabs; // All the slabs allocated so far
+        Block* freeList = nullptr; // The head of the free blocks list
+        PoolStatistics statistics;
+
+    public:
+        PoolAllocator() = default;
+
+        // Returns memory for a single T
+        T* allocate() {
+            if(!freeList){
+                // There is no free block so we allocate a new slab and put all of its blocks in the free list
+                slabs.push_back(std::make_unique<Block[]>(SLAB_CAPACITY));
+                Block* slab = slabs.back().get();
+                for(size_t index = 0; index < SLAB_CAPACITY; ++index)
+                    slab[index].next = index + 1 < SLAB_CAPACITY ? &slab[index + 1] : nullptr;
+                freeList = slab;
+                ++statistics.slabs;
+            }
+            Block* block = freeList;
+            freeList = block->next;
+            if(++statistics.live > statistics.peak) statistics.peak = statistics.live;
+            return reinterpret_cast<T*>(block->storage);
+        }
+
+        // Returns the given memory (which must have been allocated from this pool) to the free list
+        void deallocate(T* pointer) {
+            Block* block = reinterpret_cast<Block*>(pointer);
+            block->next = freeList;
+            freeList = block;
+            --statistics.live;
+        }
+
+        const PoolStatistics& getStatistics() const { return statistics; }
+
+        // The pool should not be copyable
+        PoolAllocator(const PoolAllocator&) = delete;
+        PoolAllocator &operator=(PoolAllocator const &) = delete;
+    };
+
+}
@@ -0,0 +1,80 @@
+#include "transform-hierarchy.hpp"
+#include "world.hpp"
+
+namespace our {
+
+    // The hierarchy is stale if entities were added or deleted since it was built (the world counts these changes)
+    // or if the parent of any entity changed (we compare the parent pointers since "setParent" can be called at any time)
+    bool TransformHierarchy::isStale(const World* world) const {
+        if(builtFrom != world->getStructureVersion()) return true;
+        for(size_t index = 0; index < entities.size(); ++index){
+            const Entity* parent = parents[index] >= 0 ? entities[parents[index]] : nullptr;
+            if(entities[index]->parent != parent) return true;
+        }
+        return false;
+    }
+
+    void TransformHierarchy::rebuild(const World* world) {
+        const std::vector<Entity*>& worldEntities = world->getEntities();
+        size_t count = worldEntities.size();
+
+        // First, we find the depth of every entity (indexed by its position in the world's entity list)
+        // We walk up the parent chain until we reach an entity whose depth is known, then assign the depths on the way back
+        std::vector<int32_t> depths(count, -1);
+        std::vector<Entity*> chain;
+        int32_t maxDepth = -1;
+        for(Entity* entity : worldEntities){
+            for(Entity* current = entity; current && depths[current->listIndex] < 0; current = current->parent)
+                chain.push_back(current);
+            while(!chain.empty()){
+                Entity* current = chain.back();
+                chain.pop_back();
+                int32_t depth = current->parent ? depths[current->parent->listIndex] + 1 : 0;
+                depths[current->listIndex] = depth;
+                if(depth > maxDepth) maxDepth = depth;
+            }
+        }
+
+        // Then we sort the entities by depth using a counting sort (which keeps the world order inside each level)
+        levels.assign(maxDepth + 2, 0);
+        for(int32_t depth : depths) ++levels[depth + 1];
+        for(size_t level = 1; level < levels.size(); ++level) levels[level] += levels[level - 1];
+        std::vector<size_t> positions(count); // The index of each world entity in the sorted order
+        std::vector<size_t> next(levels.begin(), levels.end() - 1); // The next free position in each level
+        for(size_t index = 0; index < count; ++index) positions[index] = next[depths[index]]++;
+
+        entities.resize(count);
+        parents.resize(count);
+        for(size_t index = 0; index < count; ++index){
+            Entity* entity = worldEntities[index];
+            size_t position = positions[index];
+            entities[position] = entity;
+            parents[position] = entity->parent ? static_cast<int32_t>(positions[entity->parent->listIndex]) : -1;
+        }
+
+        // We store a version that is behind each entity's version so that the first update copies every matrix
+        // (whether or not the update increments the entity's version)
+        worldMatrices.resize(count);
+        worldVersions.resize(count);
+        for(size_t position = 0; position < count; ++position) worldVersions[position] = entities[position]->worldVersion - 1;
+
+        builtFrom = world->getStructureVersion();
+    }
+
+    void TransformHierarchy::updateRange(size_t begin, size_t end) {
+        for(size_t index = begin; index < end; ++index){
+            Entity* entity = entities[index];
+            int32_t parent = parents[index];
+            // Since the parents come before their children, the parent's matrix and version are already up to date
+            const glm::mat4& matrix = parent >= 0 ?
+                entity->refreshWorldMatrix(entities[parent], worldMatrices[parent], worldVersions[parent]) :
+                entity->refreshWorldMatrix(nullptr, worldMatrices[index], 0);
+            // We only copy the matrices that changed
+            if(entity->worldVersion != worldVersions[index]){
+                worldMatrices[index] = matrix;
+                worldVersions[index] = entity->worldVersion;
+            }
+        }
+    }
+
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace our {
+
+    class Entity; // A forward declaration of the Entity Class
+    class World; // A forward declaration of the World Class
+
+    // The transform hierarchy is a flattened copy of the parent-child relations between the entities of a world.
+    // The entities are sorted by their depth in the hierarchy (roots first, then their children, and so on)
+    // and each one refers to its parent by its index in that order, so every parent comes before its children.
+    // This allows computing all the world matrices in one linear pass where the parent matrix is always ready,
+    // instead of walking up the parent chain for every entity.
+    // Since the entities of one depth level do not depend on each other, each level can also be split between threads.
+    // The hierarchy is rebuilt automatically when entities are added or deleted or when a "parent" pointer changes.
+    class TransformHierarchy {
+        std::vector<Entity*> entities; // The entities sorted by depth
+        std::vector<int32_t> parents; // The index of the parent of each entity in "entities" (or -1 for a root)
+        std::vector<glm::mat4> worldMatrices; // The local to world matrix of each entity
+        std::vector<uint32_t> worldVersions; // The world version of each entity (see "Entity::worldVersion")
+        std::vector<size_t> levels; // The entities of depth d are in the range [levels[d], levels[d+1])
+        uint64_t builtFrom = 0; // The structure version of the world when this hierarchy was built (0 means never)
+
+        // Returns true if the hierarchy no longer matches the given world
+        bool isStale(const World* world) const;
+        // Sorts the entities of the given world by depth and fills the parent indices
+        void rebuild(const World* world);
+        // Refreshes the matrices of the entities in the range [begin, end) whose parents are already up to date
+        void updateRange(size_t begin, size_t end);
+
+    public:
+        // This function should be called once per frame (after the systems that move the entities and before rendering)
+        // It makes sure that the hierarchy matches the world then refreshes the matrices level by level.
+        // Only the entities whose transform (or an ancestor's transform) changed since the last update are recomputed.
+        // "parallelFor" is called for each depth level as parallelFor(begin, end, function) where "function" takes a
+        // sub-range (begin, end). It can split the range between threads as long as it returns after all the work is done.
+        template<typename ParallelFor>
+        void update(const World* world, ParallelFor&& parallelFor) {
+            if(isStale(world)) rebuild(world);
+            for(size_t level = 0; level + 1 < levels.size(); ++level){
+                parallelFor(levels[level], levels[level + 1], [this](size_t begin, size_t end){ updateRange(begin, end); });
+            }
+        }
+
+        // Same as above but everything is done in one linear pass on the calling thread
+        void update(const World* world) {
+            if(isStale(world)) rebuild(world);
+            updateRange(0, entities.size());
+        }
+
+        // Returns the number of entities in the hierarchy
+        size_t size() const { return entities.size(); }
+        // Returns the number of depth levels in the hierarchy
+        size_t getDepth() const { return levels.empty() ? 0 : levels.size() - 1; }
+        // Returns the entities sorted by depth and their local to world matrices (as computed by the last update)
+        const std::vector<Entity*>& getEntities() const { return entities; }
+        const std::vector<glm::mat4>& getWorldMatrices() const { return worldMatrices; }
+    };
+
+}
@@ -0,0 +1,51 @@
+#include "world-command-buffer.hpp"
+#include "world.hpp"
+
+namespace our {
+
+    void WorldCommandBuffer::playback(World* world) {
+        // We take the commands out of the buffer first so that the buffer can be reused (even by the commands themselves)
+        std::vector<Command> recorded;
+        uint32_t pending;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            recorded.swap(commands);
+            pending = pendingCount;
+            pendingCount = 0;
+        }
+
+        // The entities created by this playback indexed by their pending handle's index - 1
+        std::vector<Entity*> created(pending, nullptr);
+        // Returns the entity referred to by a handle or a nullptr if it no longer exists (or if the handle is null)
+        auto resolve = [&](EntityHandle handle) -> Entity* {
+            if(isPending(handle)) return handle.index <= created.size() ? created[handle.index - 1] : nullptr;
+            return world->get(handle);
+        };
+
+        for(Command& command : recorded){
+            if(command.type == CommandType::Create){
+                created[command.entity.index - 1] = world->add();
+                continue;
+            }
+            Entity* entity = resolve(command.entity);
+            if(!entity) continue; // The entity was deleted before the playback
+            switch(command.type){
+                case CommandType::SetParent:
+                    entity->setParent(resolve(command.parent));
+                    break;
+                case CommandType::Modify:
+                    command.modify(entity);
+                    break;
+                case CommandType::Destroy:
+                    world->addToMarkedEntities(entity);
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        // Finally, we delete the destroyed entities
+        world->destroyMarkedEntities();
+    }
+
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "entity-handle.hpp"
+
+#include <functional>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace our {
+
+    class Entity; // A forward declaration of the Entity Class
+    class World; // A forward declaration of the World Class
+
+    // A world command buffer records changes to the structure of a world (creating and destroying entities,
+    // adding and removing components and changing parents) so that they can be applied later at a sync point.
+    // Recording is thread-safe, so systems running on the job system's threads can record commands while other
+    // threads are iterating over the world, then the commands are played back on the main thread in the order they were recorded.
+    // The entities are referred to by their handles. Since the entities created by the buffer don't exist until the
+    // playback, "createEntity" returns a pending handle that can be used by the following commands in the same buffer.
+    // The commands whose entity was deleted before the playback are skipped.
+    class WorldCommandBuffer {
+        enum class CommandType { Create, SetParent, Modify, Destroy };
+        struct Command {
+            CommandType type;
+            EntityHandle entity; // The entity to which the command is applied
+            EntityHandle parent; // The new parent (only used by "SetParent")
+            std::function<void(Entity*)> modify; // The change to apply to the entity (only used by "Modify")
+        };
+
+        mutable std::mutex mutex; // Guards the members below against concurrent recording
+        std::vector<Command> commands; // The recorded commands in order
+        uint32_t pendingCount = 0; // The number of entities created by the recorded commands
+
+        void record(Command command) {
+            std::lock_guard<std::mutex> lock(mutex);
+            commands.push_back(std::move(command));
+        }
+
+    public:
+        WorldCommandBuffer() = default;
+
+        // Returns true if the handle was returned by "createEntity" and refers to an entity that does not exist yet
+        // Pending handles have a generation of 0 (which real entities never have) and the index of the entity in the buffer + 1
+        static bool isPending(EntityHandle handle) { return handle.generation == 0 && handle.index != 0; }
+
+        // Records the creation of an entity and returns a pending handle to it
+        // The pending handle is only valid inside this buffer, once the buffer is played back, it no longer refers to anything
+        EntityHandle createEntity() {
+            std::lock_guard<std::mutex> lock(mutex);
+            EntityHandle handle = { ++pendingCount, 0 };
+            commands.push_back({ CommandType::Create, handle, {}, nullptr });
+            return handle;
+        }
+
+        // Records a change of the entity's parent (a null handle makes it a root entity)
+        void setParent(EntityHandle entity, EntityHandle parent) {
+            record({ CommandType::SetParent, entity, parent, nullptr });
+        }
+
+        // Records adding a component of type T to the entity then calling "initialize" on it (if given)
+        // NOTE: This template needs the complete Entity class so it is defined at the end of "world.hpp"
+        template<typename T>
+        void addComponent(EntityHandle entity, std::function<void(T*)> initialize = nullptr);
+
+        // Records removing the component of type T from the entity
+        // NOTE: This template needs the complete Entity class so it is defined at the end of "world.hpp"
+        template<typename T>
+        void removeComponent(EntityHandle entity);
+
+        // Records calling the given function on the entity at playback (it runs on the thread that plays the buffer back)
+        void modify(EntityHandle entity, std::function<void(Entity*)> function) {
+            record({ CommandType::Modify, entity, {}, std::move(function) });
+        }
+
+        // Records the deletion of the entity
+        void destroy(EntityHandle entity) {
+            record({ CommandType::Destroy, entity, {}, nullptr });
+        }
+
+        // Returns the number of recorded commands
+        size_t size() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return commands.size();
+        }
+        bool empty() const { return size() == 0; }
+
+        // Applies the recorded commands to the given world in the order they were recorded then empties the buffer
+        // The destroyed entities are deleted at the end of the playback (after all the other commands)
+        // This must not be called while other threads are using the world
+        void playback(World* world);
+
+        // Discards the recorded commands
+        void clear() {
+            std::lock_guard<std::mutex> lock(mutex);
+            commands.clear();
+            pendingCount = 0;
+        }
+
+        // The command buffer should not be copyable
+        WorldCommandBuffer(const WorldCommandBuffer&) = delete;
+        WorldCommandBuffer &operator=(WorldCommandBuffer const &) = delete;
+    };
+
+}
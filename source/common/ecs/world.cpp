@@ -1,5 +1,7 @@
 #include "world.hpp"
 
+#include <algorithm>
+
 namespace our {
 
     // This will deserialize a json array of entities and add the new entities to the current world
@@ -11,7 +13,7 @@ namespace our {
             //TODO: (Req 8) Create an entity, make its parent "parent" and call its deserialize with "entityData".
             // Create an entity using world funtion add which adds entity to entities list and adjust world pointer of entity
             Entity* currentEntity = World::add();
-            currentEntity->parent = parent;
+            currentEntity->setParent(parent);
             currentEntity->deserialize(entityData);
             if(entityData.contains("children")){
                 //TODO: (Req 8) Recursively call this world's "deserialize" using the children data
@@ -21,4 +23,94 @@ namespace our {
         }
     }
 
-}
\ No newline at end of file
+    // This adds an entity to the world and returns a pointer to that entity
+    Entity* World::add() {
+        // Take a free slot from the pool, or grow the pool by one chunk if there is none
+        if(freeSlots.empty()){
+            uint32_t first = static_cast<uint32_t>(slots.size());
+            entityChunks.push_back(std::make_unique<EntityChunk>());
+            slots.resize(first + ENTITY_CHUNK_CAPACITY);
+            // We push the slots in reverse so that they are taken in order
+            for(uint32_t index = first + ENTITY_CHUNK_CAPACITY; index > first; --index) freeSlots.push_back(index - 1);
+        }
+        uint32_t index = freeSlots.back();
+        freeSlots.pop_back();
+        EntitySlot& slot = slots[index];
+        slot.alive = true;
+        // Create a new entity in the slot and set its world member variable to this
+        Entity* entity = new (getSlotAddress(index)) Entity();
+        entity->world = this;
+        entity->handle = { index, slot.generation };
+        // insert it in the list of entities
+        entity->listIndex = static_cast<uint32_t>(entities.size());
+        entities.push_back(entity);
+        ++structureVersion;
+        // returns a pointer to that entity
+        return entity;
+    }
+
+    // Destroys the given entity and frees its slot
+    void World::destroy(Entity* entity){
+        // Remove it from the list of entities by moving the last entity into its place
+        Entity* last = entities.back();
+        entities[entity->listIndex] = last;
+        last->listIndex = entity->listIndex;
+        entities.pop_back();
+        ++structureVersion;
+        // Its parent loses a child (the children of a deleted entity are made root entities before it is destroyed)
+        entity->setParent(nullptr);
+        // Any handle to this entity becomes stale once the generation of its slot changes
+        EntitySlot& slot = slots[entity->handle.index];
+        slot.alive = false;
+        ++slot.generation;
+        freeSlots.push_back(entity->handle.index);
+        // The destructor removes the components of the entity (which also updates the views)
+        // We don't call "delete" since the memory belongs to the entity pool
+        entity->~Entity();
+    }
+
+    // This removes the elements in "markedForRemoval" from the "entities" list.
+    // Then each of these elements are destroyed and their slots are returned to the entity pool.
+    void World::destroyMarkedEntities(){
+        if(markedForRemoval.empty()) return;
+        // The children of the deleted entities become root entities so that they don't point to deleted memory
+        // Finding them requires a pass over all the entities, so we only do it if a deleted entity has children
+        bool hasChildren = std::any_of(markedForRemoval.begin(), markedForRemoval.end(), [](Entity* entity){ return entity->childCount != 0; });
+        if(hasChildren){
+            for(Entity* entity : entities)
+                if(entity->parent && entity->parent->markedForRemoval) entity->setParent(nullptr);
+        }
+        for(Entity* entity : markedForRemoval) destroy(entity);
+        // at the end marked for removal contains all entities that are erased so we must clear it
+        markedForRemoval.clear();
+    }
+
+    //This deletes all entities in the world
+    void World::clear(){
+        // Since every entity is going away, we empty the views and the component storages at once
+        // instead of removing the components entity by entity
+        for(auto& [mask, view] : views) view->clear();
+        for(auto& storage : storages) if(storage) storage->clear();
+        for(Entity* entity : entities){
+            // Its components are already destroyed, so the entity only has to forget them
+            entity->components.clear();
+            entity->componentMask.reset();
+            ++slots[entity->handle.index].generation;
+            entity->~Entity();
+        }
+        entities.clear();
+        ++structureVersion;
+        // at the end marked for removal could contain entities that are erased so we must clear it
+        markedForRemoval.clear();
+        // and the deferred commands refer to entities that no longer exist
+        commands.clear();
+        // Now every slot in the pool is free, so we rebuild the free list in one go
+        // (in reverse so that the next entities are taken from the start of the pool)
+        freeSlots.resize(slots.size());
+        for(size_t index = 0; index < slots.size(); ++index){
+            slots[index].alive = false;
+            freeSlots[index] = static_cast<uint32_t>(slots.size() - 1 - index);
+        }
+    }
+
+}
@@ -1,15 +1,76 @@
 #pragma once
 
 #include <unordered_set>
+#include <unordered_map>
+#include <vector>
+#include <memory>
 #include "entity.hpp"
+#include "component-storage.hpp"
+#include "entity-view.hpp"
+#include "transform-hierarchy.hpp"
+#include "world-command-buffer.hpp"
 
 namespace our {
 
     // This class holds a set of entities
     class World {
-        std::unordered_set<Entity*> entities; // These are the entities held by this world
-        std::unordered_set<Entity*> markedForRemoval; // These are the entities that are awaiting to be deleted
-                                                      // when deleteMarkedEntities is called
+        // The entities live in a pool of fixed-size chunks so they are close together in memory and never move
+        static constexpr size_t ENTITY_CHUNK_CAPACITY = 256;
+        struct EntityChunk {
+            alignas(Entity) unsigned char data[sizeof(Entity) * ENTITY_CHUNK_CAPACITY];
+        };
+        // The state of each slot in the entity pool
+        struct EntitySlot {
+            uint32_t generation = 1; // Incremented whenever the entity in this slot is deleted
+            bool alive = false; // Whether the slot currently holds an entity
+        };
+
+        std::vector<std::unique_ptr<EntityChunk>> entityChunks; // The memory of the entity pool (it is kept after "clear" for reuse)
+        std::vector<EntitySlot> slots; // One entry for each slot in the entity pool
+        std::vector<uint32_t> freeSlots; // The indices of the free slots in the entity pool
+        std::vector<Entity*> entities; // These are the entities held by this world packed together
+        std::vector<Entity*> markedForRemoval; // These are the entities that are awaiting to be deleted
+                                               // at the end of the current command buffer playback
+        WorldCommandBuffer commands; // The deferred commands that are applied when "playback" (or "deleteMarkedEntities") is called
+        uint64_t structureVersion = 1; // This is incremented whenever an entity is added or deleted
+        TransformHierarchy transformHierarchy; // The flattened hierarchy used to update the transforms in bulk
+
+        // Returns the memory of the given slot in the entity pool
+        Entity* getSlotAddress(uint32_t index) {
+            return reinterpret_cast<Entity*>(entityChunks[index / ENTITY_CHUNK_CAPACITY]->data) + index % ENTITY_CHUNK_CAPACITY;
+        }
+        // Destroys the given entity and frees its slot (the entity must be in this world)
+        void destroy(Entity* entity);
+
+        // For every component type, this holds a storage in which all the components of that type are packed together
+        // The storages are indexed by the component type ID (see "getComponentTypeID" in "component.hpp")
+        std::vector<std::unique_ptr<ComponentStorageBase>> storages;
+        // The cached views created by "view" indexed by the mask of the component types they require
+        std::unordered_map<ComponentMask, std::unique_ptr<EntityView>> views;
+
+        friend Entity; // The entities notify the world whenever their components change
+        friend WorldCommandBuffer; // The command buffers delete the entities through the "markedForRemoval" list
+
+        // This adds the entity to the "markedForRemoval" list (if it is in this world and not already there)
+        void addToMarkedEntities(Entity* entity){
+            if(entity->world == this && !entity->markedForRemoval && get(entity->handle) == entity){
+                entity->markedForRemoval = true;
+                markedForRemoval.push_back(entity);
+            }
+        }
+        // This destroys the entities in the "markedForRemoval" list and returns their slots to the entity pool
+        void destroyMarkedEntities();
+
+        // This is called by an entity after a component is added to it or removed from it
+        // It inserts the entity into (or removes it from) the views whose membership changed
+        void onComponentMaskChanged(Entity* entity, const ComponentMask& oldMask){
+            const ComponentMask& newMask = entity->getComponentMask();
+            for(auto& [mask, view] : views){
+                bool wasInView = view->matches(oldMask), isInView = view->matches(newMask);
+                if(wasInView && !isInView) view->erase(entity);
+                else if(!wasInView && isInView) view->insert(entity);
+            }
+        }
     public:
 
         World() = default;
@@ -19,63 +80,129 @@ namespace our {
         // If any of the entities has children, this function will be called recursively for these children
         void deserialize(const nlohmann::json& data, Entity* parent = nullptr);
 
-        // This adds an entity to the entities set and returns a pointer to that entity
+        // This adds an entity to the world and returns a pointer to that entity
         // WARNING The entity is owned by this world so don't use "delete" to delete it, instead, call "markForRemoval"
-        // to put it in the "markedForRemoval" set. The elements in the "markedForRemoval" set will be removed and
-        // deleted when "deleteMarkedEntities" is called.
-        Entity* add() {
-            //TODO: (Req 8) Create a new entity, set its world member variable to this,
-            // and don't forget to insert it in the suitable container.
-            // Create a new entity
-            Entity* entity = new Entity();
-            // set its world member variable to this
-            entity->world = this;
-            // insert it in the suitable container
-            entities.insert(entity);
-            // returns a pointer to that entity
-            return entity;
-        }
-
-        // This returns and immutable reference to the set of all entites in the world.
-        const std::unordered_set<Entity*>& getEntities() {
+        // to record its deletion in the world's command buffer. The recorded entities will be removed and
+        // deleted when "deleteMarkedEntities" (or "playback") is called.
+        // The entity is allocated from the world's entity pool so its address stays valid until it is deleted.
+        // NOTE: This is not thread-safe, so systems running on other threads should use "WorldCommandBuffer::createEntity" instead.
+        Entity* add();
+
+        // This returns an immutable reference to the list of all entites in the world.
+        // The order of the entities is the order of their creation except that deleting an entity moves the last one into its place.
+        const std::vector<Entity*>& getEntities() const {
             return entities;
         }
 
-        // This marks an entity for removal by adding it to the "markedForRemoval" set.
-        // The elements in the "markedForRemoval" set will be removed and deleted when "deleteMarkedEntities" is called.
-        void markForRemoval(Entity* entity){
-            //TODO: (Req 8) If the entity is in this world, add it to the "markedForRemoval" set.
-            if(entities.find(entity) != entities.end()){
-                markedForRemoval.insert(entity);
-            }
+        // This returns a number that changes whenever an entity is added to or deleted from this world
+        uint64_t getStructureVersion() const {
+            return structureVersion;
         }
 
-        // This removes the elements in "markedForRemoval" from the "entities" set.
-        // Then each of these elements are deleted.
-        void deleteMarkedEntities(){
-            //TODO: (Req 8) Remove and delete all the entities that have been marked for removal
-            for (Entity* entity : markedForRemoval){
-                entities.erase(entity);
-                // Erase :: Removes from the vector container and calls its destructor 
-                // but If the contained object is a pointer it doesnt take ownership of destroying it.
-                // so we have to explicitly call delete on each contained pointer to delete the content
-                delete entity;
-            }
-            // at the end marked for removal contains all entities that are erased so we must clear it
-            markedForRemoval.clear();
+        // This returns the entity referred to by the given handle or a nullptr if the handle is stale (or null)
+        Entity* get(EntityHandle handle) {
+            if(handle.index >= slots.size()) return nullptr;
+            const EntitySlot& slot = slots[handle.index];
+            if(!slot.alive || slot.generation != handle.generation) return nullptr;
+            return getSlotAddress(handle.index);
         }
 
-        //This deletes all entities in the world
-        void clear(){
-            //TODO: (Req 8) Delete all the entites and make sure that the containers are empty
-            for (Entity* entity : entities){
-                delete entity;
+        // This returns true if the given handle refers to a live entity in this world
+        bool isAlive(EntityHandle handle) {
+            return get(handle) != nullptr;
+        }
+
+        // This returns the storage holding all the components of type T in this world (the storage is created on first use)
+        // Systems that only care about one component type can iterate over it directly instead of going through the entities
+        template<typename T>
+        ComponentStorage<T>& getStorage() {
+            ComponentTypeID type = getComponentTypeID<T>();
+            if(type >= storages.size()) storages.resize(type + 1);
+            auto& storage = storages[type];
+            if(!storage) storage = std::make_unique<ComponentStorage<T>>();
+            return *static_cast<ComponentStorage<T>*>(storage.get());
+        }
+
+        // This returns the storage of the given component type (it is used when the concrete type is unknown)
+        // Since a component of that type exists, the storage must have been already created by "getStorage<T>"
+        ComponentStorageBase* getStorage(ComponentTypeID type) {
+            return storages[type].get();
+        }
+
+        // This returns a cached list of all the entities that have a component of each of the given types
+        // For example, "world->view<CameraComponent, FreeCameraControllerComponent>()" returns the entities holding both.
+        // The first call builds the list by scanning the world, then the world keeps it up to date incrementally as
+        // components are added and removed and as entities are deleted, so later calls are almost free.
+        // WARNING: Adding or removing components of these types invalidates the returned list, so don't do it while iterating.
+        template<typename... T>
+        const std::vector<Entity*>& view() {
+            ComponentMask mask = getComponentMask<T...>();
+            auto& cached = views[mask];
+            if(!cached){
+                cached = std::make_unique<EntityView>(mask);
+                for(Entity* entity : entities)
+                    if(cached->matches(entity->getComponentMask())) cached->insert(entity);
             }
-            entities.clear();
-            // at the end marked for removal could contain entities that are erased so we must clear it
-            markedForRemoval.clear();
+            return cached->getEntities();
         }
 
+        // This refreshes the cached local to world matrices of all the entities in this world using the flattened transform hierarchy
+        // It should be called once per frame before rendering (see "TransformSystem").
+        // The overload that takes a "parallelFor" can process each depth level on multiple threads (see "TransformHierarchy::update").
+        void updateTransforms() {
+            transformHierarchy.update(this);
+        }
+        template<typename ParallelFor>
+        void updateTransforms(ParallelFor&& parallelFor) {
+            transformHierarchy.update(this, std::forward<ParallelFor>(parallelFor));
+        }
+
+        // This returns the flattened transform hierarchy as it was built by the last "updateTransforms"
+        const TransformHierarchy& getTransformHierarchy() const {
+            return transformHierarchy;
+        }
+
+        // This returns the memory statistics of every component storage in this world
+        std::vector<ComponentStatistics> getComponentStatistics() const {
+            std::vector<ComponentStatistics> statistics;
+            for(auto& storage : storages)
+                if(storage) statistics.push_back(storage->getStatistics());
+            return statistics;
+        }
+
+        // This returns the world's own command buffer. Systems (even the ones running on other threads) can record
+        // structural changes into it, and they are applied the next time "playback" is called (see "world-command-buffer.hpp")
+        WorldCommandBuffer& getCommandBuffer() {
+            return commands;
+        }
+
+        // This is the sync point at which the deferred commands are applied (it must be called on the main thread
+        // while no other thread uses the world, e.g. after the systems are updated and before the transforms are updated)
+        // The first overload applies the world's own command buffer and the second applies the given buffer.
+        void playback() {
+            commands.playback(this);
+        }
+        void playback(WorldCommandBuffer& buffer) {
+            buffer.playback(this);
+        }
+
+        // This marks an entity for removal by recording its deletion in the world's command buffer.
+        // The entity will be deleted when "deleteMarkedEntities" (or "playback") is called.
+        // Like any recording, this is thread-safe.
+        void markForRemoval(Entity* entity){
+            // If the entity is in this world, record its deletion
+            if(entity && entity->world == this) commands.destroy(entity->handle);
+        }
+
+        // This applies the world's command buffer which deletes the entities marked for removal
+        // (along with any other deferred command recorded before this call)
+        void deleteMarkedEntities() {
+            playback();
+        }
+
+        //This deletes all entities in the world
+        void clear();
+
         //Since the world owns all of its entities, they should be deleted alongside it.
         ~World(){
             clear();
@@ -86,4 +213,41 @@ namespace our {
         World &operator=(World const &) = delete;
     };
 
-}
\ No newline at end of file
+    // The definition of the entity's "addComponent" template (see "entity.hpp")
+    template<typename T>
+    T* Entity::addComponent(){
+        static_assert(std::is_base_of<Component, T>::value, "T must inherit from Component");
+        ComponentTypeID type = getComponentTypeID<T>();
+        // An entity can only have one component of each type
+        if(componentMask.test(type)) return static_cast<T*>(components[getSlotIndex(type)].component);
+        // Create a component of type T in the world's storage for that type
+        T* newComponent = world->getStorage<T>().create();
+        // Set its "owner" to be this entity
+        newComponent->owner = this;
+        // then insert it into the component's list (keeping the list sorted by type)
+        this->components.insert(this->components.begin() + getSlotIndex(type), {newComponent, type});
+        ComponentMask oldMask = componentMask;
+        componentMask.set(type);
+        // Let the world update its views
+        world->onComponentMaskChanged(this, oldMask);
+        // Don't forget to return a pointer to the new component
+        return newComponent;
+    }
+
+    // The definitions of the command buffer's component templates (see "world-command-buffer.hpp")
+    template<typename T>
+    void WorldCommandBuffer::addComponent(EntityHandle entity, std::function<void(T*)> initialize){
+        static_assert(std::is_base_of<Component, T>::value, "T must inherit from Component");
+        modify(entity, [initialize = std::move(initialize)](Entity* owner){
+            T* component = owner->addComponent<T>();
+            if(initialize) initialize(component);
+        });
+    }
+
+    template<typename T>
+    void WorldCommandBuffer::removeComponent(EntityHandle entity){
+        static_assert(std::is_base_of<Component, T>::value, "T must inherit from Component");
+        modify(entity, [](Entity* owner){ owner->deleteComponent<T>(); });
+    }
+
+}
@@ -0,0 +1,110 @@
+#include "ring-buffer.hpp"
+#include "state-cache.hpp"
+
+#include <cassert>
+
+namespace our {
+
+    // The smallest region size (so that small scenes don't reallocate the buffer a few times while they grow)
+    static constexpr size_t MIN_REGION_SIZE = 64 * 1024;
+
+    RingBuffer::RingBuffer(GLenum target, size_t alignment, bool persistent)
+        : target(target), alignment(alignment > 0 ? alignment : 1), persistent(persistent && isPersistentMappingSupported()) {}
+
+    bool RingBuffer::isPersistentMappingSupported() {
+        return GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage;
+    }
+
+    void RingBuffer::create(size_t size) {
+        regionSize = size;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(target, buffer);
+        if(persistent){
+            // Coherent mapping makes the CPU writes visible to the GPU without flushing them explicitly
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(target, regionSize * REGIONS, nullptr, flags);
+            mapped = static_cast<uint8_t*>(glMapBufferRange(target, 0, regionSize * REGIONS, flags));
+        } else {
+            glBufferData(target, regionSize, nullptr, GL_STREAM_DRAW);
+            staging.resize(regionSize);
+        }
+        glBindBuffer(target, 0);
+        ++statistics.reallocations;
+    }
+
+    void RingBuffer::destroy() {
+        // OpenGL keeps the storage alive until the GPU is done with it, so the fences are deleted without waiting for them
+        for(GLsync& fence : fences){
+            if(fence) glDeleteSync(fence);
+            fence = nullptr;
+        }
+        if(buffer == 0) return;
+        if(mapped){
+            glBindBuffer(target, buffer);
+            glUnmapBuffer(target);
+            glBindBuffer(target, 0);
+            mapped = nullptr;
+        }
+        GLStateCache::get().forgetBuffer(buffer);
+        glDeleteBuffers(1, &buffer);
+        buffer = 0;
+        regionSize = 0;
+    }
+
+    void RingBuffer::wait(int region) {
+        GLsync& fence = fences[region];
+        if(!fence) return;
+        // We first check if the GPU is already done (which is the common case) before actually waiting
+        GLenum result = glClientWaitSync(fence, 0, 0);
+        if(result == GL_TIMEOUT_EXPIRED){
+            ++statistics.waits;
+            // The flush makes sure the fence reaches the GPU, otherwise we could wait forever
+            do {
+                result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            } while(result == GL_TIMEOUT_EXPIRED);
+        }
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    void RingBuffer::begin(size_t capacity) {
+        cursor = 0;
+        if(capacity > regionSize){
+            // The regions grow to the next power of two so that the buffer is rarely reallocated
+            size_t size = MIN_REGION_SIZE;
+            while(size < capacity) size <<= 1;
+            destroy();
+            create(size);
+            region = 0;
+        } else if(persistent) {
+            region = (region + 1) % REGIONS;
+            wait(region);
+        }
+    }
+
+    size_t RingBuffer::allocate(size_t size) {
+        size_t offset = cursor;
+        cursor += align(size);
+        assert(cursor <= regionSize && "The ring buffer frame allocated more than the capacity given to begin");
+        // The regions start at multiples of their size which is a power of two (so they are aligned too)
+        return persistent ? region * regionSize + offset : offset;
+    }
+
+    void RingBuffer::upload() {
+        if(persistent || cursor == 0) return;
+        glBindBuffer(target, buffer);
+        // Orphaning: the old storage stays alive while the GPU reads it, and we write to new storage without waiting
+        glBufferData(target, regionSize, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(target, 0, cursor, staging.data());
+        glBindBuffer(target, 0);
+    }
+
+    void RingBuffer::end() {
+        statistics.bytes = cursor;
+        if(!persistent || !buffer) return;
+        // If "begin" was not called since the last "end", the region is fenced again (so the older fence is not needed anymore)
+        if(fences[region]) glDeleteSync(fences[region]);
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+}
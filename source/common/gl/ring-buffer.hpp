@@ -0,0 +1,90 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+namespace our {
+
+    // The statistics of the last frame written to a ring buffer
+    struct RingBufferStatistics {
+        size_t bytes = 0; // The number of bytes written in the last frame (including the alignment padding)
+        size_t waits = 0; // The number of times the CPU had to wait for the GPU to finish reading a region since the buffer was created
+        size_t reallocations = 0; // The number of times the buffer storage was reallocated since the buffer was created
+    };
+
+    // A ring buffer streams data that is written by the CPU every frame and read by the GPU once (e.g. the per-draw uniform blocks).
+    // The data of each frame is written with "allocate" (or "push") between "begin" and "end", and bound by its offset.
+    // There are two ways to avoid overwriting data that the GPU has not read yet:
+    // - Persistent mapping (GL 4.4 or ARB_buffer_storage): the buffer is mapped once and split into REGIONS regions.
+    //   Each frame writes to the next region directly through the mapped pointer, and "end" inserts a fence after the frame's commands.
+    //   Before a region is reused, we wait for its fence, which only blocks if the GPU is more than REGIONS - 1 frames behind.
+    // - Orphaning (GL 3.3): the frame's data is written to a CPU array and "upload" reallocates the buffer storage (glBufferData with null)
+    //   before copying the data, so the driver can keep the old storage alive for the GPU instead of waiting for it.
+    class RingBuffer {
+    public:
+        // The number of regions of a persistently mapped buffer (one being written by the CPU and the rest in flight on the GPU)
+        static constexpr int REGIONS = 3;
+
+    private:
+        GLenum target; // The buffer target used to allocate and upload the buffer (e.g. GL_UNIFORM_BUFFER)
+        size_t alignment; // Every allocation starts at a multiple of this (e.g. GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT)
+        bool persistent; // True if the buffer is persistently mapped
+
+        GLuint buffer = 0;
+        size_t regionSize = 0; // The size of a region (the whole buffer if it is orphaned)
+        uint8_t* mapped = nullptr; // The mapped storage of a persistent buffer
+        std::vector<uint8_t> staging; // The data of the current frame of an orphaned buffer
+        GLsync fences[REGIONS] = {};
+        int region = 0; // The region that is being written
+        size_t cursor = 0; // The offset of the next allocation within the region
+        RingBufferStatistics statistics;
+
+        // Creates the buffer storage such that each region can hold "size" bytes
+        void create(size_t size);
+        // Deletes the buffer (after waiting for the GPU to finish with it)
+        void destroy();
+        // Waits until the GPU is done with the given region
+        void wait(int region);
+
+    public:
+        // The buffer is persistently mapped if "persistent" is true and the driver supports it (see "isPersistentMappingSupported")
+        RingBuffer(GLenum target, size_t alignment, bool persistent);
+        ~RingBuffer() { destroy(); }
+
+        // Returns true if the context supports persistently mapped buffers
+        static bool isPersistentMappingSupported();
+
+        // Rounds a size up to the alignment of the allocations
+        size_t align(size_t size) const { return (size + alignment - 1) / alignment * alignment; }
+
+        // Starts a frame that allocates at most "capacity" bytes (the aligned sizes of all its allocations)
+        // The buffer grows if the current regions are too small
+        void begin(size_t capacity);
+        // Allocates "size" bytes and returns their offset in the buffer (which is what glBindBufferRange expects)
+        size_t allocate(size_t size);
+        // Returns a pointer through which the data at the given offset (returned by "allocate") is written
+        uint8_t* data(size_t offset) { return persistent ? mapped + offset : staging.data() + offset; }
+        // Allocates space for a value, copies it and returns its offset
+        template<typename T>
+        size_t push(const T& value) {
+            size_t offset = allocate(sizeof(T));
+            std::memcpy(data(offset), &value, sizeof(T));
+            return offset;
+        }
+        // Makes the data written since "begin" visible to the GPU (it must be called before drawing with it)
+        void upload();
+        // Ends the frame (it must be called after all the commands reading the frame's data were issued)
+        void end();
+
+        GLuint getBuffer() const { return buffer; }
+        bool isPersistent() const { return persistent; }
+        const RingBufferStatistics& getStatistics() const { return statistics; }
+
+        RingBuffer(const RingBuffer&) = delete;
+        RingBuffer& operator=(const RingBuffer&) = delete;
+    };
+
+}
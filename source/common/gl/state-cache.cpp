@@ -0,0 +1,294 @@
+#include "state-cache.hpp"
+
+#include <iostream>
+
+namespace our {
+
+    GLStateCache& GLStateCache::get() {
+        static GLStateCache cache;
+        return cache;
+    }
+
+    int GLStateCache::getCapabilityIndex(GLenum capability) {
+        switch(capability){
+            case GL_CULL_FACE: return CULL_FACE;
+            case GL_DEPTH_TEST: return DEPTH_TEST;
+            case GL_BLEND: return BLEND;
+            default: return -1;
+        }
+    }
+
+    bool GLStateCache::check(const char* name, GLint expected, GLint actual) {
+        if(expected == actual) return true;
+        std::cerr << "GL state cache mismatch: " << name << " is " << actual << " but the cache has " << expected << std::endl;
+        return false;
+    }
+
+    void GLStateCache::invalidate() {
+        for(auto& capability : capabilities) capability = UNKNOWN_FLAG;
+        cullFaceMode = frontFaceMode = depthFunction = blendEquationMode = blendSource = blendDestination = UNKNOWN;
+        blendConstantKnown = false;
+        for(auto& mask : colorWriteMask) mask = UNKNOWN_FLAG;
+        depthWriteMask = UNKNOWN_FLAG;
+        program = vertexArray = activeUnit = UNKNOWN;
+        for(GLuint unit = 0; unit < TEXTURE_UNITS; ++unit) textures[unit] = samplers[unit] = UNKNOWN;
+        for(auto& range : uniformBuffers) range = { UNKNOWN, 0, 0 };
+    }
+
+    size_t GLStateCache::validate() {
+        size_t mismatches = 0;
+        auto compare = [&](const char* name, GLuint expected, GLenum parameter){
+            if(expected == UNKNOWN) return;
+            GLint actual = 0;
+            glGetIntegerv(parameter, &actual);
+            if(!check(name, static_cast<GLint>(expected), actual)) ++mismatches;
+        };
+        const GLenum capabilityEnums[CAPABILITY_COUNT] = { GL_CULL_FACE, GL_DEPTH_TEST, GL_BLEND };
+        const char* capabilityNames[CAPABILITY_COUNT] = { "GL_CULL_FACE", "GL_DEPTH_TEST", "GL_BLEND" };
+        for(int index = 0; index < CAPABILITY_COUNT; ++index){
+            if(capabilities[index] == UNKNOWN_FLAG) continue;
+            if(!check(capabilityNames[index], capabilities[index], glIsEnabled(capabilityEnums[index]) ? 1 : 0)) ++mismatches;
+        }
+        compare("GL_CULL_FACE_MODE", cullFaceMode, GL_CULL_FACE_MODE);
+        compare("GL_FRONT_FACE", frontFaceMode, GL_FRONT_FACE);
+        compare("GL_DEPTH_FUNC", depthFunction, GL_DEPTH_FUNC);
+        compare("GL_BLEND_EQUATION_RGB", blendEquationMode, GL_BLEND_EQUATION_RGB);
+        compare("GL_BLEND_SRC_RGB", blendSource, GL_BLEND_SRC_RGB);
+        compare("GL_BLEND_DST_RGB", blendDestination, GL_BLEND_DST_RGB);
+        if(blendConstantKnown){
+            glm::vec4 actual;
+            glGetFloatv(GL_BLEND_COLOR, &actual.r);
+            if(actual != blendConstant){
+                std::cerr << "GL state cache mismatch: GL_BLEND_COLOR differs from the cache" << std::endl;
+                ++mismatches;
+            }
+        }
+        GLboolean colorMaskValue[4];
+        glGetBooleanv(GL_COLOR_WRITEMASK, colorMaskValue);
+        for(int channel = 0; channel < 4; ++channel)
+            if(colorWriteMask[channel] != UNKNOWN_FLAG && !check("GL_COLOR_WRITEMASK", colorWriteMask[channel], colorMaskValue[channel] ? 1 : 0)) ++mismatches;
+        if(depthWriteMask != UNKNOWN_FLAG){
+            GLboolean depthMaskValue;
+            glGetBooleanv(GL_DEPTH_WRITEMASK, &depthMaskValue);
+            if(!check("GL_DEPTH_WRITEMASK", depthWriteMask, depthMaskValue ? 1 : 0)) ++mismatches;
+        }
+        compare("GL_CURRENT_PROGRAM", program, GL_CURRENT_PROGRAM);
+        compare("GL_VERTEX_ARRAY_BINDING", vertexArray, GL_VERTEX_ARRAY_BINDING);
+
+        // The texture and sampler bindings can only be read for the active unit, so we visit every unit then restore the active one
+        GLint active = 0;
+        glGetIntegerv(GL_ACTIVE_TEXTURE, &active);
+        if(activeUnit != UNKNOWN && !check("GL_ACTIVE_TEXTURE", static_cast<GLint>(GL_TEXTURE0 + activeUnit), active)) ++mismatches;
+        for(GLuint unit = 0; unit < TEXTURE_UNITS; ++unit){
+            if(textures[unit] == UNKNOWN && samplers[unit] == UNKNOWN) continue;
+            glActiveTexture(GL_TEXTURE0 + unit);
+            compare("GL_TEXTURE_BINDING_2D", textures[unit], GL_TEXTURE_BINDING_2D);
+            compare("GL_SAMPLER_BINDING", samplers[unit], GL_SAMPLER_BINDING);
+        }
+        glActiveTexture(active);
+
+        for(GLuint binding = 0; binding < UNIFORM_BUFFER_BINDINGS; ++binding){
+            if(uniformBuffers[binding].buffer == UNKNOWN) continue;
+            if(!checkUniformBuffer(binding)) ++mismatches;
+        }
+        return mismatches;
+    }
+
+    void GLStateCache::setCapability(GLenum capability, bool enable) {
+        int index = getCapabilityIndex(capability);
+        if(index < 0){
+            // Not shadowed, so we can't know if it changes anything
+            if(enable) glEnable(capability); else glDisable(capability);
+            ++statistics.stateCalls;
+            return;
+        }
+        int8_t value = enable ? 1 : 0;
+        if(changeState(capabilities[index] != value)){
+            if(enable) glEnable(capability); else glDisable(capability);
+            capabilities[index] = value;
+        }
+        if(validation) check("capability", value, glIsEnabled(capability) ? 1 : 0);
+    }
+
+    void GLStateCache::cullFace(GLenum mode) {
+        if(changeState(cullFaceMode != mode)){
+            glCullFace(mode);
+            cullFaceMode = mode;
+        }
+        if(validation){ GLint actual; glGetIntegerv(GL_CULL_FACE_MODE, &actual); check("GL_CULL_FACE_MODE", mode, actual); }
+    }
+
+    void GLStateCache::frontFace(GLenum mode) {
+        if(changeState(frontFaceMode != mode)){
+            glFrontFace(mode);
+            frontFaceMode = mode;
+        }
+        if(validation){ GLint actual; glGetIntegerv(GL_FRONT_FACE, &actual); check("GL_FRONT_FACE", mode, actual); }
+    }
+
+    void GLStateCache::depthFunc(GLenum function) {
+        if(changeState(depthFunction != function)){
+            glDepthFunc(function);
+            depthFunction = function;
+        }
+        if(validation){ GLint actual; glGetIntegerv(GL_DEPTH_FUNC, &actual); check("GL_DEPTH_FUNC", function, actual); }
+    }
+
+    void GLStateCache::blendEquation(GLenum mode) {
+        if(changeState(blendEquationMode != mode)){
+            glBlendEquation(mode);
+            blendEquationMode = mode;
+        }
+        if(validation){ GLint actual; glGetIntegerv(GL_BLEND_EQUATION_RGB, &actual); check("GL_BLEND_EQUATION_RGB", mode, actual); }
+    }
+
+    void GLStateCache::blendFunc(GLenum source, GLenum destination) {
+        if(changeState(blendSource != source || blendDestination != destination)){
+            glBlendFunc(source, destination);
+            blendSource = source;
+            blendDestination = destination;
+        }
+        if(validation){
+            GLint actual;
+            glGetIntegerv(GL_BLEND_SRC_RGB, &actual); check("GL_BLEND_SRC_RGB", source, actual);
+            glGetIntegerv(GL_BLEND_DST_RGB, &actual); check("GL_BLEND_DST_RGB", destination, actual);
+        }
+    }
+
+    void GLStateCache::blendColor(const glm::vec4& color) {
+        if(changeState(!blendConstantKnown || blendConstant != color)){
+            glBlendColor(color.r, color.g, color.b, color.a);
+            blendConstant = color;
+            blendConstantKnown = true;
+        }
+        if(validation){
+            glm::vec4 actual;
+            glGetFloatv(GL_BLEND_COLOR, &actual.r);
+            if(actual != color) std::cerr << "GL state cache mismatch: GL_BLEND_COLOR differs from the cache" << std::endl;
+        }
+    }
+
+    void GLStateCache::colorMask(const glm::bvec4& mask) {
+        bool changed = false;
+        for(int channel = 0; channel < 4; ++channel) changed = changed || colorWriteMask[channel] != (mask[channel] ? 1 : 0);
+        if(changeState(changed)){
+            glColorMask(mask.r, mask.g, mask.b, mask.a);
+            for(int channel = 0; channel < 4; ++channel) colorWriteMask[channel] = mask[channel] ? 1 : 0;
+        }
+        if(validation){
+            GLboolean actual[4];
+            glGetBooleanv(GL_COLOR_WRITEMASK, actual);
+            for(int channel = 0; channel < 4; ++channel) check("GL_COLOR_WRITEMASK", mask[channel] ? 1 : 0, actual[channel] ? 1 : 0);
+        }
+    }
+
+    void GLStateCache::depthMask(bool mask) {
+        int8_t value = mask ? 1 : 0;
+        if(changeState(depthWriteMask != value)){
+            glDepthMask(mask);
+            depthWriteMask = value;
+        }
+        if(validation){ GLboolean actual; glGetBooleanv(GL_DEPTH_WRITEMASK, &actual); check("GL_DEPTH_WRITEMASK", value, actual ? 1 : 0); }
+    }
+
+    void GLStateCache::useProgram(GLuint program) {
+        if(changeBinding(this->program != program)){
+            glUseProgram(program);
+            this->program = program;
+        }
+        if(validation){ GLint actual; glGetIntegerv(GL_CURRENT_PROGRAM, &actual); check("GL_CURRENT_PROGRAM", program, actual); }
+    }
+
+    void GLStateCache::bindVertexArray(GLuint vertexArray) {
+        if(changeBinding(this->vertexArray != vertexArray)){
+            glBindVertexArray(vertexArray);
+            this->vertexArray = vertexArray;
+        }
+        if(validation){ GLint actual; glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &actual); check("GL_VERTEX_ARRAY_BINDING", vertexArray, actual); }
+    }
+
+    void GLStateCache::activeTexture(GLuint unit) {
+        if(changeBinding(activeUnit != unit)){
+            glActiveTexture(GL_TEXTURE0 + unit);
+            activeUnit = unit;
+        }
+        if(validation){ GLint actual; glGetIntegerv(GL_ACTIVE_TEXTURE, &actual); check("GL_ACTIVE_TEXTURE", GL_TEXTURE0 + unit, actual); }
+    }
+
+    void GLStateCache::bindTexture(GLuint texture) {
+        // If we don't know which unit is active (or it is not shadowed), we can't know what is bound to it
+        if(activeUnit >= TEXTURE_UNITS){
+            glBindTexture(GL_TEXTURE_2D, texture);
+            ++statistics.bindCalls;
+            return;
+        }
+        if(changeBinding(textures[activeUnit] != texture)){
+            glBindTexture(GL_TEXTURE_2D, texture);
+            textures[activeUnit] = texture;
+        }
+        if(validation){ GLint actual; glGetIntegerv(GL_TEXTURE_BINDING_2D, &actual); check("GL_TEXTURE_BINDING_2D", texture, actual); }
+    }
+
+    void GLStateCache::bindSampler(GLuint unit, GLuint sampler) {
+        if(unit >= TEXTURE_UNITS){
+            glBindSampler(unit, sampler);
+            ++statistics.bindCalls;
+            return;
+        }
+        if(changeBinding(samplers[unit] != sampler)){
+            glBindSampler(unit, sampler);
+            samplers[unit] = sampler;
+        }
+        // The sampler binding can only be read for the active unit
+        if(validation && unit == activeUnit){ GLint actual; glGetIntegerv(GL_SAMPLER_BINDING, &actual); check("GL_SAMPLER_BINDING", sampler, actual); }
+    }
+
+    void GLStateCache::bindUniformBuffer(GLuint binding, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+        if(binding >= UNIFORM_BUFFER_BINDINGS){
+            glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, offset, size);
+            ++statistics.bindCalls;
+            return;
+        }
+        BufferRange& range = uniformBuffers[binding];
+        if(changeBinding(range.buffer != buffer || range.offset != offset || range.size != size)){
+            glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, offset, size);
+            range = { buffer, offset, size };
+        }
+        if(validation) checkUniformBuffer(binding);
+    }
+
+    bool GLStateCache::checkUniformBuffer(GLuint binding) {
+        const BufferRange& range = uniformBuffers[binding];
+        GLint buffer = 0;
+        GLint64 offset = 0, size = 0;
+        glGetIntegeri_v(GL_UNIFORM_BUFFER_BINDING, binding, &buffer);
+        glGetInteger64i_v(GL_UNIFORM_BUFFER_START, binding, &offset);
+        glGetInteger64i_v(GL_UNIFORM_BUFFER_SIZE, binding, &size);
+        bool matches = check("GL_UNIFORM_BUFFER_BINDING", static_cast<GLint>(range.buffer), buffer);
+        matches = check("GL_UNIFORM_BUFFER_START", static_cast<GLint>(range.offset), static_cast<GLint>(offset)) && matches;
+        matches = check("GL_UNIFORM_BUFFER_SIZE", static_cast<GLint>(range.size), static_cast<GLint>(size)) && matches;
+        return matches;
+    }
+
+    void GLStateCache::forgetProgram(GLuint program) {
+        // A deleted program stays in use until another one is used, but we can't tell when its name is reused
+        if(this->program == program) this->program = UNKNOWN;
+    }
+
+    void GLStateCache::forgetVertexArray(GLuint vertexArray) {
+        if(this->vertexArray == vertexArray) this->vertexArray = UNKNOWN;
+    }
+
+    void GLStateCache::forgetTexture(GLuint texture) {
+        for(auto& bound : textures) if(bound == texture) bound = UNKNOWN;
+    }
+
+    void GLStateCache::forgetSampler(GLuint sampler) {
+        for(auto& bound : samplers) if(bound == sampler) bound = UNKNOWN;
+    }
+
+    void GLStateCache::forgetBuffer(GLuint buffer) {
+        for(auto& range : uniformBuffers) if(range.buffer == buffer) range.buffer = UNKNOWN;
+    }
+
+}
\ No newline at end of file
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+
+namespace our {
+
+    // The number of calls that went through the state cache since the statistics were last reset
+    struct GLStateStatistics {
+        size_t stateCalls = 0; // The pipeline state calls (glEnable, glDepthFunc, glBlendFunc, ...) that were sent to OpenGL
+        size_t stateSkipped = 0; // The pipeline state calls that were skipped since OpenGL already had the same value
+        size_t bindCalls = 0; // The binding calls (glUseProgram, glBindVertexArray, glBindTexture, ...) that were sent to OpenGL
+        size_t bindSkipped = 0; // The binding calls that were skipped since the same object was already bound
+        size_t uniformCalls = 0; // The uniform uploads (glUniform*) that were sent to OpenGL
+        size_t uniformSkipped = 0; // The uniform uploads that were skipped since the uniform already had the same value
+    };
+
+    // OpenGL calls are expensive even when they don't change anything (the driver still validates them), and the renderer
+    // sets up the whole pipeline state and rebinds the shader, the textures and the vertex array for every draw.
+    // The state cache keeps a shadow copy of the OpenGL state that the engine changes, so it can skip the calls that would
+    // set a value that OpenGL already has. To keep the shadow correct, every change to this state must go through the cache.
+    // Code that changes the state directly (e.g. ImGui) must call "invalidate" afterwards, which makes the cache forget
+    // everything so the next call of each kind is always sent to OpenGL.
+    // There is a single cache since the application has a single OpenGL context.
+    // In validation mode, the shadow is compared to the values returned by glGet* after every call (which is very slow,
+    // since every glGet* waits for the driver) and every mismatch is printed to the console.
+    class GLStateCache {
+    public:
+        // The number of texture units whose bindings are shadowed (the bindings of the other units always reach OpenGL)
+        static constexpr GLuint TEXTURE_UNITS = 16;
+        // The number of uniform buffer binding points whose bindings are shadowed
+        static constexpr GLuint UNIFORM_BUFFER_BINDINGS = 8;
+
+    private:
+        // The values used for the state that the cache does not know (so the next call is always sent to OpenGL)
+        static constexpr GLuint UNKNOWN = 0xFFFFFFFFu;
+        static constexpr int8_t UNKNOWN_FLAG = -1;
+
+        // The shadowed capabilities (the ones that are set by the pipeline state)
+        enum Capability { CULL_FACE, DEPTH_TEST, BLEND, CAPABILITY_COUNT };
+        int8_t capabilities[CAPABILITY_COUNT];
+
+        GLenum cullFaceMode, frontFaceMode, depthFunction, blendEquationMode, blendSource, blendDestination;
+        glm::vec4 blendConstant;
+        bool blendConstantKnown;
+        int8_t colorWriteMask[4];
+        int8_t depthWriteMask;
+
+        GLuint program, vertexArray, activeUnit;
+        GLuint textures[TEXTURE_UNITS], samplers[TEXTURE_UNITS];
+        // The buffer range bound to each uniform buffer binding point (the buffer is UNKNOWN if we don't know it)
+        struct BufferRange {
+            GLuint buffer;
+            GLintptr offset;
+            GLsizeiptr size;
+        };
+        BufferRange uniformBuffers[UNIFORM_BUFFER_BINDINGS];
+
+        bool enabled = true; // If false, every call is sent to OpenGL (to measure what the cache saves)
+        bool validation = false;
+        GLStateStatistics statistics;
+
+        GLStateCache() { invalidate(); }
+
+        // Returns true if the call should be sent to OpenGL (and counts it)
+        bool changeState(bool changed) {
+            changed = changed || !enabled;
+            if(changed) ++statistics.stateCalls; else ++statistics.stateSkipped;
+            return changed;
+        }
+        bool changeBinding(bool changed) {
+            changed = changed || !enabled;
+            if(changed) ++statistics.bindCalls; else ++statistics.bindSkipped;
+            return changed;
+        }
+        // Maps a capability enum to its index in "capabilities" (or -1 if it is not shadowed)
+        static int getCapabilityIndex(GLenum capability);
+        // Prints a mismatch between the shadow and OpenGL if they are different (only used in validation mode)
+        // Returns true if they match
+        static bool check(const char* name, GLint expected, GLint actual);
+        // Compares the shadowed range of a uniform buffer binding point to OpenGL and returns true if they match
+        bool checkUniformBuffer(GLuint binding);
+
+    public:
+        // Returns the cache of the application's OpenGL context
+        static GLStateCache& get();
+
+        // Forgets the whole shadow state, so the next call of each kind is sent to OpenGL
+        // This must be called after any code changes the shadowed state without going through the cache
+        void invalidate();
+
+        // If the cache is disabled, every call is sent to OpenGL (the counters still count them)
+        void setEnabled(bool enabled) { this->enabled = enabled; }
+        bool isEnabled() const { return enabled; }
+        // If validation is enabled, the shadow is compared to the actual OpenGL state after every call
+        void setValidation(bool validation) { this->validation = validation; }
+        bool isValidating() const { return validation; }
+        // Compares the whole shadow to the actual OpenGL state and returns the number of mismatches (the unknown values are skipped)
+        size_t validate();
+
+        // The shader programs shadow their own uniform values (see "ShaderProgram"), they only ask the cache whether
+        // an upload should be sent so that disabling the cache disables the uniform shadowing too (and the uploads are counted)
+        bool changeUniform(bool changed) {
+            changed = changed || !enabled;
+            if(changed) ++statistics.uniformCalls; else ++statistics.uniformSkipped;
+            return changed;
+        }
+
+        const GLStateStatistics& getStatistics() const { return statistics; }
+        void resetStatistics() { statistics = GLStateStatistics(); }
+
+        // Pipeline state (only GL_CULL_FACE, GL_DEPTH_TEST and GL_BLEND are shadowed, the others are always sent to OpenGL)
+        void setCapability(GLenum capability, bool enable);
+        void cullFace(GLenum mode);
+        void frontFace(GLenum mode);
+        void depthFunc(GLenum function);
+        void blendEquation(GLenum mode);
+        void blendFunc(GLenum source, GLenum destination);
+        void blendColor(const glm::vec4& color);
+        void colorMask(const glm::bvec4& mask);
+        void depthMask(bool mask);
+
+        // Bindings
+        void useProgram(GLuint program);
+        void bindVertexArray(GLuint vertexArray);
+        // Selects the texture unit that "bindTexture" binds to (the unit is an index, not GL_TEXTURE0 + index)
+        void activeTexture(GLuint unit);
+        // Binds a 2D texture to the active texture unit
+        void bindTexture(GLuint texture);
+        // Binds a 2D texture to the given texture unit (and makes it the active unit)
+        void bindTexture(GLuint unit, GLuint texture) { activeTexture(unit); bindTexture(texture); }
+        void bindSampler(GLuint unit, GLuint sampler);
+        // Binds a range of a buffer to a uniform buffer binding point (using glBindBufferRange)
+        // Note that this also binds the buffer to the generic GL_UNIFORM_BUFFER target, which is not shadowed
+        void bindUniformBuffer(GLuint binding, GLuint buffer, GLintptr offset, GLsizeiptr size);
+
+        // These must be called when an object is deleted since OpenGL unbinds it and may reuse its name for a new object
+        void forgetProgram(GLuint program);
+        void forgetVertexArray(GLuint vertexArray);
+        void forgetTexture(GLuint texture);
+        void forgetSampler(GLuint sampler);
+        void forgetBuffer(GLuint buffer);
+
+        GLStateCache(const GLStateCache&) = delete;
+        GLStateCache& operator=(const GLStateCache&) = delete;
+    };
+
+}
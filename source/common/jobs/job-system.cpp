@@ -0,0 +1,128 @@
+#include "job-system.hpp"
+
+namespace our {
+
+    thread_local size_t JobSystem::currentThreadIndex = 0;
+
+    JobSystem::JobSystem(int workerCount) {
+        if(workerCount < 0){
+            // hardware_concurrency may return 0 if it can't tell, in which case we run everything on the calling thread
+            unsigned int hardwareThreads = std::thread::hardware_concurrency();
+            workerCount = hardwareThreads > 1 ? static_cast<int>(hardwareThreads) - 1 : 0;
+        }
+        for(int index = 0; index <= workerCount; ++index) queues.push_back(std::make_unique<WorkQueue>());
+        for(int index = 0; index < workerCount; ++index) workers.emplace_back(&JobSystem::workerLoop, this, index + 1);
+    }
+
+    JobSystem::~JobSystem() {
+        // Finish whatever is still queued, then tell the workers to leave
+        while(queuedJobs.load() != 0) if(!runNext()) std::this_thread::yield();
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        for(auto& worker : workers) worker.join();
+    }
+
+    void JobSystem::enqueue(JobHandle job) {
+        size_t index = currentThreadIndex < queues.size() ? currentThreadIndex : 0;
+        {
+            // The counter is changed under the sleep mutex so that a worker that is about to sleep can't miss the job
+            // It is incremented before the job is published, otherwise a thief could take the job and decrement it first
+            // (a worker that wakes up in between finds no job and simply looks again)
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            queuedJobs.fetch_add(1);
+        }
+        {
+            std::lock_guard<std::mutex> lock(queues[index]->mutex);
+            queues[index]->jobs.push_back(std::move(job));
+        }
+        wakeUp.notify_one();
+    }
+
+    bool JobSystem::runNext() {
+        size_t index = currentThreadIndex < queues.size() ? currentThreadIndex : 0;
+        JobHandle job;
+        {
+            // First, we take the newest job from our own queue
+            WorkQueue& queue = *queues[index];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if(!queue.jobs.empty()){
+                job = std::move(queue.jobs.back());
+                queue.jobs.pop_back();
+            }
+        }
+        // If our queue is empty, we try to steal the oldest job of the other threads starting from our neighbour
+        for(size_t offset = 1; !job && offset < queues.size(); ++offset){
+            WorkQueue& queue = *queues[(index + offset) % queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if(!queue.jobs.empty()){
+                job = std::move(queue.jobs.front());
+                queue.jobs.pop_front();
+            }
+        }
+        if(!job) return false;
+        queuedJobs.fetch_sub(1);
+        execute(job);
+        return true;
+    }
+
+    void JobSystem::execute(const JobHandle& job) {
+        job->function();
+        job->function = nullptr; // Release whatever the function captured
+        std::vector<JobHandle> continuations;
+        {
+            std::lock_guard<std::mutex> lock(job->continuationsMutex);
+            job->finished.store(true, std::memory_order_release);
+            continuations.swap(job->continuations);
+        }
+        for(auto& continuation : continuations) releaseDependency(continuation);
+    }
+
+    void JobSystem::releaseDependency(const JobHandle& job) {
+        if(job->pendingDependencies.fetch_sub(1, std::memory_order_acq_rel) == 1) enqueue(job);
+    }
+
+    void JobSystem::workerLoop(size_t index) {
+        currentThreadIndex = index;
+        while(true){
+            if(runNext()) continue;
+            // There is nothing to run, so we sleep until a job is queued
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wakeUp.wait(lock, [this](){ return stopping || queuedJobs.load() != 0; });
+            if(stopping) return;
+        }
+    }
+
+    JobHandle JobSystem::schedule(std::function<void()> function, std::initializer_list<JobHandle> dependencies) {
+        return schedule(std::move(function), std::vector<JobHandle>(dependencies));
+    }
+
+    JobHandle JobSystem::schedule(std::function<void()> function, const std::vector<JobHandle>& dependencies) {
+        JobHandle job = std::make_shared<Job>();
+        job->function = std::move(function);
+        for(const auto& dependency : dependencies){
+            if(!dependency) continue;
+            // If the dependency is still running, it will release our job when it finishes
+            std::lock_guard<std::mutex> lock(dependency->continuationsMutex);
+            if(!dependency->finished.load(std::memory_order_acquire)){
+                job->pendingDependencies.fetch_add(1);
+                dependency->continuations.push_back(job);
+            }
+        }
+        // Finally, we release the extra dependency that prevented the job from being queued while we were adding its dependencies
+        releaseDependency(job);
+        return job;
+    }
+
+    void JobSystem::wait(const JobHandle& job) {
+        while(job && !job->isFinished())
+            if(!runNext()) std::this_thread::yield();
+    }
+
+    void JobSystem::wait(const std::vector<JobHandle>& jobs) {
+        for(const auto& job : jobs) wait(job);
+    }
+
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace our {
+
+    // A job is a function that is scheduled to run on one of the job system's threads.
+    // A job can depend on other jobs. It is only queued once all of them are finished,
+    // so a job that depends on another job acts as its continuation.
+    class Job {
+        std::function<void()> function; // The work to do
+        std::atomic<size_t> pendingDependencies{1}; // The number of unfinished dependencies (+1 while the job is being scheduled)
+        std::atomic<bool> finished{false}; // Whether the function has finished running
+        std::mutex continuationsMutex; // Guards "continuations" against jobs that are finishing while it is filled
+        std::vector<std::shared_ptr<Job>> continuations; // The jobs waiting for this job to finish
+
+        friend class JobSystem;
+    public:
+        // Returns true if the job has finished running
+        bool isFinished() const { return finished.load(std::memory_order_acquire); }
+    };
+
+    // A job handle keeps a job alive so that it can be waited for or used as a dependency
+    typedef std::shared_ptr<Job> JobHandle;
+
+    // The job system is a pool of worker threads that share the work using work stealing.
+    // Every thread (including the main thread) has its own deque of jobs. A thread pushes the jobs it creates
+    // to the back of its own deque and takes its next job from the back too (so it works on recent, cache-hot jobs),
+    // and when its deque is empty it steals the oldest job from the front of another thread's deque.
+    // The main thread never sleeps inside the job system, instead, whenever it waits for a job it helps running jobs.
+    // The application owns a job system whose worker count comes from the "jobs" object in the app config
+    // (see "Application::getJobSystem"), so states and systems can use it to split their work across the cores.
+    class JobSystem {
+        // Each thread has a deque of jobs that are ready to run
+        struct WorkQueue {
+            std::mutex mutex;
+            std::deque<JobHandle> jobs;
+        };
+
+        std::vector<std::unique_ptr<WorkQueue>> queues; // One queue per thread where queue 0 belongs to the main thread
+        std::vector<std::thread> workers; // The worker threads (the worker i uses the queue i + 1)
+        std::atomic<size_t> queuedJobs{0}; // The number of jobs waiting in all the queues
+        std::mutex sleepMutex; // The idle workers sleep on "wakeUp" until a job is queued
+        std::condition_variable wakeUp;
+        bool stopping = false; // Set when the job system is destroyed to tell the workers to leave (guarded by "sleepMutex")
+
+        // The index of the queue of the current thread. Threads that do not belong to the job system use the main thread's queue.
+        static thread_local size_t currentThreadIndex;
+
+        // Adds a job that is ready to run to the queue of the current thread and wakes up a worker to run it (or steal it)
+        void enqueue(JobHandle job);
+        // Takes a job from the current thread's queue or steals one from another thread, then runs it
+        // Returns false if there was no job to run
+        bool runNext();
+        // Runs the given job then schedules the continuations whose dependencies are now all finished
+        void execute(const JobHandle& job);
+        // Called once per finished dependency, the job is queued when its last dependency finishes
+        void releaseDependency(const JobHandle& job);
+        // The loop that each worker thread runs until the job system is destroyed
+        void workerLoop(size_t index);
+
+    public:
+        // Creates a job system with the given number of worker threads (in addition to the calling thread)
+        // If workerCount is negative, one worker is created for each hardware thread except the calling one
+        explicit JobSystem(int workerCount = -1);
+        // Waits for the workers to finish the queued jobs then stops them
+        ~JobSystem();
+
+        // Returns the number of worker threads
+        size_t getWorkerCount() const { return workers.size(); }
+        // Returns the number of threads that run jobs (the workers and the main thread)
+        size_t getThreadCount() const { return workers.size() + 1; }
+        // Returns the index of the current thread where 0 is the main thread (or any thread outside the job system)
+        // and [1, getThreadCount()) are the workers. It can be used to give each thread its own scratch data.
+        static size_t getCurrentThreadIndex() { return currentThreadIndex; }
+
+        // Schedules a function to run on the job system after all the given jobs are finished
+        // The returned handle can be waited for or passed as a dependency to other jobs
+        JobHandle schedule(std::function<void()> function, std::initializer_list<JobHandle> dependencies = {});
+        JobHandle schedule(std::function<void()> function, const std::vector<JobHandle>& dependencies);
+        // Schedules a function to run after the given job is finished
+        JobHandle then(const JobHandle& job, std::function<void()> function) { return schedule(std::move(function), { job }); }
+
+        // Blocks until the given job is finished. Meanwhile, the calling thread runs other jobs.
+        void wait(const JobHandle& job);
+        // Blocks until all the given jobs are finished. Meanwhile, the calling thread runs other jobs.
+        void wait(const std::vector<JobHandle>& jobs);
+
+        // Splits the range [begin, end) into sub-ranges and calls function(subBegin, subEnd) for each of them in parallel,
+        // then blocks (while helping) until all of them are done.
+        // Each sub-range has at least "grain" elements, and small ranges are run directly on the calling thread.
+        // It can be called from inside a job (nested parallel loops are fine since waiting threads keep running jobs).
+        template<typename Function>
+        void parallelFor(size_t begin, size_t end, Function&& function, size_t grain = 1) {
+            if(end <= begin) return;
+            size_t count = end - begin;
+            // We make a few chunks per thread so that the threads that finish early can steal the remaining chunks
+            size_t chunkSize = (count + 4 * getThreadCount() - 1) / (4 * getThreadCount());
+            if(chunkSize < grain) chunkSize = grain;
+            if(chunkSize >= count || workers.empty()){
+                function(begin, end);
+                return;
+            }
+            std::atomic<size_t> remaining{(count + chunkSize - 1) / chunkSize};
+            // The calling thread takes the first chunk itself and the rest are queued
+            for(size_t chunkBegin = begin + chunkSize; chunkBegin < end; chunkBegin += chunkSize){
+                size_t chunkEnd = chunkBegin + chunkSize < end ? chunkBegin + chunkSize : end;
+                JobHandle job = std::make_shared<Job>();
+                job->function = [&function, &remaining, chunkBegin, chunkEnd](){
+                    function(chunkBegin, chunkEnd);
+                    remaining.fetch_sub(1, std::memory_order_release);
+                };
+                releaseDependency(job);
+            }
+            function(begin, begin + chunkSize);
+            remaining.fetch_sub(1, std::memory_order_release);
+            while(remaining.load(std::memory_order_acquire) != 0)
+                if(!runNext()) std::this_thread::yield();
+        }
+
+        // The job system should not be copyable
+        JobSystem(const JobSystem&) = delete;
+        JobSystem &operator=(JobSystem const &) = delete;
+    };
+
+}
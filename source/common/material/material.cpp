@@ -3,15 +3,63 @@
 #include "../asset-loader.hpp"
 #include "deserialize-utils.hpp"
 
+#include <cstring>
+#include <typeinfo>
+
 namespace our {
 
     // This function should setup the pipeline state and set the shader to be used
-    void Material::setup() const {
+    void Material::setup(bool instanced) const {
         //TODO: (Req 7) Write this function
         // setup the pipeline state 
         this->pipelineState.setup();
         // set the shader to be used
-        this->shader->use();
+        getShader(instanced)->use();
+        // The shaders that read the material data from a uniform block get it from the material's buffer
+        if(getShader(instanced)->usesBlock(UniformBlock::Material)) bindUniformBlock();
+    }
+
+    Material::~Material() {
+        if(uniformBuffer == 0) return;
+        GLStateCache::get().forgetBuffer(uniformBuffer);
+        glDeleteBuffers(1, &uniformBuffer);
+    }
+
+    bool Material::canShareDraws(const Material& other) const {
+        return typeid(*this) == typeid(other) && shader == other.shader && instancedShader == other.instancedShader
+            && pipelineState == other.pipelineState && transparent == other.transparent;
+    }
+
+    void Material::bindUniformBlock() const {
+        MaterialBlock block;
+        fillUniformBlock(block);
+        // The block is only uploaded when the material data changes (which is rare) so it is not streamed like the per-draw data
+        if(uniformBuffer == 0){
+            glGenBuffers(1, &uniformBuffer);
+            glBindBuffer(GL_UNIFORM_BUFFER, uniformBuffer);
+            glBufferData(GL_UNIFORM_BUFFER, sizeof(MaterialBlock), &block, GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            uploadedBlock = block;
+        } else if(std::memcmp(&block, &uploadedBlock, sizeof(MaterialBlock)) != 0){
+            glBindBuffer(GL_UNIFORM_BUFFER, uniformBuffer);
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(MaterialBlock), &block);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            uploadedBlock = block;
+        }
+        GLStateCache::get().bindUniformBuffer(static_cast<GLuint>(UniformBlock::Material), uniformBuffer, 0, sizeof(MaterialBlock));
+    }
+
+    const MaterialUniforms& Material::getUniforms(bool instanced) const {
+        MaterialUniforms& result = uniforms[instanced ? 1 : 0];
+        const ShaderProgram* current = getShader(instanced);
+        if(result.shader != current){
+            result.shader = current;
+            result.transform = current->getUniform("transform");
+            result.tint = current->getUniform("tint");
+            result.alphaThreshold = current->getUniform("alphaThreshold");
+            result.tex = current->getUniform("tex");
+        }
+        return result;
     }
 
     // This function read the material data from a json object
@@ -22,20 +70,26 @@ namespace our {
             pipelineState.deserialize(data["pipelineState"]);
         }
         shader = AssetLoader<ShaderProgram>::get(data["shader"].get<std::string>());
+        // The instanced shader is optional, without it every object using this material is drawn separately
+        instancedShader = data.contains("instancedShader") ? AssetLoader<ShaderProgram>::get(data["instancedShader"].get<std::string>()) : nullptr;
         transparent = data.value("transparent", false);
     }
 
     // This function should call the setup of its parent and
     // set the "tint" uniform to the value in the member variable tint 
-    void TintedMaterial::setup() const {
+    void TintedMaterial::setup(bool instanced) const {
         //TODO: (Req 7) Write this function
         
         //call the setup of its parent which is Material
-        Material::setup();
+        Material::setup(instanced);
         
         // set the "tint" uniform to the value in the member variable tint 
         // uniform vec4 tint;
-        this->shader->set("tint", this->tint);
+        getShader(instanced)->set(getUniforms(instanced).tint, this->tint);
+    }
+
+    void TintedMaterial::fillUniformBlock(MaterialBlock& block) const {
+        block.tint = tint;
     }
 
     // This function read the material data from a json object
@@ -48,26 +102,39 @@ namespace our {
     // This function should call the setup of its parent and
     // set the "alphaThreshold" uniform to the value in the member variable alphaThreshold
     // Then it should bind the texture and sampler to a texture unit and send the unit number to the uniform variable "tex" 
-    void TexturedMaterial::setup() const {
+    void TexturedMaterial::setup(bool instanced) const {
         //TODO: (Req 7) Write this function
         
         //call the setup of its parent which is TintedMaterial
-        TintedMaterial::setup();
+        TintedMaterial::setup(instanced);
+        ShaderProgram* shader = getShader(instanced);
         
         // set the "alphaThreshold" uniform to the value in the member variable alphaThreshold
-        this->shader->set("alphaThreshold", this->alphaThreshold);
+        shader->set(getUniforms(instanced).alphaThreshold, this->alphaThreshold);
 
         // Then it should bind the texture and sampler to a texture unit and send the unit number to the uniform variable "tex" 
         // we can use the first one since the shader has only this one transform and we dont need to add to GL_TEXTURE0
         // i also made textureUnitIndex to keep it dynamic if we needed to change the texture unit after some time
         int textureUnitIndex = 0;
-        glActiveTexture(GL_TEXTURE0 + textureUnitIndex); 
+        GLStateCache::get().activeTexture(textureUnitIndex);
         // binding the texture to the active unit of the texture units
         this->texture->bind();
         // bind the sampler to the same texture unit index where the texture is binderd
         this->sampler->bind(textureUnitIndex);
         // send the unit number to the uniform variable "tex" 
-        this->shader->set("tex", textureUnitIndex);
+        shader->set(getUniforms(instanced).tex, textureUnitIndex);
+    }
+
+    void TexturedMaterial::fillUniformBlock(MaterialBlock& block) const {
+        TintedMaterial::fillUniformBlock(block);
+        block.alphaThreshold = alphaThreshold;
+    }
+
+    bool TexturedMaterial::canShareDraws(const Material& other) const {
+        // The texture and the sampler are bound once for the whole draw, so they must be the same too
+        if(!TintedMaterial::canShareDraws(other)) return false;
+        const TexturedMaterial& textured = static_cast<const TexturedMaterial&>(other);
+        return texture == textured.texture && sampler == textured.sampler;
     }
 
     // This function read the material data from a json object
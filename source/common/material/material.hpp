@@ -10,22 +10,62 @@
 
 namespace our {
 
+    // The handles of the uniforms that the materials and the renderer set for every draw
+    // They are resolved once per shader (see "Material::getUniforms") instead of looking up the names on every draw
+    struct MaterialUniforms {
+        const ShaderProgram* shader = nullptr; // The shader that the handles were resolved for
+        UniformHandle transform, tint, alphaThreshold, tex;
+    };
+
     // This is the base class for all the materials
     // It contains the 3 essential components required by any material
     // 1- The pipeline state when drawing objects using this material
     // 2- The shader program used to draw objects using this material
     // 3- Whether this material is transparent or not
     // Materials that send uniforms to the shader should inherit from the is material and add the required uniforms
+    // A material can also have an instanced shader which reads the model matrix from a per-instance attribute
+    // so that the renderer can draw many objects sharing the same mesh and material with a single draw call
     class Material {
+        // The uniform handles of the regular shader [0] and the instanced shader [1]
+        mutable MaterialUniforms uniforms[2];
+        // The buffer holding the "Material" uniform block (see "uniform-blocks.hpp") and the data last uploaded to it
+        // It is created the first time the material is set up with a shader that declares the block
+        mutable GLuint uniformBuffer = 0;
+        mutable MaterialBlock uploadedBlock;
+
+    protected:
+        // Fills the data of the "Material" uniform block (each material type writes its own uniforms)
+        virtual void fillUniformBlock(MaterialBlock&) const {}
+        // Uploads the "Material" uniform block if its data changed since the last upload, then binds it
+        void bindUniformBlock() const;
+
     public:
         PipelineState pipelineState;
         ShaderProgram* shader;
+        ShaderProgram* instancedShader = nullptr; // The instanced variant of "shader" (or null if the material can't be instanced)
         bool transparent;
+
+        // Returns the shader used to draw with this material (the instanced one if "instanced" is true)
+        ShaderProgram* getShader(bool instanced) const { return instanced ? instancedShader : shader; }
+        // Returns the uniform handles of the shader used to draw with this material (they are resolved again if the shader changed)
+        const MaterialUniforms& getUniforms(bool instanced) const;
+        // Returns the data of the "Material" uniform block (which is also the entry of this material in the "Materials" table)
+        MaterialBlock getUniformBlock() const { MaterialBlock block; fillUniformBlock(block); return block; }
+        // Returns true if the objects drawn with this material and with "other" can be drawn by the same instanced or indirect draw
+        // when the instanced shader reads the material data from the "Materials" table, i.e. if the materials only differ by their uniform block
+        virtual bool canShareDraws(const Material& other) const;
         
         // This function does 2 things: setup the pipeline state and set the shader program to be used
-        virtual void setup() const;
+        // If "instanced" is true, the instanced shader is used (it must not be null)
+        virtual void setup(bool instanced = false) const;
         // This function read a material from a json object
         virtual void deserialize(const nlohmann::json& data);
+
+        Material() = default;
+        virtual ~Material();
+        // A copy would share (and delete) the uniform buffer of the original
+        Material(const Material&) = delete;
+        Material& operator=(const Material&) = delete;
     };
 
     // This material adds a uniform for a tint (a color that will be sent to the shader)
@@ -34,7 +74,8 @@ namespace our {
     public:
         glm::vec4 tint;
 
-        void setup() const override;
+        void fillUniformBlock(MaterialBlock& block) const override;
+        void setup(bool instanced = false) const override;
         void deserialize(const nlohmann::json& data) override;
     };
 
@@ -49,7 +90,9 @@ namespace our {
         Sampler* sampler;
         float alphaThreshold;
 
-        void setup() const override;
+        void fillUniformBlock(MaterialBlock& block) const override;
+        bool canShareDraws(const Material& other) const override;
+        void setup(bool instanced = false) const override;
         void deserialize(const nlohmann::json& data) override;
     };
 
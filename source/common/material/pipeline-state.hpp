@@ -1,6 +1,7 @@
 #pragma once
 
 #include <glad/gl.h>
+#include "../gl/state-cache.hpp"
 #include <glm/vec4.hpp>
 #include <json/json.hpp>
 
@@ -40,59 +41,74 @@ namespace our {
 
         // This function should set the OpenGL options to the values specified by this structure
         // For example, if faceCulling.enabled is true, you should call glEnable(GL_CULL_FACE), otherwise, you should call glDisable(GL_CULL_FACE)
+        // The calls go through the state cache, so only the options that differ from the current OpenGL state are sent to OpenGL
         void setup() const {
             //TODO: (Req 4) Write this function
-                        //TODO: (Req 4) Write this function
+            GLStateCache& state = GLStateCache::get();
             if(faceCulling.enabled){
                 /// now I am going to enable the face culling
-                glEnable(GL_CULL_FACE);
+                state.setCapability(GL_CULL_FACE, true);
                 // choosing which face that will be culled grom the struct the culled face is the back face
-                glCullFace(faceCulling.culledFace);
+                state.cullFace(faceCulling.culledFace);
                 // choosing which direction that will maintain the culled face CCW means that i will cull the face if the points doesn't follow ccw direstions 
                 // this also means that rotation around z axis won't cull neither front or back f=face
-                glFrontFace(faceCulling.frontFace);
+                state.frontFace(faceCulling.frontFace);
             }
             else{
                 // if the face culling is not enabled then i will disable it what does this mean this means that i will have the back face even that i am not seeing it
-                glDisable(GL_CULL_FACE);
+                state.setCapability(GL_CULL_FACE, false);
             }
             if(depthTesting.enabled){
                 // now i am going to enable the depth testing
-                glEnable(GL_DEPTH_TEST);
+                state.setCapability(GL_DEPTH_TEST, true);
                 // now i am going to choose the depth function what does it mean it means that i will draw the pixels if it is less or equal the already drawn one
-                glDepthFunc(depthTesting.function);
+                state.depthFunc(depthTesting.function);
             }
             else{
                 // if the depth testing is not enabled then i will disable it it will affect highly the opaque objects
-                glDisable(GL_DEPTH_TEST);
+                state.setCapability(GL_DEPTH_TEST, false);
             }
             if(blending.enabled){
                 // now i am going to enable the blending
-                glEnable(GL_BLEND);
+                state.setCapability(GL_BLEND, true);
                 // now i am going to choose the blending equation what does it mean it means that i will add the source and destination colors
                 // alpha (source )*souce  + (1 - alpha (source)) * destination
                 //source is the color of the pixel that i am going to draw
                 //destination is the color of the pixel that is already drawn
                 //this is the meaning of adding 
-                glBlendEquation(blending.equation);
+                state.blendEquation(blending.equation);
                 //here i am choosing that the equation will be the source color * the source alpha + the destination color * (1 - source alpha)
-                glBlendFunc(blending.sourceFactor,blending.destinationFactor);
+                state.blendFunc(blending.sourceFactor, blending.destinationFactor);
                 //the struct has constant color so if you are going to use any factor that blend with constant color it is set by the blend color function
                 //this will only affect if you will blend with constant color
-                glBlendColor(blending.constantColor.r,blending.constantColor.g,blending.constantColor.b,blending.constantColor.a);
+                state.blendColor(blending.constantColor);
             }
             else{
                 // if the blending is not enabled then i will disable it it will affect highly the transparent objects
-                glDisable(GL_BLEND);
+                state.setCapability(GL_BLEND, false);
             }
             // it is used to see if the colors can be written on the frame buffer or no do here we have all colors can be written on the frame buffer(all have true values)
-            glColorMask(colorMask.r,colorMask.g,colorMask.b,colorMask.a);
+            state.colorMask(colorMask);
             // this enables that you could write on the depth buffer 
-            glDepthMask(depthMask);
+            state.depthMask(depthMask);
         }
 
         // Given a json object, this function deserializes a PipelineState structure
         void deserialize(const nlohmann::json& data);
+
+        // Two pipeline states are equal if setting up one after the other would not change anything
+        // (the options of a disabled feature are ignored since they are not sent to OpenGL)
+        bool operator==(const PipelineState& other) const {
+            if(faceCulling.enabled != other.faceCulling.enabled) return false;
+            if(faceCulling.enabled && (faceCulling.culledFace != other.faceCulling.culledFace || faceCulling.frontFace != other.faceCulling.frontFace)) return false;
+            if(depthTesting.enabled != other.depthTesting.enabled) return false;
+            if(depthTesting.enabled && depthTesting.function != other.depthTesting.function) return false;
+            if(blending.enabled != other.blending.enabled) return false;
+            if(blending.enabled && (blending.equation != other.blending.equation || blending.sourceFactor != other.blending.sourceFactor
+                || blending.destinationFactor != other.blending.destinationFactor || blending.constantColor != other.blending.constantColor)) return false;
+            return colorMask == other.colorMask && depthMask == other.depthMask;
+        }
+        bool operator!=(const PipelineState& other) const { return !(*this == other); }
     };
 
 }
\ No newline at end of file
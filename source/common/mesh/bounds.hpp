@@ -0,0 +1,71 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <limits>
+
+namespace our {
+
+    // An axis aligned bounding box defined by its minimum and maximum corners
+    struct BoundingBox {
+        glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+        glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+
+        // Returns true if no point was added to the box yet
+        bool isEmpty() const { return min.x > max.x; }
+        // Grows the box to contain the given point
+        void expand(const glm::vec3& point) {
+            min = glm::min(min, point);
+            max = glm::max(max, point);
+        }
+        // Grows the box to contain the given box
+        void expand(const BoundingBox& box) {
+            min = glm::min(min, box.min);
+            max = glm::max(max, box.max);
+        }
+        // Returns true if the two boxes overlap (touching boxes overlap too)
+        bool overlaps(const BoundingBox& box) const {
+            return glm::all(glm::lessThanEqual(min, box.max)) && glm::all(glm::lessThanEqual(box.min, max));
+        }
+        // Returns the surface area of the box (it is used to estimate how likely a ray or a query hits the box)
+        float getSurfaceArea() const {
+            if(isEmpty()) return 0.0f;
+            glm::vec3 size = max - min;
+            return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+        }
+        bool operator==(const BoundingBox& other) const { return min == other.min && max == other.max; }
+        bool operator!=(const BoundingBox& other) const { return !(*this == other); }
+        glm::vec3 getCenter() const { return 0.5f * (min + max); }
+        glm::vec3 getExtents() const { return 0.5f * (max - min); } // The half size of the box along each axis
+    };
+
+    // A sphere that contains all the points of a mesh
+    struct BoundingSphere {
+        glm::vec3 center = glm::vec3(0.0f);
+        float radius = 0.0f;
+    };
+
+    // The bounding volumes of a mesh in its local space
+    // The sphere is cheap to test so it is used to reject most of the objects, and the box is tighter so it is used to refine the results
+    struct Bounds {
+        BoundingBox box;
+        BoundingSphere sphere;
+
+        // Computes the bounds of the given points (any container of structs with a "position" member)
+        // The sphere is centered at the center of the box and its radius is the distance to the farthest point.
+        template<typename Container>
+        static Bounds fromVertices(const Container& vertices) {
+            Bounds bounds;
+            for(const auto& vertex : vertices) bounds.box.expand(vertex.position);
+            if(bounds.box.isEmpty()) return Bounds{ BoundingBox{ glm::vec3(0.0f), glm::vec3(0.0f) }, BoundingSphere{} };
+            bounds.sphere.center = bounds.box.getCenter();
+            float radiusSquared = 0.0f;
+            for(const auto& vertex : vertices){
+                glm::vec3 offset = vertex.position - bounds.sphere.center;
+                radiusSquared = glm::max(radiusSquared, glm::dot(offset, offset));
+            }
+            bounds.sphere.radius = glm::sqrt(radiusSquared);
+            return bounds;
+        }
+    };
+
+}
@@ -0,0 +1,237 @@
+#include "geometry-arena.hpp"
+#include "mesh.hpp"
+#include "../gl/state-cache.hpp"
+
+#include <cassert>
+
+namespace our {
+
+    void RangeAllocator::reset(size_t capacity, size_t used) {
+        this->capacity = capacity;
+        freeRanges.clear();
+        if(used < capacity) freeRanges.emplace(used, capacity - used);
+        freeSize = capacity - used;
+    }
+
+    bool RangeAllocator::allocate(size_t size, size_t& offset) {
+        if(size == 0){
+            offset = 0;
+            return true;
+        }
+        // First fit: the meshes are allocated rarely (when they are loaded), so a linear search is good enough
+        for(auto it = freeRanges.begin(); it != freeRanges.end(); ++it){
+            if(it->second < size) continue;
+            offset = it->first;
+            size_t remaining = it->second - size;
+            freeRanges.erase(it);
+            if(remaining > 0) freeRanges.emplace(offset + size, remaining);
+            freeSize -= size;
+            return true;
+        }
+        return false;
+    }
+
+    void RangeAllocator::free(size_t offset, size_t size) {
+        if(size == 0) return;
+        freeSize += size;
+        auto next = freeRanges.lower_bound(offset);
+        // We merge the range with the free range right after it
+        if(next != freeRanges.end() && next->first == offset + size){
+            size += next->second;
+            next = freeRanges.erase(next);
+        }
+        // and with the free range right before it
+        if(next != freeRanges.begin()){
+            auto previous = std::prev(next);
+            if(previous->first + previous->second == offset){
+                previous->second += size;
+                return;
+            }
+        }
+        freeRanges.emplace_hint(next, offset, size);
+    }
+
+    GeometryArena& GeometryArena::get() {
+        // The OpenGL objects are not deleted when the application exits since the context is already destroyed by then
+        static GeometryArena arena;
+        return arena;
+    }
+
+    void GeometryArena::create() {
+        glGenVertexArrays(1, &vertexArray);
+        glGenBuffers(1, &vertexBuffer);
+        glGenBuffers(1, &elementBuffer);
+        // The buffers are allocated and filled through the copy targets so that we never change the element buffer of a bound vertex array
+        glBindBuffer(GL_COPY_WRITE_BUFFER, vertexBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, INITIAL_VERTEX_CAPACITY * sizeof(Vertex), nullptr, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, elementBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, INITIAL_INDEX_CAPACITY * sizeof(GLuint), nullptr, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        vertices.reset(INITIAL_VERTEX_CAPACITY, 0);
+        indices.reset(INITIAL_INDEX_CAPACITY, 0);
+        setupVertexArray();
+    }
+
+    void GeometryArena::setupVertexArray() {
+        // The vertex array remembers the attribute layout, the buffer each attribute is read from and the element buffer
+        // (the binding goes through the state cache so that it knows which vertex array is bound)
+        GLStateCache::get().bindVertexArray(vertexArray);
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        // Every attribute is read from the interleaved vertices: the stride is the size of a vertex and the offset is the member offset
+        // The color is stored as 4 bytes which are normalized to [0, 1] when they are read by the shader
+        glVertexAttribPointer(ATTRIB_LOC_POSITION, 3, GL_FLOAT, false, sizeof(Vertex), (void*)offsetof(Vertex, position));
+        glEnableVertexAttribArray(ATTRIB_LOC_POSITION);
+        glVertexAttribPointer(ATTRIB_LOC_COLOR, 4, GL_UNSIGNED_BYTE, true, sizeof(Vertex), (void*)offsetof(Vertex, color));
+        glEnableVertexAttribArray(ATTRIB_LOC_COLOR);
+        glVertexAttribPointer(ATTRIB_LOC_TEXCOORD, 2, GL_FLOAT, false, sizeof(Vertex), (void*)offsetof(Vertex, tex_coord));
+        glEnableVertexAttribArray(ATTRIB_LOC_TEXCOORD);
+        glVertexAttribPointer(ATTRIB_LOC_NORMAL, 3, GL_FLOAT, false, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+        glEnableVertexAttribArray(ATTRIB_LOC_NORMAL);
+        // The element buffer binding is part of the vertex array state (unlike the array buffer binding)
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void GeometryArena::relocate(size_t vertexCapacity, size_t indexCapacity) {
+        GLuint newVertexBuffer, newElementBuffer;
+        glGenBuffers(1, &newVertexBuffer);
+        glGenBuffers(1, &newElementBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, newVertexBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, vertexCapacity * sizeof(Vertex), nullptr, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, newElementBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, indexCapacity * sizeof(GLuint), nullptr, GL_STATIC_DRAW);
+
+        // The live ranges are copied one after the other to the start of the new buffers
+        size_t vertexCursor = 0, indexCursor = 0;
+        for(Handle handle = 0; handle < ranges.size(); ++handle){
+            if(!live[handle]) continue;
+            Range& range = ranges[handle];
+            glBindBuffer(GL_COPY_READ_BUFFER, vertexBuffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, newVertexBuffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, range.baseVertex * sizeof(Vertex), vertexCursor * sizeof(Vertex), range.vertexCount * sizeof(Vertex));
+            glBindBuffer(GL_COPY_READ_BUFFER, elementBuffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, newElementBuffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, range.firstIndex * sizeof(GLuint), indexCursor * sizeof(GLuint), range.indexCount * sizeof(GLuint));
+            range.baseVertex = static_cast<GLint>(vertexCursor);
+            range.firstIndex = static_cast<GLuint>(indexCursor);
+            vertexCursor += range.vertexCount;
+            indexCursor += range.indexCount;
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        glDeleteBuffers(1, &vertexBuffer);
+        glDeleteBuffers(1, &elementBuffer);
+        vertexBuffer = newVertexBuffer;
+        elementBuffer = newElementBuffer;
+        setupVertexArray();
+        vertices.reset(vertexCapacity, vertexCursor);
+        indices.reset(indexCapacity, indexCursor);
+        ++compactions;
+    }
+
+    GeometryArena::Handle GeometryArena::allocate(const std::vector<Vertex>& vertexData, const std::vector<unsigned int>& indexData) {
+        if(vertexArray == 0) create();
+        size_t vertexCount = vertexData.size(), indexCount = indexData.size();
+        size_t vertexOffset = 0, indexOffset = 0;
+        bool fits = vertices.allocate(vertexCount, vertexOffset);
+        if(fits && !indices.allocate(indexCount, indexOffset)){
+            vertices.free(vertexOffset, vertexCount);
+            fits = false;
+        }
+        if(!fits){
+            // If there is enough free space, it is just fragmented, so packing the live ranges is enough.
+            // Otherwise, the buffers that are too small double in size until the mesh fits.
+            size_t vertexCapacity = vertices.getCapacity(), indexCapacity = indices.getCapacity();
+            while(vertexCapacity - vertices.getUsedSize() < vertexCount) vertexCapacity *= 2;
+            while(indexCapacity - indices.getUsedSize() < indexCount) indexCapacity *= 2;
+            relocate(vertexCapacity, indexCapacity);
+            bool allocated = vertices.allocate(vertexCount, vertexOffset) && indices.allocate(indexCount, indexOffset);
+            assert(allocated && "The geometry arena is packed, so the free space must be a single range that is large enough");
+            (void)allocated;
+        }
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, vertexBuffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, vertexOffset * sizeof(Vertex), vertexCount * sizeof(Vertex), vertexData.data());
+        glBindBuffer(GL_COPY_WRITE_BUFFER, elementBuffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, indexOffset * sizeof(GLuint), indexCount * sizeof(GLuint), indexData.data());
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        Handle handle;
+        if(!freeHandles.empty()){
+            handle = freeHandles.back();
+            freeHandles.pop_back();
+        } else {
+            handle = static_cast<Handle>(ranges.size());
+            ranges.emplace_back();
+            live.push_back(false);
+        }
+        ranges[handle] = { static_cast<GLint>(vertexOffset), static_cast<GLsizei>(vertexCount), static_cast<GLuint>(indexOffset), static_cast<GLsizei>(indexCount) };
+        live[handle] = true;
+        return handle;
+    }
+
+    void GeometryArena::free(Handle handle) {
+        if(handle >= ranges.size() || !live[handle]) return;
+        const Range& range = ranges[handle];
+        vertices.free(range.baseVertex, range.vertexCount);
+        indices.free(range.firstIndex, range.indexCount);
+        live[handle] = false;
+        freeHandles.push_back(handle);
+    }
+
+    void GeometryArena::read(Handle handle, std::vector<Vertex>& vertexData, std::vector<unsigned int>& indexData) const {
+        const Range& range = ranges[handle];
+        vertexData.resize(range.vertexCount);
+        indexData.resize(range.indexCount);
+        // Like the uploads, the reads go through the copy targets so that no vertex array binding is touched
+        glBindBuffer(GL_COPY_READ_BUFFER, vertexBuffer);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, range.baseVertex * sizeof(Vertex), range.vertexCount * sizeof(Vertex), vertexData.data());
+        glBindBuffer(GL_COPY_READ_BUFFER, elementBuffer);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, range.firstIndex * sizeof(GLuint), range.indexCount * sizeof(GLuint), indexData.data());
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    }
+
+    void GeometryArena::bind() const {
+        GLStateCache::get().bindVertexArray(vertexArray);
+    }
+
+    void GeometryArena::bindInstanceBuffer(GLuint buffer, size_t offset) {
+        // The attribute pointers keep the buffer object (not its name), so they stay valid when its storage is reallocated (orphaned)
+        if(buffer == instanceBuffer && offset == instanceOffset) return;
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        for(GLuint column = 0; column < 4; ++column){
+            GLuint location = ATTRIB_LOC_INSTANCE_TRANSFORM + column;
+            glVertexAttribPointer(location, 4, GL_FLOAT, false, sizeof(InstanceData), (void*)(offset + offsetof(InstanceData, localToWorld) + column * sizeof(glm::vec4)));
+            glEnableVertexAttribArray(location);
+            // A divisor of 1 makes the attribute advance once per instance instead of once per vertex
+            glVertexAttribDivisor(location, 1);
+        }
+        // The material index is an integer attribute, so it is read with glVertexAttribIPointer (which does not convert it to a float)
+        glVertexAttribIPointer(ATTRIB_LOC_INSTANCE_MATERIAL, 1, GL_UNSIGNED_INT, sizeof(InstanceData), (void*)(offset + offsetof(InstanceData, material)));
+        glEnableVertexAttribArray(ATTRIB_LOC_INSTANCE_MATERIAL);
+        glVertexAttribDivisor(ATTRIB_LOC_INSTANCE_MATERIAL, 1);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        instanceBuffer = buffer;
+        instanceOffset = offset;
+    }
+
+    void GeometryArena::forgetInstanceBuffer(GLuint buffer) {
+        if(buffer != instanceBuffer) return;
+        instanceBuffer = 0;
+        instanceOffset = 0;
+    }
+
+    GeometryArenaStatistics GeometryArena::getStatistics() const {
+        GeometryArenaStatistics statistics;
+        statistics.meshes = ranges.size() - freeHandles.size();
+        statistics.vertices = vertices.getUsedSize();
+        statistics.vertexCapacity = vertices.getCapacity();
+        statistics.indices = indices.getUsedSize();
+        statistics.indexCapacity = indices.getCapacity();
+        statistics.freeRanges = vertices.getFreeRangeCount() + indices.getFreeRangeCount();
+        statistics.compactions = compactions;
+        return statistics;
+    }
+
+}
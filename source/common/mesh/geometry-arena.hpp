@@ -0,0 +1,123 @@
+#pragma once
+
+#include <glad/gl.h>
+#include "vertex.hpp"
+
+#include <vector>
+#include <map>
+#include <cstdint>
+#include <cstddef>
+
+namespace our {
+
+    // Manages the free ranges of a buffer whose space is handed out in ranges (the sizes and offsets are in elements, not bytes)
+    // The free ranges are kept sorted by offset and the neighbouring ones are merged when a range is freed,
+    // so the free space is always described by the fewest ranges possible.
+    class RangeAllocator {
+        std::map<size_t, size_t> freeRanges; // The offset and the size of each free range
+        size_t capacity = 0;
+        size_t freeSize = 0; // The total size of the free ranges
+    public:
+        // Forgets every allocation and makes [used, capacity) the only free range (used after the live ranges were packed at the start)
+        void reset(size_t capacity, size_t used);
+        // Finds the first free range that can hold "size" elements and returns true if one was found (its offset is stored in "offset")
+        bool allocate(size_t size, size_t& offset);
+        // Returns a range to the free ranges
+        void free(size_t offset, size_t size);
+
+        size_t getCapacity() const { return capacity; }
+        size_t getFreeSize() const { return freeSize; }
+        size_t getUsedSize() const { return capacity - freeSize; }
+        // The number of separate free ranges (1 means that the free space is not fragmented)
+        size_t getFreeRangeCount() const { return freeRanges.size(); }
+    };
+
+    // The statistics of the geometry arena
+    struct GeometryArenaStatistics {
+        size_t meshes = 0; // The number of live allocations
+        size_t vertices = 0, vertexCapacity = 0; // The number of allocated vertices and the capacity of the vertex buffer
+        size_t indices = 0, indexCapacity = 0; // The number of allocated indices and the capacity of the element buffer
+        size_t freeRanges = 0; // The number of free ranges in both buffers (more ranges means more fragmentation)
+        size_t compactions = 0; // The number of times the live ranges were packed (either to defragment or to grow the buffers)
+    };
+
+    // The geometry arena stores the vertices and the indices of all the meshes in a single vertex buffer and a single element buffer,
+    // which are read through a single vertex array. Each mesh is a range of vertices and a range of indices in these buffers,
+    // and it is drawn with glDrawElementsBaseVertex (the indices of a mesh are relative to its first vertex, so they are stored unchanged).
+    // Since every mesh uses the same vertex array and buffers, drawing a different mesh does not change any binding,
+    // and the draws of different meshes can be merged into a single multi-draw or indirect draw.
+    // The free space of each buffer is managed by a RangeAllocator. When a mesh does not fit, the live ranges are packed at the
+    // start of new buffers (using glCopyBufferSubData, so the data never goes through the CPU), which are larger if the free space
+    // is not enough, and the vertex array is pointed at the new buffers.
+    // There is a single arena since the application has a single OpenGL context.
+    class GeometryArena {
+    public:
+        // An allocation is identified by its index in the range table (the ranges move when the arena is compacted, the handles don't)
+        using Handle = uint32_t;
+        struct Range {
+            GLint baseVertex; // The index of the first vertex (which is added to every index of the mesh)
+            GLsizei vertexCount;
+            GLuint firstIndex; // The index of the first element in the element buffer
+            GLsizei indexCount;
+        };
+
+        // The initial capacities of the buffers (in elements)
+        static constexpr size_t INITIAL_VERTEX_CAPACITY = 64 * 1024;
+        static constexpr size_t INITIAL_INDEX_CAPACITY = 192 * 1024;
+
+    private:
+        GLuint vertexArray = 0, vertexBuffer = 0, elementBuffer = 0;
+        RangeAllocator vertices, indices;
+        std::vector<Range> ranges; // Indexed by the handle
+        std::vector<bool> live; // True if the handle is in use
+        std::vector<Handle> freeHandles; // The handles that can be reused
+        size_t compactions = 0;
+        // The instance buffer range that the instance attributes of the vertex array point at (to skip pointing them again)
+        GLuint instanceBuffer = 0;
+        size_t instanceOffset = 0;
+
+        GeometryArena() = default;
+        // Creates the vertex array and the buffers (called when the first mesh is allocated since it needs an OpenGL context)
+        void create();
+        // Points the vertex attributes and the element buffer of the vertex array at the current buffers
+        void setupVertexArray();
+        // Moves the live ranges to the start of new buffers with the given capacities
+        void relocate(size_t vertexCapacity, size_t indexCapacity);
+
+    public:
+        // Returns the arena of the application's OpenGL context
+        static GeometryArena& get();
+
+        // Copies the vertices and the indices of a mesh into the arena and returns its handle
+        Handle allocate(const std::vector<Vertex>& vertexData, const std::vector<unsigned int>& indexData);
+        // Returns the ranges of a mesh to the free space
+        void free(Handle handle);
+        // Packs the live ranges at the start of the buffers so that the free space becomes a single range at the end
+        void compact() { relocate(vertices.getCapacity(), indices.getCapacity()); }
+
+        // Reads the vertices and the indices of a mesh back from the buffers (the indices are relative to the first vertex of the mesh)
+        // It waits for the GPU, so it should only be used when the meshes are processed after they are loaded (e.g. static batching)
+        void read(Handle handle, std::vector<Vertex>& vertexData, std::vector<unsigned int>& indexData) const;
+
+        // Returns the current range of a mesh (it changes when the arena is compacted, so it should not be kept)
+        const Range& getRange(Handle handle) const { return ranges[handle]; }
+
+        // Binds the vertex array that every mesh is drawn with
+        void bind() const;
+        // Points the per-instance attributes of the vertex array (see "InstanceData" in "mesh.hpp") at the instances
+        // stored in the given buffer starting at "offset" (in bytes). The vertex array must be bound.
+        void bindInstanceBuffer(GLuint buffer, size_t offset);
+        // This must be called when an instance buffer is deleted since OpenGL may reuse its name for a new buffer,
+        // which "bindInstanceBuffer" would then skip while the attributes still point at the deleted one
+        void forgetInstanceBuffer(GLuint buffer);
+
+        GLuint getVertexArray() const { return vertexArray; }
+        GLuint getVertexBuffer() const { return vertexBuffer; }
+        GLuint getElementBuffer() const { return elementBuffer; }
+        GeometryArenaStatistics getStatistics() const;
+
+        GeometryArena(const GeometryArena&) = delete;
+        GeometryArena& operator=(const GeometryArena&) = delete;
+    };
+
+}
@@ -0,0 +1,250 @@
+#include "mesh-simplify.hpp"
+
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <queue>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+
+namespace our::mesh_utils {
+
+    // The border quadrics are weighted more than the surface ones since moving the border changes the silhouette
+    static constexpr double BORDER_WEIGHT = 10.0;
+
+    namespace {
+
+        // A symmetric 4x4 matrix Q such that v^T Q v (with v = (x, y, z, 1)) is the weighted sum of the squared distances
+        // from the point to the accumulated planes. Only the 10 unique entries are stored.
+        struct Quadric {
+            double xx = 0, xy = 0, xz = 0, xw = 0, yy = 0, yz = 0, yw = 0, zz = 0, zw = 0, ww = 0;
+
+            // The quadric of the plane dot(normal, p) + d = 0 (the normal must be normalized)
+            static Quadric fromPlane(const glm::dvec3& normal, double d, double weight) {
+                Quadric q;
+                q.xx = weight * normal.x * normal.x; q.xy = weight * normal.x * normal.y; q.xz = weight * normal.x * normal.z; q.xw = weight * normal.x * d;
+                q.yy = weight * normal.y * normal.y; q.yz = weight * normal.y * normal.z; q.yw = weight * normal.y * d;
+                q.zz = weight * normal.z * normal.z; q.zw = weight * normal.z * d;
+                q.ww = weight * d * d;
+                return q;
+            }
+
+            Quadric& operator+=(const Quadric& q) {
+                xx += q.xx; xy += q.xy; xz += q.xz; xw += q.xw;
+                yy += q.yy; yz += q.yz; yw += q.yw;
+                zz += q.zz; zw += q.zw;
+                ww += q.ww;
+                return *this;
+            }
+
+            // Returns v^T Q v
+            double evaluate(const glm::dvec3& p) const {
+                return xx * p.x * p.x + 2.0 * xy * p.x * p.y + 2.0 * xz * p.x * p.z + 2.0 * xw * p.x
+                     + yy * p.y * p.y + 2.0 * yz * p.y * p.z + 2.0 * yw * p.y
+                     + zz * p.z * p.z + 2.0 * zw * p.z
+                     + ww;
+            }
+        };
+
+        // A candidate collapse that moves "from" onto "to"
+        // The stamps are the versions of both vertices when the cost was computed (the collapse is stale if either changed since)
+        struct Collapse {
+            double cost;
+            uint32_t from, to;
+            uint32_t fromStamp, toStamp;
+            bool operator>(const Collapse& other) const { return cost > other.cost; }
+        };
+
+    }
+
+    void simplify(const std::vector<Vertex>& vertices, const std::vector<GLuint>& elements, size_t targetTriangles,
+                  std::vector<Vertex>& simplifiedVertices, std::vector<GLuint>& simplifiedElements) {
+        size_t vertexCount = vertices.size(), triangleCount = elements.size() / 3;
+
+        // The vertices are welded by position into points, so the seams (where the vertices at the same position have different
+        // normals or texture coordinates) are part of the surface instead of looking like borders
+        std::vector<uint32_t> pointOf(vertexCount);
+        std::vector<glm::dvec3> positions;
+        std::vector<std::vector<uint32_t>> pointVertices;
+        {
+            std::unordered_map<glm::vec3, uint32_t> pointAt;
+            for(uint32_t vertex = 0; vertex < vertexCount; ++vertex){
+                auto [it, inserted] = pointAt.try_emplace(vertices[vertex].position, static_cast<uint32_t>(positions.size()));
+                if(inserted){
+                    positions.push_back(glm::dvec3(vertices[vertex].position));
+                    pointVertices.emplace_back();
+                }
+                pointOf[vertex] = it->second;
+                pointVertices[it->second].push_back(vertex);
+            }
+        }
+        size_t pointCount = positions.size();
+
+        // The triangles keep the vertices of their corners, while the topology (edges, borders, collapses) is computed on the points
+        std::vector<std::array<uint32_t, 3>> triangles(triangleCount);
+        std::vector<uint8_t> triangleAlive(triangleCount, 1);
+        std::vector<std::vector<uint32_t>> pointTriangles(pointCount);
+        for(uint32_t triangle = 0; triangle < triangleCount; ++triangle){
+            for(int corner = 0; corner < 3; ++corner){
+                triangles[triangle][corner] = elements[3 * triangle + corner];
+                pointTriangles[pointOf[triangles[triangle][corner]]].push_back(triangle);
+            }
+        }
+        auto pointsOf = [&](uint32_t triangle){
+            const auto& corners = triangles[triangle];
+            return std::array<uint32_t, 3>{ pointOf[corners[0]], pointOf[corners[1]], pointOf[corners[2]] };
+        };
+        auto normalOf = [&](const std::array<uint32_t, 3>& points){
+            return glm::cross(positions[points[1]] - positions[points[0]], positions[points[2]] - positions[points[0]]);
+        };
+
+        // Every point starts with the planes of its triangles (weighted by their area, so the small triangles matter less)
+        std::vector<Quadric> quadrics(pointCount);
+        // The edges used by a single triangle are on the border (the key packs the smaller index then the larger one)
+        auto edgeKey = [](uint32_t a, uint32_t b){ return a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a; };
+        std::unordered_map<uint64_t, uint32_t> edgeUses;
+        for(uint32_t triangle = 0; triangle < triangleCount; ++triangle){
+            auto points = pointsOf(triangle);
+            glm::dvec3 normal = normalOf(points);
+            double length = glm::length(normal);
+            if(length > 0.0){
+                normal /= length;
+                Quadric plane = Quadric::fromPlane(normal, -glm::dot(normal, positions[points[0]]), 0.5 * length);
+                for(uint32_t point : points) quadrics[point] += plane;
+            }
+            for(int corner = 0; corner < 3; ++corner) ++edgeUses[edgeKey(points[corner], points[(corner + 1) % 3])];
+        }
+        // A border edge adds the plane that contains it and is perpendicular to its triangle to both of its points
+        for(uint32_t triangle = 0; triangle < triangleCount; ++triangle){
+            auto points = pointsOf(triangle);
+            glm::dvec3 normal = normalOf(points);
+            if(glm::length(normal) == 0.0) continue;
+            normal = glm::normalize(normal);
+            for(int corner = 0; corner < 3; ++corner){
+                uint32_t a = points[corner], b = points[(corner + 1) % 3];
+                if(edgeUses[edgeKey(a, b)] != 1) continue;
+                glm::dvec3 edge = positions[b] - positions[a];
+                double edgeLength = glm::length(edge);
+                if(edgeLength == 0.0) continue;
+                glm::dvec3 borderNormal = glm::normalize(glm::cross(edge, normal));
+                Quadric plane = Quadric::fromPlane(borderNormal, -glm::dot(borderNormal, positions[a]), BORDER_WEIGHT * edgeLength * edgeLength);
+                quadrics[a] += plane;
+                quadrics[b] += plane;
+            }
+        }
+
+        // The collapses are visited from the cheapest one. Instead of updating the queue when a point changes,
+        // its stamp is increased and the collapses computed with an older stamp are skipped when they are popped.
+        std::vector<uint32_t> stamps(pointCount, 0);
+        std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+        auto push = [&](uint32_t from, uint32_t to){
+            Quadric merged = quadrics[from];
+            merged += quadrics[to];
+            queue.push(Collapse{ merged.evaluate(positions[to]), from, to, stamps[from], stamps[to] });
+        };
+        for(const auto& [key, uses] : edgeUses){
+            uint32_t a = static_cast<uint32_t>(key >> 32), b = static_cast<uint32_t>(key & 0xFFFFFFFFu);
+            if(a == b) continue;
+            push(a, b);
+            push(b, a);
+        }
+
+        // When a corner moves to another point, it takes the vertex of that point whose attributes are the closest to its own
+        auto closestVertex = [&](uint32_t vertex, uint32_t point){
+            const Vertex& original = vertices[vertex];
+            uint32_t best = pointVertices[point][0];
+            float bestDistance = std::numeric_limits<float>::max();
+            for(uint32_t candidate : pointVertices[point]){
+                const Vertex& other = vertices[candidate];
+                glm::vec2 uv = other.tex_coord - original.tex_coord;
+                float distance = (1.0f - glm::dot(other.normal, original.normal)) + glm::dot(uv, uv);
+                if(distance < bestDistance){
+                    best = candidate;
+                    bestDistance = distance;
+                }
+            }
+            return best;
+        };
+
+        std::vector<uint8_t> removed(pointCount, 0);
+        size_t aliveTriangles = triangleCount;
+        while(aliveTriangles > targetTriangles && !queue.empty()){
+            Collapse collapse = queue.top();
+            queue.pop();
+            uint32_t from = collapse.from, to = collapse.to;
+            if(removed[from] || removed[to] || stamps[from] != collapse.fromStamp || stamps[to] != collapse.toStamp) continue;
+
+            // Moving "from" onto "to" must not flip any of the triangles that survive the collapse
+            bool flips = false;
+            for(uint32_t triangle : pointTriangles[from]){
+                if(!triangleAlive[triangle]) continue;
+                auto points = pointsOf(triangle);
+                if(points[0] == to || points[1] == to || points[2] == to) continue;
+                glm::dvec3 normalBefore = normalOf(points);
+                for(uint32_t& point : points){
+                    if(point == from) point = to;
+                }
+                if(glm::dot(normalBefore, normalOf(points)) <= 0.0){
+                    flips = true;
+                    break;
+                }
+            }
+            if(flips) continue;
+
+            // The triangles that have both points disappear, and the others now use a vertex of "to" instead of "from"
+            std::vector<uint32_t> merged;
+            for(uint32_t triangle : pointTriangles[from]){
+                if(!triangleAlive[triangle]) continue;
+                auto points = pointsOf(triangle);
+                if(points[0] == to || points[1] == to || points[2] == to){
+                    triangleAlive[triangle] = 0;
+                    --aliveTriangles;
+                    continue;
+                }
+                for(uint32_t& corner : triangles[triangle]){
+                    if(pointOf[corner] == from) corner = closestVertex(corner, to);
+                }
+                merged.push_back(triangle);
+            }
+            for(uint32_t triangle : pointTriangles[to]){
+                if(triangleAlive[triangle]) merged.push_back(triangle);
+            }
+            pointTriangles[to].swap(merged);
+            pointTriangles[from].clear();
+            removed[from] = 1;
+            quadrics[to] += quadrics[from];
+            ++stamps[to];
+
+            // The collapses around "to" are computed again with its new quadric
+            for(uint32_t triangle : pointTriangles[to]){
+                for(uint32_t point : pointsOf(triangle)){
+                    if(point == to) continue;
+                    push(to, point);
+                    push(point, to);
+                }
+            }
+        }
+
+        // The remaining vertices are packed in their original order
+        std::vector<GLuint> remap(vertexCount, 0);
+        std::vector<uint8_t> used(vertexCount, 0);
+        for(uint32_t triangle = 0; triangle < triangleCount; ++triangle){
+            if(!triangleAlive[triangle]) continue;
+            for(uint32_t corner : triangles[triangle]) used[corner] = 1;
+        }
+        simplifiedVertices.clear();
+        simplifiedElements.clear();
+        for(uint32_t vertex = 0; vertex < vertexCount; ++vertex){
+            if(!used[vertex]) continue;
+            remap[vertex] = static_cast<GLuint>(simplifiedVertices.size());
+            simplifiedVertices.push_back(vertices[vertex]);
+        }
+        simplifiedElements.reserve(3 * aliveTriangles);
+        for(uint32_t triangle = 0; triangle < triangleCount; ++triangle){
+            if(!triangleAlive[triangle]) continue;
+            for(uint32_t corner : triangles[triangle]) simplifiedElements.push_back(remap[corner]);
+        }
+    }
+
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "vertex.hpp"
+
+#include <glad/gl.h>
+#include <vector>
+#include <cstddef>
+
+namespace our::mesh_utils {
+
+    // Simplifies a triangle mesh until it has at most "targetTriangles" triangles (or until no edge can be collapsed anymore)
+    // using the quadric error metric (Garland and Heckbert, "Surface Simplification Using Quadric Error Metrics").
+    // Every vertex accumulates the planes of its triangles as a quadric, which measures the squared distance to these planes,
+    // and the edge whose collapse adds the least error is collapsed first.
+    // The collapses move a vertex onto one of its neighbours (instead of a new optimal position), so:
+    //   - the simplified vertices are a subset of the original ones with their attributes unchanged (no interpolated texture coordinates),
+    //   - the bounds of the original mesh still contain the simplified one.
+    // The vertices are welded by position first, so the seams (e.g. the vertices of a flat shaded model, which have a normal per face)
+    // collapse together and never open. A corner that moves takes the vertex of its new position whose normal and texture coordinates
+    // are the closest to its own. The edges on the border of the mesh get an extra quadric that keeps the border in place,
+    // and the collapses that would flip a triangle are skipped.
+    void simplify(const std::vector<Vertex>& vertices, const std::vector<GLuint>& elements, size_t targetTriangles,
+                  std::vector<Vertex>& simplifiedVertices, std::vector<GLuint>& simplifiedElements);
+
+}
@@ -8,11 +8,11 @@
 #include <vector>
 #include <unordered_map>
 
-our::Mesh* our::mesh_utils::loadOBJ(const std::string& filename) {
+bool our::mesh_utils::readOBJ(const std::string& filename, std::vector<our::Vertex>& vertices, std::vector<GLuint>& elements, our::Bounds& bounds) {
 
-    // The data that we will use to initialize our mesh
-    std::vector<our::Vertex> vertices;
-    std::vector<GLuint> elements;
+    vertices.clear();
+    elements.clear();
+    bounds = our::Bounds();
 
     // Since the OBJ can have duplicated vertices, we make them unique using this map
     // The key is the vertex, the value is its index in the vector "vertices".
@@ -27,7 +27,7 @@ our::Mesh* our::mesh_utils::loadOBJ(const std::string& filename) {
 
     if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filename.c_str())) {
         std::cerr << "Failed to load obj file \"" << filename << "\" due to error: " << err << std::endl;
-        return nullptr;
+        return false;
     }
     if (!warn.empty()) {
         std::cout << "WARN while loading obj file \"" << filename << "\": " << warn << std::endl;
@@ -81,7 +81,18 @@ our::Mesh* our::mesh_utils::loadOBJ(const std::string& filename) {
         }
     }
 
-    return new our::Mesh(vertices, elements);
+    bounds = our::Bounds::fromVertices(vertices);
+
+    return true;
+}
+
+our::Mesh* our::mesh_utils::loadOBJ(const std::string& filename) {
+    // The data that we will use to initialize our mesh
+    std::vector<our::Vertex> vertices;
+    std::vector<GLuint> elements;
+    our::Bounds bounds;
+    if(!readOBJ(filename, vertices, elements, bounds)) return nullptr;
+    return new our::Mesh(vertices, elements, bounds);
 }
 
 // Create a sphere (the vertex order in the triangles are CCW from the outside)
@@ -119,5 +130,9 @@ our::Mesh* our::mesh_utils::sphere(const glm::ivec2& segments){
         }
     }
 
-    return new our::Mesh(vertices, elements);
+    // Every vertex is on the unit sphere, so we know the bounds without looking at the vertices
+    our::Bounds bounds;
+    bounds.box = { glm::vec3(-1.0f), glm::vec3(1.0f) };
+    bounds.sphere = { glm::vec3(0.0f), 1.0f };
+    return new our::Mesh(vertices, elements, bounds);
 }
\ No newline at end of file
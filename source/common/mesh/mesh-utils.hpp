@@ -2,8 +2,11 @@
 
 #include "mesh.hpp"
 #include <string>
+#include <vector>
 
 namespace our::mesh_utils {
+    // Read the vertices and the elements of an ".obj" file (returns false if the file could not be loaded)
+    bool readOBJ(const std::string& filename, std::vector<Vertex>& vertices, std::vector<GLuint>& elements, Bounds& bounds);
     // Load an ".obj" file into the mesh
     Mesh* loadOBJ(const std::string& filename);
     // Create a sphere (the vertex order in the triangles are CCW from the outside)
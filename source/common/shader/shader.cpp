@@ -4,6 +4,8 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <vector>
+#include <algorithm>
 
 //Forward definition for error checking functions
 std::string checkForShaderCompilationErrors(GLuint shader);
@@ -70,7 +72,7 @@ bool our::ShaderProgram::attach(const std::string &filename, GLenum type) const
 
 
 
-bool our::ShaderProgram::link() const {
+bool our::ShaderProgram::link() {
     //TODO: Complete this function
     //Note: The function "checkForLinkingErrors" checks if there is
     // an error in the given program. You should use it to check if there is a
@@ -93,9 +95,53 @@ bool our::ShaderProgram::link() const {
          return false;
      }
 
+    reflectUniforms();
     return true;
 }
 
+void our::ShaderProgram::reflectUniforms() {
+    uniforms.clear();
+    uniformIndices.clear();
+
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    std::vector<GLchar> nameBuffer(std::max(maxLength, 1));
+    for(GLint index = 0; index < count; ++index){
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(program, static_cast<GLuint>(index), static_cast<GLsizei>(nameBuffer.size()), &length, &size, &type, nameBuffer.data());
+        std::string name(nameBuffer.data(), length);
+        // The members of uniform blocks have no location since they are read from a buffer
+        GLint location = glGetUniformLocation(program, name.c_str());
+        if(location < 0) continue;
+        uint32_t uniformIndex = static_cast<uint32_t>(uniforms.size());
+        uniformIndices.emplace(name, uniformIndex);
+        // Arrays are reported as "name[0]", but they are usually set by their name alone
+        if(name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+            uniformIndices.emplace(name.substr(0, name.size() - 3), uniformIndex);
+        uniforms.push_back({std::move(name), location, type, size});
+    }
+    // The uniform blocks are bound to fixed binding points (GLSL 3.30 can't choose the binding in the shader)
+    blockMask = 0;
+    for(GLuint block = 0; block < static_cast<GLuint>(UniformBlock::Count); ++block){
+        UniformBlock uniformBlock = static_cast<UniformBlock>(block);
+        GLuint index = glGetUniformBlockIndex(program, getUniformBlockName(uniformBlock));
+        if(index == GL_INVALID_INDEX) continue;
+        GLint dataSize = 0;
+        glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_DATA_SIZE, &dataSize);
+        if(dataSize > getUniformBlockSize(uniformBlock))
+            std::cerr << "WARNING: The uniform block " << getUniformBlockName(uniformBlock) << " is larger in the shader ("
+                      << dataSize << " bytes) than in the engine (" << getUniformBlockSize(uniformBlock) << " bytes)" << std::endl;
+        glUniformBlockBinding(program, index, block);
+        blockMask |= 1u << block;
+    }
+    // Linking resets every uniform to its default value, so none of the shadowed values is known anymore
+    values.assign(uniforms.size(), glm::mat4(0.0f));
+    known.assign(uniforms.size(), false);
+}
+
 ////////////////////////////////////////////////////////////////////
 // Function to check for compilation and linking error in shaders //
 ////////////////////////////////////////////////////////////////////
@@ -2,19 +2,68 @@
 #define SHADER_HPP
 
 #include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cstring>
 
 #include <glad/gl.h>
+#include "../gl/state-cache.hpp"
+#include "uniform-blocks.hpp"
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 namespace our {
 
+    // A handle to an active uniform of a shader program (its index in the program's uniform table)
+    // Resolving the handle once and setting the uniform through it avoids looking up the name on every draw
+    struct UniformHandle {
+        int32_t index = -1;
+        bool isValid() const { return index >= 0; }
+    };
+
+    // An active uniform of a shader program as reported by glGetActiveUniform
+    struct UniformInfo {
+        std::string name; // The name of the uniform (arrays are reported as "name[0]" and can be found by both names)
+        GLint location; // The location of the uniform (the location of the first element for arrays)
+        GLenum type; // The GLSL type of the uniform (e.g. GL_FLOAT_VEC4)
+        GLint size; // The number of elements (1 unless the uniform is an array)
+    };
+
     class ShaderProgram {
 
     private:
         //Shader Program Handle (OpenGL object name)
         GLuint program;
 
+        // The active uniforms of the program which are read once after it is linked
+        std::vector<UniformInfo> uniforms;
+        std::unordered_map<std::string, uint32_t> uniformIndices;
+        // The last value uploaded to each uniform (indexed like "uniforms") so that uploading the same value again can be skipped
+        // The values are stored as raw bytes in a mat4 (the largest value that "set" can upload) and only the first element of an array is shadowed
+        // Uniform values belong to the program (they survive switching to other programs), so the shadow stays valid until the program is linked again
+        std::vector<glm::mat4> values;
+        std::vector<bool> known; // False until a value is uploaded to the uniform through "set"
+        // A bit for each uniform block (see "uniform-blocks.hpp") that the program declares
+        uint32_t blockMask = 0;
+
+        // Reads the active uniforms of the program into the uniform table and forgets the shadowed values
+        // It also binds the uniform blocks that the program declares to their binding points
+        void reflectUniforms();
+
+        // Returns true if the value should be uploaded to the uniform (and shadows it)
+        template<typename T>
+        bool shouldUpload(UniformHandle uniform, const T& value) {
+            static_assert(sizeof(T) <= sizeof(glm::mat4), "The uniform value is larger than its shadow");
+            if(!uniform.isValid()) return false;
+            void* shadow = &values[uniform.index];
+            bool changed = !known[uniform.index] || std::memcmp(shadow, &value, sizeof(T)) != 0;
+            if(!GLStateCache::get().changeUniform(changed)) return false;
+            std::memcpy(shadow, &value, sizeof(T));
+            known[uniform.index] = true;
+            return true;
+        }
+
     public:
         ShaderProgram(){
             //TODO: (Req 1) Create A shader program
@@ -27,91 +76,110 @@ namespace our {
             //TODO: (Req 1) Delete a shader program
             //Hint: Use the function glDeleteProgram to delete the shader program
             //Hint: The function glDeleteProgram takes a GLuint which is the shader program
+            GLStateCache::get().forgetProgram(program);
             glDeleteProgram(program);
         }
 
         bool attach(const std::string &filename, GLenum type) const;
 
-        bool link() const;
+        // Links the program then reads its active uniforms (so "set" does not need to query OpenGL for their locations)
+        bool link();
 
         void use() { 
-            glUseProgram(program);
+            // The state cache skips the call if this program is already in use
+            GLStateCache::get().useProgram(program);
         }
 
-        GLuint getUniformLocation(const std::string &name) {
+        GLuint getUniformLocation(const std::string &name) const {
             //TODO: (Req 1) Return the location of the uniform with the given name
             //name is the name of the uniform
-            //Hint: Use the function glGetUniformLocation which takes the program shader and the name of the uniform as parameters
-            //Hint: Use the function c_str() to convert the string to a c string
-            //Hint: The function glGetUniformLocation returns a GLuint which is the location of the uniform
-            return glGetUniformLocation(program, name.c_str());
+            //The locations are read once after linking (see "reflectUniforms") so this is a lookup in the uniform table
+            //instead of a call to glGetUniformLocation (which searches the program's uniforms by name inside the driver)
+            UniformHandle handle = getUniform(name);
+            return handle.isValid() ? uniforms[handle.index].location : -1;
+        }
+
+        // Returns the handle of the uniform with the given name (or an invalid handle if the program has no such active uniform)
+        // The handle stays valid until the program is linked again, so it can be resolved once and used for every draw
+        UniformHandle getUniform(const std::string &name) const {
+            auto it = uniformIndices.find(name);
+            return it == uniformIndices.end() ? UniformHandle() : UniformHandle{static_cast<int32_t>(it->second)};
         }
 
-        void set(const std::string &uniform, GLfloat value) {
+        // Returns the active uniforms found after the last link
+        const std::vector<UniformInfo>& getActiveUniforms() const { return uniforms; }
+
+        // Returns true if the program declares the given uniform block (and reads it from its binding point)
+        bool usesBlock(UniformBlock block) const { return (blockMask >> static_cast<GLuint>(block)) & 1u; }
+
+        // The string overloads resolve the name through the uniform table then upload the value through the handle overloads
+        // Setting a uniform that the program does not have (or that the compiler removed) does nothing, just like glUniform* with location -1
+        void set(const std::string &uniform, GLfloat value) { set(getUniform(uniform), value); }
+        void set(const std::string &uniform, GLuint value) { set(getUniform(uniform), value); }
+        void set(const std::string &uniform, GLint value) { set(getUniform(uniform), value); }
+        void set(const std::string &uniform, glm::vec2 value) { set(getUniform(uniform), value); }
+        void set(const std::string &uniform, glm::vec3 value) { set(getUniform(uniform), value); }
+        void set(const std::string &uniform, glm::vec4 value) { set(getUniform(uniform), value); }
+        void set(const std::string &uniform, glm::mat4 matrix) { set(getUniform(uniform), matrix); }
+
+        // The handle overloads skip the upload if the uniform already holds the same value (see "shouldUpload")
+        // Since glUniform* changes the program that is in use, the program must be in use when any of these is called
+        void set(UniformHandle uniform, GLfloat value) {
             //TODO: (Req 1) Send the given float value to the given uniform
-            //uniform is the name of the uniform
             //Glfloat is a float
             //Hint: Use the function glUniform1f because we will send one float only if there were 2 we would use glUniform2f and so on.
-            //Hint: Use the function getUniformLocation to get the location of the uniform
             //glUniform1f(the location of the uniform, value to be sent);
-            glUniform1f(getUniformLocation(uniform), value);
+            if(shouldUpload(uniform, value)) glUniform1f(uniforms[uniform.index].location, value);
         }
 
-        void set(const std::string &uniform, GLuint value) {
+        void set(UniformHandle uniform, GLuint value) {
             //TODO: (Req 1) Send the given unsigned integer value to the given uniform
-            //uniform is the name of the uniform
             //Gluint is an unsigned integer
             //Hint: Use the function glUniform1ui because we will send one unsigned integer only if there were 2 we would use glUniform2ui and so on.
-            //Hint: Use the function getUniformLocation to get the location of the uniform
             //glUniform1ui(the location of the uniform, value to be sent);
-            glUniform1ui(getUniformLocation(uniform), value);
+            if(shouldUpload(uniform, value)) glUniform1ui(uniforms[uniform.index].location, value);
         }
 
-        void set(const std::string &uniform, GLint value) {
+        void set(UniformHandle uniform, GLint value) {
             //TODO: (Req 1) Send the given integer value to the given uniform
             //Glint is a signed integer
             //Hint: Use the function glUniform1i because we will send one integer only if there were 2 we would use glUniform2i and so on.
-            //Hint: Use the function getUniformLocation to get the location of the uniform
             //glUniform1i(the location of the uniform, value to be sent);
-            glUniform1i(getUniformLocation(uniform), value);
+            if(shouldUpload(uniform, value)) glUniform1i(uniforms[uniform.index].location, value);
         }
 
-        void set(const std::string &uniform, glm::vec2 value) {
+        void set(UniformHandle uniform, glm::vec2 value) {
             //TODO: (Req 1) Send the given 2D vector value to the given uniform
             //glm::vec2 is a 2D vector with two floats (x and y)
             //Hint: Use the function glUniform2f because we will send two floats only if there were 3 we would use glUniform3f and so on.
-            //Hint: Use the function getUniformLocation to get the location of the uniform
             //glUniform2f(the location of the uniform, value to be sent);
-            glUniform2f(getUniformLocation(uniform), value.x, value.y);
+            if(shouldUpload(uniform, value)) glUniform2f(uniforms[uniform.index].location, value.x, value.y);
         }
 
-        void set(const std::string &uniform, glm::vec3 value) {
+        void set(UniformHandle uniform, glm::vec3 value) {
             //TODO: (Req 1) Send the given 3D vector value to the given uniform
             //glm::vec3 is a 3D vector with three floats (x, y and z)
             //Hint: Use the function glUniform3f because we will send three floats only if there were 4 we would use glUniform4f and so on.
-            //Hint: Use the function getUniformLocation to get the location of the uniform
             //glUniform3f(the location of the uniform, value to be sent);
-            glUniform3f(getUniformLocation(uniform), value.x, value.y, value.z);
+            if(shouldUpload(uniform, value)) glUniform3f(uniforms[uniform.index].location, value.x, value.y, value.z);
         }
 
-        void set(const std::string &uniform, glm::vec4 value) {
+        void set(UniformHandle uniform, glm::vec4 value) {
             //TODO: (Req 1) Send the given 4D vector value to the given uniform
             //glm::vec4 is a 4D vector with four floats (x, y, z and w)
             //Hint: Use the function glUniform4f because we will send four floats only if there were 5 we would use glUniform5f and so on.
-            //Hint: Use the function getUniformLocation to get the location of the uniform
             //glUniform4f(the location of the uniform, value to be sent);
-            glUniform4f(getUniformLocation(uniform), value.x, value.y, value.z, value.w);
+            if(shouldUpload(uniform, value)) glUniform4f(uniforms[uniform.index].location, value.x, value.y, value.z, value.w);
         }
 
-        void set(const std::string &uniform, glm::mat4 matrix) {
+        void set(UniformHandle uniform, glm::mat4 matrix) {
             //TODO: (Req 1) Send the given matrix 4x4 value to the given uniform
             //glm::mat4 is a 4x4 matrix with 16 floats
             //Hint: Use the function glUniformMatrix4fv because we will send a 4x4 matrix
-            //Hint: Use the function getUniformLocation to get the location of the uniform
             //Hint: Use the function glm::value_ptr to get the pointer to the first element of the matrix
             //glUniformMatrix4fv(the location of the uniform, number of matrices, transpose Specifies whether to transpose the matrix as the values are loaded into the uniform variable.,
             //pointer to the first element of the matrix);
-            glUniformMatrix4fv(getUniformLocation(uniform), 1, GL_FALSE, glm::value_ptr(matrix));
+            if(shouldUpload(uniform, matrix)) glUniformMatrix4fv(uniforms[uniform.index].location, 1, GL_FALSE, glm::value_ptr(matrix));
         }
 
         //TODO: (Req 1) Delete the copy constructor and assignment operator.
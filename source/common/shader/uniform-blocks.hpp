@@ -0,0 +1,71 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+namespace our {
+
+    // The uniform blocks that the engine fills for the shaders which declare them
+    // Each block is bound to a fixed binding point (its value in this enum) when a program is linked,
+    // so the renderer binds each buffer once to its binding point and every program that declares the block reads it.
+    // The shaders declare them (with the same names and members as the structs below) using the std140 layout:
+    //      layout(std140) uniform Frame { mat4 view_projection; vec4 camera_position; };
+    //      layout(std140) uniform Material { vec4 tint; float alpha_threshold; };
+    //      layout(std140) uniform Object { mat4 object_to_world; };
+    //      struct MaterialData { vec4 tint; float alpha_threshold; };
+    //      layout(std140) uniform Materials { MaterialData materials[MAX_MATERIALS]; };
+    enum class UniformBlock : GLuint {
+        Frame = 0, // The data shared by every draw in a frame (written once per frame by the renderer)
+        Material = 1, // The data of a material (kept in a buffer owned by the material and only uploaded when it changes)
+        Object = 2, // The data of a single draw (written to the renderer's ring buffer every frame)
+        Materials = 3, // The data of every material drawn by the instanced and indirect draws of a frame (indexed by the per-instance material index)
+        Count = 4
+    };
+
+    // The size of the material table of the "Materials" block (it must match the array size in the shaders)
+    constexpr GLsizeiptr MAX_MATERIALS = 256;
+
+    inline const char* getUniformBlockName(UniformBlock block) {
+        switch(block){
+            case UniformBlock::Frame: return "Frame";
+            case UniformBlock::Material: return "Material";
+            case UniformBlock::Object: return "Object";
+            case UniformBlock::Materials: return "Materials";
+            default: return "";
+        }
+    }
+
+    // The C++ side of the blocks. In std140, a vec4 or a mat4 column is aligned to 16 bytes and a float to 4 bytes,
+    // so these structs match the GLSL layout as long as every member starts at a multiple of its alignment.
+    // The structs are padded to a multiple of 16 bytes (the size that std140 rounds a block to).
+    struct FrameBlock {
+        glm::mat4 viewProjection;
+        glm::vec4 cameraPosition; // The camera position in the world space (w = 1)
+    };
+
+    // This is also the element of the "Materials" table (a std140 array of structs has a stride of 32 bytes for this struct)
+    struct MaterialBlock {
+        glm::vec4 tint = glm::vec4(1.0f);
+        float alphaThreshold = 0.0f;
+        float padding[3] = {0.0f, 0.0f, 0.0f};
+    };
+
+    struct ObjectBlock {
+        glm::mat4 objectToWorld;
+    };
+
+    static_assert(sizeof(FrameBlock) == 80, "FrameBlock does not match its std140 layout");
+    static_assert(sizeof(MaterialBlock) == 32, "MaterialBlock does not match its std140 layout");
+    static_assert(sizeof(ObjectBlock) == 64, "ObjectBlock does not match its std140 layout");
+
+    inline GLsizeiptr getUniformBlockSize(UniformBlock block) {
+        switch(block){
+            case UniformBlock::Frame: return sizeof(FrameBlock);
+            case UniformBlock::Material: return sizeof(MaterialBlock);
+            case UniformBlock::Object: return sizeof(ObjectBlock);
+            case UniformBlock::Materials: return MAX_MATERIALS * sizeof(MaterialBlock);
+            default: return 0;
+        }
+    }
+
+}
@@ -2,11 +2,81 @@
 #include "../mesh/mesh-utils.hpp"
 #include "../texture/texture-utils.hpp"
 
+#include <glm/gtc/matrix_transform.hpp>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+
 namespace our {
 
+    // The level of detail is added to the mesh field of the sort keys, so every level of a chain must fit in its bits
+    static_assert(Mesh::MAX_LODS <= (size_t(1) << sort_key::LOD_BITS), "The levels of detail of a mesh must fit in the sort keys");
+
     void ForwardRenderer::initialize(glm::ivec2 windowSize, const nlohmann::json& config){
         // First, we store the window size for later use
         this->windowSize = windowSize;
+        // Frustum culling can be disabled from the config (e.g. to compare the performance)
+        this->frustumCulling = config.value("culling", true);
+        // Instancing can be disabled too, and we can choose how many objects are worth an instanced draw call
+        this->instancing = config.value("instancing", true);
+        this->minInstances = std::max(config.value("min-instances", 2), 1);
+        // Sorting the opaque objects by state can be disabled to measure how many state changes it saves
+        this->stateSorting = config.value("state-sorting", true);
+        // The levels of detail of the meshes can be disabled to compare the triangle counts
+        this->lodSelection = config.value("lod", true);
+        this->lodBias = config.value("lod-bias", 1.0f);
+        // The occlusion buffer is small since the occluders are large (and each of its pixels is drawn on the CPU)
+        const nlohmann::json& occlusion = config.value("occlusion", nlohmann::json::object());
+        this->occlusionCulling = occlusion.value("enabled", false);
+        this->maxOccluders = occlusion.value("max-occluders", 32);
+        occlusionBuffer.resize(occlusion.value("width", 256), occlusion.value("height", 128));
+        // The occlusion queries are meant for the GPU bound scenes, so only the objects with many triangles are worth a query
+        const nlohmann::json& occlusionQueriesConfig = config.value("occlusion-queries", nlohmann::json::object());
+        this->occlusionQueries = occlusionQueriesConfig.value("enabled", false);
+        this->queryMinTriangles = occlusionQueriesConfig.value("min-triangles", 1000);
+        this->conditionalRendering = occlusionQueriesConfig.value("conditional-rendering", true);
+        queries.setHysteresis(occlusionQueriesConfig.value("hysteresis", 2));
+        if(occlusionQueries){
+            // The box is a unit cube that is scaled to the bounding box of each hidden object
+            std::vector<Vertex> boxVertices;
+            for(int corner = 0; corner < 8; ++corner){
+                glm::vec3 position((corner & 1) ? 1.0f : -1.0f, (corner & 2) ? 1.0f : -1.0f, (corner & 4) ? 1.0f : -1.0f);
+                boxVertices.push_back({ position, Color(255, 255, 255, 255), glm::vec2(0.0f), glm::vec3(0.0f) });
+            }
+            // The faces are not culled (the box is drawn from outside), so their winding does not matter
+            std::vector<unsigned int> boxElements = {
+                0, 1, 3, 0, 3, 2,   4, 5, 7, 4, 7, 6,   0, 1, 5, 0, 5, 4,
+                2, 3, 7, 2, 7, 6,   0, 2, 6, 0, 6, 4,   1, 3, 7, 1, 7, 5
+            };
+            this->queryBox = new Mesh(boxVertices, boxElements);
+
+            ShaderProgram* boxShader = new ShaderProgram();
+            boxShader->attach("assets/shaders/tinted.vert", GL_VERTEX_SHADER);
+            boxShader->attach("assets/shaders/tinted.frag", GL_FRAGMENT_SHADER);
+            boxShader->link();
+            // The box is tested against the depth of the objects drawn before it, but it must not change what is seen
+            this->queryBoxMaterial = new TintedMaterial();
+            this->queryBoxMaterial->shader = boxShader;
+            this->queryBoxMaterial->pipelineState.depthTesting.enabled = true;
+            this->queryBoxMaterial->pipelineState.depthTesting.function = GL_LEQUAL;
+            this->queryBoxMaterial->pipelineState.colorMask = glm::bvec4(false);
+            this->queryBoxMaterial->pipelineState.depthMask = false;
+            this->queryBoxMaterial->tint = glm::vec4(1.0f);
+            this->queryBoxMaterial->transparent = false;
+        }
+        // The instance buffer gets its storage when the first instanced batch is drawn
+        glGenBuffers(1, &instanceBuffer);
+        instanceBufferSize = 0;
+        // The buckets are submitted with indirect draws if the context supports them (GL 4.3 or the extensions that it made core)
+        this->multiDrawIndirect = config.value("multi-draw-indirect", true)
+            && (GLAD_GL_VERSION_4_3 || (GLAD_GL_ARB_multi_draw_indirect && GLAD_GL_ARB_base_instance));
+        // The indirect commands are tightly packed, so they only need the alignment of their members
+        if(multiDrawIndirect) indirectRing = new RingBuffer(GL_DRAW_INDIRECT_BUFFER, sizeof(GLuint), config.value("persistent-mapping", true));
+        // The uniform blocks bound with glBindBufferRange must start at multiples of the driver's alignment
+        GLint uniformAlignment = 0;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+        uniformRing = new RingBuffer(GL_UNIFORM_BUFFER, static_cast<size_t>(uniformAlignment), config.value("persistent-mapping", true));
+        objectBlockStride = uniformRing->align(sizeof(ObjectBlock));
 
         // Then we check if there is a sky texture in the configuration
         if(config.contains("sky")){
@@ -116,6 +186,23 @@ namespace our {
     }
 
     void ForwardRenderer::destroy(){
+        // The arena must not skip pointing its instance attributes at a new buffer that gets the same name
+        GeometryArena::get().forgetInstanceBuffer(instanceBuffer);
+        glDeleteBuffers(1, &instanceBuffer);
+        occluderGeometry.clear();
+        queries.clear();
+        // Delete the objects used to draw the bounding boxes of the hidden objects
+        if(queryBoxMaterial){
+            delete queryBox;
+            delete queryBoxMaterial->shader;
+            delete queryBoxMaterial;
+            queryBox = nullptr;
+            queryBoxMaterial = nullptr;
+        }
+        delete uniformRing;
+        uniformRing = nullptr;
+        delete indirectRing;
+        indirectRing = nullptr;
         // Delete all objects related to the sky
         if(skyMaterial){
             delete skySphere;
@@ -127,6 +214,7 @@ namespace our {
         // Delete all objects related to post processing
         if(postprocessMaterial){
             glDeleteFramebuffers(1, &postprocessFrameBuffer);
+            GLStateCache::get().forgetVertexArray(postProcessVertexArray);
             glDeleteVertexArrays(1, &postProcessVertexArray);
             delete colorTarget;
             delete depthTarget;
@@ -136,55 +224,407 @@ namespace our {
         }
     }
 
-    void ForwardRenderer::render(World* world){
-        // First of all, we search for a camera and for all the mesh renderers
-        CameraComponent* camera = nullptr;
-        opaqueCommands.clear();
-        transparentCommands.clear();
-        for(auto entity : world->getEntities()){
-            // If we hadn't found a camera yet, we look for a camera in this entity
-            if(!camera) camera = entity->getComponent<CameraComponent>();
-            // If this entity has a mesh renderer component
-            if(auto meshRenderer = entity->getComponent<MeshRendererComponent>(); meshRenderer){
-                // We construct a command from it
-                RenderCommand command;
-                command.localToWorld = meshRenderer->getOwner()->getLocalToWorldMatrix();
-                command.center = glm::vec3(command.localToWorld * glm::vec4(0, 0, 0, 1));
-                command.mesh = meshRenderer->mesh;
-                command.material = meshRenderer->material;
+    void ForwardRenderer::extractCommands(World* world, const SpatialSystem* spatial, const Frustum& frustum, JobSystem* jobSystem){
+        auto start = std::chrono::high_resolution_clock::now();
+        // First, the render list rebuilds the commands of the mesh renderers that changed since the last frame
+        renderList.update(world, jobSystem);
+        statistics.meshRenderers = renderList.size();
+        statistics.patched = renderList.getStatistics().patched;
+        // The spatial system's items can be mapped to the render list entries as long as both were matched to the same storage version
+        // (otherwise, the spatial system was not updated this frame, so we test every entry instead)
+        if(spatial && spatial->getStorageVersion() != renderList.getStorageVersion()) spatial = nullptr;
+        // The occluders are drawn before the slices are extracted since every slice tests its objects against them
+        if(occlusionCulling) drawOccluders(frustum, jobSystem);
+        if(spatial){
+            // The spatial system already knows the world space box of every mesh renderer, so we only visit
+            // the parts of its hierarchy that intersect the frustum (it must have been updated this frame)
+            visibleEntries.clear();
+            if(frustumCulling){
+                spatial->queryFrustum(frustum, visibleEntries);
+                // The items are replaced by the entries of their mesh renderers (which are their indices in the storage)
+                const std::vector<uint32_t>& storageIndices = spatial->getStorageIndices();
+                for(uint32_t& entry : visibleEntries) entry = storageIndices[entry];
+            } else {
+                visibleEntries.resize(renderList.size());
+                for(uint32_t entry = 0; entry < visibleEntries.size(); ++entry) visibleEntries[entry] = entry;
+            }
+        }
+        size_t count = spatial ? visibleEntries.size() : renderList.size();
+
+        // The entries are split into a few slices per thread (so that the threads that finish early can take the remaining ones)
+        // The slices are contiguous and merged in order, so the commands come out in the same order whatever the number of threads
+        size_t threadCount = jobSystem ? jobSystem->getThreadCount() : 1;
+        size_t sliceCount = jobSystem ? std::max<size_t>(1, std::min(4 * threadCount, count / MIN_SLICE_SIZE)) : 1;
+        size_t sliceSize = (count + sliceCount - 1) / sliceCount;
+        if(commandLists.size() < sliceCount) commandLists.resize(sliceCount);
+
+        const std::vector<RenderCommand>& commands = renderList.getCommands();
+        const std::vector<EntityHandle>& handles = renderList.getHandles();
+        auto extractSlice = [&](size_t slice){
+            CommandList& list = commandLists[slice];
+            list.opaque.clear();
+            list.transparent.clear();
+            list.queried.clear();
+            list.queriedKeys.clear();
+            list.culled = 0;
+            list.triangles = list.trianglesWithoutLod = list.simplified = 0;
+            list.occluded = 0;
+            size_t begin = std::min(count, slice * sliceSize), end = std::min(count, begin + sliceSize);
+            // Adds the command of an entry that passed the culling test to the list it will be drawn from
+            auto addCommand = [&](size_t entry){
+                const RenderCommand& command = commands[entry];
                 // if it is transparent, we add it to the transparent commands list
-                if(command.material->transparent){
-                    transparentCommands.push_back(command);
-                } else {
                 // Otherwise, we add it to the opaque command list
-                    opaqueCommands.push_back(command);
+                std::vector<RenderCommand>& target = command.material->transparent ? list.transparent : list.opaque;
+                target.push_back(command);
+                if(!command.mesh) return;
+                size_t triangles = command.mesh->getElementCount() / 3;
+                list.trianglesWithoutLod += triangles;
+                if(lodSelection && command.mesh->getLodCount() > 1){
+                    // The level is picked from the size of the bounding sphere on the screen (the bounds of every level are the bounds of level 0)
+                    float radius = renderList.getSphereRadius()[entry];
+                    float screenSize = lodBias * radius * lodView.scale;
+                    if(lodView.perspective){
+                        glm::vec3 center(renderList.getSphereX()[entry], renderList.getSphereY()[entry], renderList.getSphereZ()[entry]);
+                        float distance = glm::distance(center, lodView.position);
+                        // The camera inside the sphere sees the object at its full size
+                        screenSize = distance > radius ? screenSize / distance : std::numeric_limits<float>::max();
+                    }
+                    if(size_t level = command.mesh->selectLod(screenSize); level > 0){
+                        RenderCommand& added = target.back();
+                        added.mesh = command.mesh->getLod(level);
+                        added.state = sort_key::withLod(command.state, level);
+                        triangles = added.mesh->getElementCount() / 3;
+                        ++list.simplified;
+                    }
+                }
+                list.triangles += triangles;
+                // The expensive opaque objects are moved to their own list since they are drawn one at a time with a query each
+                if(occlusionQueries && !command.material->transparent && triangles >= queryMinTriangles){
+                    list.queried.push_back(target.back());
+                    target.pop_back();
+                    list.queriedKeys.push_back((uint64_t(handles[entry].index) << 32) | handles[entry].generation);
+                }
+            };
+            const std::vector<BoundingBox>& boxes = renderList.getBoxes();
+            if(spatial){
+                for(size_t index = begin; index < end; ++index){
+                    uint32_t entry = visibleEntries[index];
+                    if(occlusionCulling && !occlusionBuffer.isVisible(boxes[entry])){
+                        ++list.occluded;
+                        continue;
+                    }
+                    addCommand(entry);
                 }
+                return;
+            }
+            // The bounding spheres of the entries are tested against the frustum in batches
+            list.sphereVisible.assign(end - begin, 1);
+            if(frustumCulling)
+                frustum.intersects(renderList.getSphereX() + begin, renderList.getSphereY() + begin, renderList.getSphereZ() + begin,
+                                   renderList.getSphereRadius() + begin, end - begin, list.sphereVisible.data());
+            for(size_t index = begin; index < end; ++index){
+                // The sphere test is conservative, so the objects that passed it are tested again using their (tighter) bounding box
+                if(frustumCulling && (!list.sphereVisible[index - begin] || !frustum.intersects(boxes[index]))){
+                    ++list.culled;
+                    continue;
+                }
+                // Then the objects inside the frustum are tested against the occluders
+                if(occlusionCulling && !occlusionBuffer.isVisible(boxes[index])){
+                    ++list.occluded;
+                    continue;
+                }
+                addCommand(index);
+            }
+        };
+
+        // Then the lists of the slices are copied one after the other into the command lists
+        size_t opaqueCount = 0, transparentCount = 0, queriedCount = 0;
+        auto mergeSlice = [&](size_t slice){
+            const CommandList& list = commandLists[slice];
+            std::copy(list.opaque.begin(), list.opaque.end(), opaqueCommands.begin() + list.opaqueOffset);
+            std::copy(list.transparent.begin(), list.transparent.end(), transparentCommands.begin() + list.transparentOffset);
+            std::copy(list.queried.begin(), list.queried.end(), queriedCommands.begin() + list.queriedOffset);
+            std::copy(list.queriedKeys.begin(), list.queriedKeys.end(), queriedKeys.begin() + list.queriedOffset);
+        };
+        auto computeOffsets = [&](){
+            for(size_t slice = 0; slice < sliceCount; ++slice){
+                CommandList& list = commandLists[slice];
+                list.opaqueOffset = opaqueCount;
+                list.transparentOffset = transparentCount;
+                list.queriedOffset = queriedCount;
+                opaqueCount += list.opaque.size();
+                transparentCount += list.transparent.size();
+                queriedCount += list.queried.size();
+                statistics.culled += list.culled;
+                statistics.triangles += list.triangles;
+                statistics.trianglesWithoutLod += list.trianglesWithoutLod;
+                statistics.simplified += list.simplified;
+                statistics.occluded += list.occluded;
+            }
+            opaqueCommands.resize(opaqueCount);
+            transparentCommands.resize(transparentCount);
+            queriedCommands.resize(queriedCount);
+            queriedKeys.resize(queriedCount);
+        };
+        if(sliceCount > 1){
+            jobSystem->parallelFor(0, sliceCount, [&](size_t begin, size_t end){
+                for(size_t slice = begin; slice < end; ++slice) extractSlice(slice);
+            });
+            computeOffsets();
+            jobSystem->parallelFor(0, sliceCount, [&](size_t begin, size_t end){
+                for(size_t slice = begin; slice < end; ++slice) mergeSlice(slice);
+            });
+        } else {
+            extractSlice(0);
+            computeOffsets();
+            mergeSlice(0);
+        }
+        statistics.visible = opaqueCount + transparentCount + queriedCount;
+        // The mesh renderers that the spatial system did not return are outside the frustum
+        if(spatial) statistics.culled = statistics.meshRenderers - statistics.visible - statistics.occluded;
+        statistics.extractionThreads = std::min(threadCount, sliceCount);
+        statistics.extractionTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    void ForwardRenderer::drawOccluders(const Frustum& frustum, JobSystem* jobSystem){
+        // The occluders inside the frustum are sorted by their size on the screen, so the ones that hide the most are drawn
+        occluderCandidates.clear();
+        const std::vector<RenderCommand>& commands = renderList.getCommands();
+        for(uint32_t entry : renderList.getOccluders()){
+            const RenderCommand& command = commands[entry];
+            if(!command.mesh || command.material->transparent) continue;
+            BoundingSphere sphere{ glm::vec3(renderList.getSphereX()[entry], renderList.getSphereY()[entry], renderList.getSphereZ()[entry]), renderList.getSphereRadius()[entry] };
+            if(frustumCulling && !frustum.intersects(sphere)) continue;
+            float size = sphere.radius;
+            if(lodView.perspective) size /= std::max(glm::distance(sphere.center, lodView.position), 1e-3f);
+            occluderCandidates.emplace_back(size, entry);
+        }
+        size_t count = std::min(maxOccluders, occluderCandidates.size());
+        std::partial_sort(occluderCandidates.begin(), occluderCandidates.begin() + count, occluderCandidates.end(),
+            [](const auto& a, const auto& b){ return a.first > b.first; });
+        for(size_t index = 0; index < count; ++index){
+            const RenderCommand& command = commands[occluderCandidates[index].second];
+            auto [it, inserted] = occluderGeometry.try_emplace(command.mesh);
+            if(inserted){
+                // The occluders are drawn with their full mesh (a simplified one could cover pixels that the real one does not)
+                std::vector<Vertex> vertices;
+                std::vector<unsigned int> elements;
+                command.mesh->read(vertices, elements);
+                it->second.positions.reserve(vertices.size());
+                for(const Vertex& vertex : vertices) it->second.positions.push_back(vertex.position);
+                it->second.indices.assign(elements.begin(), elements.end());
+            }
+            occlusionBuffer.addOccluder(it->second, command.localToWorld);
+        }
+        occlusionBuffer.rasterize(jobSystem);
+        statistics.occluders = occlusionBuffer.getStatistics().occluders;
+        statistics.occluderTriangles = occlusionBuffer.getStatistics().triangles;
+        statistics.occlusionTime = occlusionBuffer.getStatistics().rasterizationTime;
+    }
+
+    void ForwardRenderer::sortQueues(const glm::vec3& cameraPosition, const glm::vec3& cameraForward, float far){
+        auto depthOf = [&](const RenderCommand& command){
+            return sort_key::quantizeDepth(glm::dot(command.center - cameraPosition, cameraForward), far);
+        };
+        opaqueKeys.clear();
+        for(RenderCommand& command : opaqueCommands){
+            command.sortKey = sort_key::opaque(command.state, depthOf(command));
+            opaqueKeys.push_back(command.sortKey);
+        }
+        transparentKeys.clear();
+        for(RenderCommand& command : transparentCommands){
+            command.sortKey = sort_key::transparent(command.state, depthOf(command));
+            transparentKeys.push_back(command.sortKey);
+        }
+        if(stateSorting){
+            sorter.sort(opaqueKeys, opaqueOrder);
+        } else {
+            opaqueOrder.resize(opaqueCommands.size());
+            for(uint32_t index = 0; index < opaqueOrder.size(); ++index) opaqueOrder[index] = index;
+        }
+        // The transparent objects are always sorted since they must be drawn from back to front
+        sorter.sort(transparentKeys, transparentOrder);
+        // The queried objects are drawn from front to back, so the nearest ones hide the others before they are tested
+        queriedDepths.clear();
+        for(const RenderCommand& command : queriedCommands) queriedDepths.push_back(depthOf(command));
+        sorter.sort(queriedDepths, queriedOrder);
+    }
+
+    uint32_t ForwardRenderer::findBucket(const Material* material){
+        // There are few buckets per frame (one per instanced shader and texture), so a linear search is good enough
+        for(uint32_t index = 0; index < buckets.size(); ++index)
+            if(buckets[index].material->canShareDraws(*material)) return index;
+        buckets.push_back({ material, 0, 0 });
+        // The bucket is drawn where its first group is found in the sorted order
+        opaqueBatches.push_back({ 0, 0, true, buckets.size() - 1 });
+        return static_cast<uint32_t>(buckets.size() - 1);
+    }
+
+    void ForwardRenderer::buildOpaqueBatches(){
+        opaqueBatches.clear();
+        instances.clear();
+        buckets.clear();
+        bucketGroups.clear();
+        indirectCommands.clear();
+        materialSlots.clear();
+        materialTable.clear();
+        if(opaqueCommands.empty()) return;
+        if(!instancing){
+            opaqueBatches.push_back({ 0, opaqueCommands.size(), false, 0 });
+            return;
+        }
+        // Returns the index of the material in the "Materials" table (and false if the table is full)
+        auto getMaterialSlot = [this](const Material* material, uint32_t& slot){
+            if(auto it = materialSlots.find(material); it != materialSlots.end()){
+                slot = it->second;
+                return true;
+            }
+            if(materialTable.size() >= static_cast<size_t>(MAX_MATERIALS)) return false;
+            slot = static_cast<uint32_t>(materialTable.size());
+            materialSlots.emplace(material, slot);
+            materialTable.push_back(material->getUniformBlock());
+            return true;
+        };
+        // An indirect command costs nothing more than a command of a larger group, so every group goes to a bucket if they are supported
+        size_t threshold = multiDrawIndirect ? 1 : minInstances;
+        // The sort keys put the objects sharing a mesh and a material next to each other, so each group is a range of the sorted order
+        auto commandAt = [this](size_t position) -> const RenderCommand& { return opaqueCommands[opaqueOrder[position]]; };
+        for(size_t first = 0; first < opaqueOrder.size();){
+            size_t last = first + 1;
+            while(last < opaqueOrder.size() && commandAt(last).material == commandAt(first).material
+                  && commandAt(last).mesh == commandAt(first).mesh) ++last;
+            size_t count = last - first;
+            const Material* material = commandAt(first).material;
+            uint32_t slot;
+            if(count >= threshold && material->instancedShader && getMaterialSlot(material, slot)){
+                bucketGroups.push_back({ findBucket(material), first, count, slot });
+            } else if(!opaqueBatches.empty() && !opaqueBatches.back().instanced && opaqueBatches.back().first + opaqueBatches.back().count == first){
+                // The objects that are drawn one at a time are merged into the previous batch if it is right before them
+                opaqueBatches.back().count += count;
+            } else {
+                opaqueBatches.push_back({ first, count, false, 0 });
             }
+            first = last;
         }
+        if(bucketGroups.empty()) return;
+
+        // The commands of each bucket are laid out next to each other so that the bucket is drawn by a single indirect draw
+        for(const BucketGroup& group : bucketGroups) ++buckets[group.bucket].commandCount;
+        size_t commandCursor = 0;
+        for(DrawBucket& bucket : buckets){
+            bucket.firstCommand = commandCursor;
+            commandCursor += bucket.commandCount;
+            bucket.commandCount = 0;
+        }
+        indirectCommands.resize(bucketGroups.size());
+        for(const BucketGroup& group : bucketGroups){
+            DrawBucket& bucket = buckets[group.bucket];
+            const Mesh* mesh = commandAt(group.first).mesh;
+            const GeometryArena::Range& range = mesh->getRange();
+            // The instances of the group start at "baseInstance" in the instance buffer
+            indirectCommands[bucket.firstCommand + bucket.commandCount++] = {
+                static_cast<GLuint>(mesh->getElementCount()), static_cast<GLuint>(group.count),
+                range.firstIndex, range.baseVertex, static_cast<GLuint>(instances.size())
+            };
+            for(size_t position = group.first; position < group.first + group.count; ++position)
+                instances.push_back({ commandAt(position).localToWorld, group.material, {0, 0, 0} });
+            ++statistics.instancedBatches;
+            statistics.instances += group.count;
+        }
+        statistics.buckets = buckets.size();
+
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        size_t size = instances.size() * sizeof(InstanceData);
+        if(size > instanceBufferSize){
+            // The buffer grows to the next power of two so that it is rarely reallocated
+            instanceBufferSize = 1;
+            while(instanceBufferSize < size) instanceBufferSize <<= 1;
+        }
+        // Allocating new storage every frame (orphaning) lets the driver keep the old one until the previous frame is done with it
+        // instead of waiting for the GPU before overwriting it
+        glBufferData(GL_ARRAY_BUFFER, instanceBufferSize, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, size, instances.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        if(multiDrawIndirect){
+            size_t commandsSize = indirectCommands.size() * sizeof(DrawElementsIndirectCommand);
+            indirectRing->begin(indirectRing->align(commandsSize));
+            indirectOffset = indirectRing->allocate(commandsSize);
+            std::memcpy(indirectRing->data(indirectOffset), indirectCommands.data(), commandsSize);
+            indirectRing->upload();
+        }
+    }
+
+    void ForwardRenderer::writeUniformBlocks(const glm::mat4& VP, const glm::vec3& cameraPosition){
+        size_t materialTableSize = getUniformBlockSize(UniformBlock::Materials);
+        size_t capacity = uniformRing->align(sizeof(FrameBlock)) + uniformRing->align(materialTableSize)
+            + (opaqueCommands.size() + transparentCommands.size() + queriedCommands.size()) * objectBlockStride;
+        uniformRing->begin(capacity);
+        FrameBlock frame;
+        frame.viewProjection = VP;
+        frame.cameraPosition = glm::vec4(cameraPosition, 1.0f);
+        size_t frameOffset = uniformRing->push(frame);
+        // The table is always allocated with its full size since that is the size of the block that the shaders declare
+        size_t materialsOffset = uniformRing->allocate(materialTableSize);
+        std::memcpy(uniformRing->data(materialsOffset), materialTable.data(), materialTable.size() * sizeof(MaterialBlock));
+        // The blocks of each queue are allocated at once, so the block of a command is found from its index
+        auto writeObjects = [this](const std::vector<RenderCommand>& commands) -> size_t {
+            size_t offset = uniformRing->allocate(commands.size() * objectBlockStride);
+            uint8_t* destination = uniformRing->data(offset);
+            for(const RenderCommand& command : commands){
+                std::memcpy(destination, &command.localToWorld, sizeof(ObjectBlock));
+                destination += objectBlockStride;
+            }
+            return offset;
+        };
+        opaqueObjectsOffset = writeObjects(opaqueCommands);
+        transparentObjectsOffset = writeObjects(transparentCommands);
+        queriedObjectsOffset = writeObjects(queriedCommands);
+        uniformRing->upload();
+        // The frame block stays bound for the whole frame since every shader reads it from the same binding point
+        GLStateCache::get().bindUniformBuffer(static_cast<GLuint>(UniformBlock::Frame), uniformRing->getBuffer(), frameOffset, sizeof(FrameBlock));
+        GLStateCache::get().bindUniformBuffer(static_cast<GLuint>(UniformBlock::Materials), uniformRing->getBuffer(), materialsOffset, materialTableSize);
+        statistics.uniformBlockBytes = capacity;
+    }
+
+    void ForwardRenderer::render(World* world, const SpatialSystem* spatial, JobSystem* jobSystem){
+        // First of all, we search for a camera and for all the mesh renderers
+        // Since the components of each type are packed in the world's storages, we scan them directly
+        CameraComponent* camera = nullptr;
+        statistics = RendererStatistics();
+        // We pick the first camera we find
+        if(auto& cameras = world->getStorage<CameraComponent>(); cameras.size() > 0) camera = &cameras[0];
 
         // If there is no camera, we return (we cannot render without a camera)
         if(camera == nullptr) return;
 
-        //TODO: (Req 9) Modify the following line such that "cameraForward" contains a vector pointing the camera forward direction
-        // HINT: See how you wrote the CameraComponent::getViewMatrix, it should help you solve this one
-        glm::vec3 cameraForward = camera->getOwner()->getLocalToWorldMatrix() * glm::vec4(0.0f, 0.0f, -1.0f, 0.0f);
-        std::sort(transparentCommands.begin(), transparentCommands.end(), [cameraForward](const RenderCommand& first, const RenderCommand& second){
-            //TODO: (Req 9) Finish this function
-            // HINT: the following return should return true "first" should be drawn before "second".
-            // get the projection of both points on the cameraForward vector but without normalization of the cameraForward
-            // since dividing both by the magnitude wont affect the result
-            
-            // first.center and second.center are wrt to world so dont need furthur processing
-            float projectionOfFirst =  glm::dot(first.center, cameraForward); 
-            float projectionOfSecond =  glm::dot(second.center, cameraForward);
-            return projectionOfFirst  > projectionOfSecond  ;
-        });
-
-        
         //TODO: (Req 9) Get the camera ViewProjection matrix and store it in VP
         
         glm::mat4 VP = camera->getProjectionMatrix(this->windowSize) * camera->getViewMatrix();
-        
+        // The frustum planes are extracted from VP so they are in the world space
+        Frustum frustum = Frustum::fromMatrix(VP);
+        // The level of detail of an object depends on its distance to the camera and on how much of the world the screen shows
+        lodView.position = glm::vec3(camera->getOwner()->getLocalToWorldMatrix() * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+        lodView.perspective = camera->cameraType == CameraType::PERSPECTIVE;
+        lodView.scale = lodView.perspective ? 1.0f / glm::tan(0.5f * camera->fovY) : 2.0f / camera->orthoHeight;
+        // The occlusion buffer is cleared for this frame's camera (the occluders are drawn into it while the commands are extracted)
+        if(occlusionCulling) occlusionBuffer.begin(VP);
+        if(occlusionQueries) queries.beginFrame();
+
+        // Then we build a command for every mesh renderer inside the frustum (split between the threads if a job system is given)
+        extractCommands(world, spatial, frustum, jobSystem);
+
+        //TODO: (Req 9) Modify the following line such that "cameraForward" contains a vector pointing the camera forward direction
+        // HINT: See how you wrote the CameraComponent::getViewMatrix, it should help you solve this one
+        glm::mat4 cameraTransform = camera->getOwner()->getLocalToWorldMatrix();
+        glm::vec3 cameraPosition = cameraTransform * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        // We normalize the forward direction since the depths in the sort keys are compared to the far plane distance
+        glm::vec3 cameraForward = glm::normalize(glm::vec3(cameraTransform * glm::vec4(0.0f, 0.0f, -1.0f, 0.0f)));
+        // The opaque commands are sorted by state then front to back, and the transparent ones back to front
+        // (the transparent order used to be the projection of the centers on cameraForward which is the same as their depth)
+        sortQueues(cameraPosition, cameraForward, camera->far);
+
 
         //TODO: (Req 9) Set the OpenGL viewport using viewportStart and viewportSize
         //glViewport takes 4 parameters: x, y, width and height
@@ -194,9 +634,10 @@ namespace our {
         glClearDepth(1.0f);
         //TODO: (Req 9) Set the color mask to true and the depth mask to true (to ensure the glClear will affect the framebuffer)
         // glColorMask takes 4 parameters: red, green, blue and alpha and specifies whether the color buffer is enabled for writing or not
-        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        // The masks go through the state cache since the materials set them too
+        GLStateCache::get().colorMask(glm::bvec4(true));
         //we need to enable depth mask since we are using depth buffer
-        glDepthMask(GL_TRUE);
+        GLStateCache::get().depthMask(true);
 
         // If there is a postprocess material, bind the framebuffer
         if(postprocessMaterial){
@@ -209,18 +650,141 @@ namespace our {
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         //TODO: (Req 9) Draw all the opaque commands
         // Don't forget to set the "transform" uniform to be equal the model-view-projection matrix for each render command
-        for (auto opaque : opaqueCommands) {
-            opaque.material->setup();
-            //multiply the VP matrix with the localToWorld matrix to get the model-view-projection matrix
-            opaque.material->shader->set("transform", VP * opaque.localToWorld);
-            opaque.mesh->draw();
+        // The objects sharing a mesh and a material are drawn together using an instanced draw call
+        // and the rest are drawn one at a time
+        buildOpaqueBatches();
+        writeUniformBlocks(VP, cameraPosition);
+        // Consecutive draws with the same material only set it up once, and we count the state changes to see how well the sorting works
+        const Material* lastMaterial = nullptr;
+        const ShaderProgram* lastShader = nullptr;
+        const Mesh* lastMesh = nullptr;
+        auto setupMaterial = [&](const Material* material, bool instanced){
+            ShaderProgram* shader = material->getShader(instanced);
+            if(material == lastMaterial && shader == lastShader) return;
+            material->setup(instanced);
+            if(shader != lastShader) ++statistics.shaderChanges;
+            ++statistics.materialChanges;
+            lastMaterial = material;
+            lastShader = shader;
+        };
+        auto countMesh = [&](const Mesh* mesh){
+            if(mesh != lastMesh) ++statistics.meshChanges;
+            lastMesh = mesh;
+        };
+        // Gives the shader the model matrix of a command: the shaders that declare the object block read the command's block
+        // from the ring buffer, and the others get the model-view-projection matrix in the "transform" uniform
+        auto setObject = [&](const RenderCommand& command, size_t objectOffset){
+            ShaderProgram* shader = command.material->shader;
+            if(shader->usesBlock(UniformBlock::Object))
+                GLStateCache::get().bindUniformBuffer(static_cast<GLuint>(UniformBlock::Object), uniformRing->getBuffer(), objectOffset, sizeof(ObjectBlock));
+            else
+                shader->set(command.material->getUniforms(false).transform, VP * command.localToWorld);
+        };
+        for (const RenderBatch& batch : opaqueBatches) {
+            if(batch.instanced){
+                // Every material of the bucket has the same shader, pipeline state and textures, so one of them is set up
+                // and the instances read the rest of their material from the "Materials" table
+                const DrawBucket& bucket = buckets[batch.bucket];
+                setupMaterial(bucket.material, true);
+                // The instanced shader multiplies the VP matrix with the model matrix of each instance
+                // (the shaders that read VP from the frame block don't have the "transform" uniform, so this does nothing for them)
+                bucket.material->instancedShader->set(bucket.material->getUniforms(true).transform, VP);
+                GeometryArena& arena = GeometryArena::get();
+                arena.bind();
+                if(multiDrawIndirect){
+                    // The instances are found by the baseInstance of each command, so the attributes point at the buffer start
+                    arena.bindInstanceBuffer(instanceBuffer, 0);
+                    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectRing->getBuffer());
+                    size_t offset = indirectOffset + bucket.firstCommand * sizeof(DrawElementsIndirectCommand);
+                    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)offset, (GLsizei)bucket.commandCount, 0);
+                    ++statistics.drawCalls;
+                    ++statistics.indirectDraws;
+                } else {
+                    // Without base instances, the attributes are pointed at the instances of each command before drawing it
+                    for(size_t index = bucket.firstCommand; index < bucket.firstCommand + bucket.commandCount; ++index){
+                        const DrawElementsIndirectCommand& command = indirectCommands[index];
+                        arena.bindInstanceBuffer(instanceBuffer, command.baseInstance * sizeof(InstanceData));
+                        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.count, GL_UNSIGNED_INT,
+                            (void*)(command.firstIndex * sizeof(GLuint)), command.instanceCount, command.baseVertex);
+                        ++statistics.drawCalls;
+                    }
+                }
+                // Every command of the bucket draws a different mesh or material
+                statistics.meshChanges += bucket.commandCount;
+                lastMesh = nullptr;
+                continue;
+            }
+            for (size_t position = batch.first; position < batch.first + batch.count; ++position) {
+                const RenderCommand& opaque = opaqueCommands[opaqueOrder[position]];
+                setupMaterial(opaque.material, false);
+                // the model matrix is either read from the command's object block or multiplied with VP into "transform"
+                setObject(opaque, opaqueObjectsOffset + opaqueOrder[position] * objectBlockStride);
+                countMesh(opaque.mesh);
+                opaque.mesh->draw();
+                ++statistics.drawCalls;
+            }
         }
+        // The expensive objects are drawn after the rest of the opaque objects (which are already in the depth buffer) with a query each.
+        // A visible object is tested by its own draw, and a hidden one by the draw of its bounding box (see "OcclusionQueries").
+        // The results are read in the next frames once they are available, so the CPU never waits for the GPU.
+        for(uint32_t index : queriedOrder){
+            const RenderCommand& command = queriedCommands[index];
+            OcclusionQueries::Object& object = queries.get(queriedKeys[index]);
+            ++statistics.queriedObjects;
+            auto drawObject = [&](){
+                setupMaterial(command.material, false);
+                setObject(command, queriedObjectsOffset + index * objectBlockStride);
+                countMesh(command.mesh);
+                command.mesh->draw();
+                ++statistics.drawCalls;
+            };
+            // If the near plane cuts the box, a part of the object could be seen while the rest of its box is hidden,
+            // so the object is drawn without being tested (the nearest corner along the near plane normal is behind the plane)
+            BoundingBox box = transformBox(command.mesh->getBounds().box, command.localToWorld);
+            const glm::vec4& nearPlane = frustum.planes[4];
+            glm::vec3 nearest(nearPlane.x >= 0 ? box.min.x : box.max.x, nearPlane.y >= 0 ? box.min.y : box.max.y, nearPlane.z >= 0 ? box.min.z : box.max.z);
+            if(glm::dot(glm::vec3(nearPlane), nearest) + nearPlane.w < 0){
+                queries.markVisible(object);
+                drawObject();
+                continue;
+            }
+            if(object.visible){
+                // Only one query per object is in flight, so an object whose last result is not ready is drawn without a query
+                if(object.pending){
+                    drawObject();
+                } else {
+                    queries.begin(object);
+                    drawObject();
+                    queries.end();
+                }
+                continue;
+            }
+            ++statistics.queryHidden;
+            if(!object.pending){
+                setupMaterial(queryBoxMaterial, false);
+                glm::mat4 boxTransform = glm::translate(glm::mat4(1.0f), 0.5f * (box.min + box.max)) * glm::scale(glm::mat4(1.0f), 0.5f * (box.max - box.min));
+                queryBoxMaterial->shader->set(queryBoxMaterial->getUniforms(false).transform, VP * boxTransform);
+                countMesh(queryBox);
+                queries.begin(object);
+                queryBox->draw();
+                queries.end();
+            }
+            if(conditionalRendering){
+                // The GPU skips the draw if no sample of the box passed (GL_QUERY_NO_WAIT draws it if the result is not ready yet)
+                glBeginConditionalRender(object.query, GL_QUERY_NO_WAIT);
+                drawObject();
+                glEndConditionalRender();
+            }
+        }
+        statistics.occlusionQueries = queries.getIssuedCount();
+
         // If there is a sky material, draw the sky
         if(this->skyMaterial){
             //TODO: (Req 10) setup the sky material
-            this->skyMaterial->setup();
+            // It goes through the same tracking as the other materials so that the next draw knows the sky changed the state
+            setupMaterial(this->skyMaterial, false);
             //TODO: (Req 10) Get the camera position
-            glm::mat4 cameraTransform = camera->getOwner()->getLocalToWorldMatrix();
+            // "cameraTransform" was already read from the camera entity when the queues were sorted
             //TODO: (Req 10) Create a model matrix for the sky such that it always follows the camera (sky sphere center = camera position)
 
             // then we will need the VP matrix to be converted into ndc space
@@ -236,16 +800,21 @@ namespace our {
                 0.0f, 0.0f, 1.0f, 1.0f
             );
             //TODO: (Req 10) set the "transform" uniform
-            this->skyMaterial->shader->set("transform", alwaysBehindTransform * skyModelMatrix);
+            this->skyMaterial->shader->set(this->skyMaterial->getUniforms(false).transform, alwaysBehindTransform * skyModelMatrix);
             //TODO: (Req 10) draw the sky sphere
+            countMesh(this->skySphere);
             this->skySphere->draw();
         }
         //TODO: (Req 9) Draw all the transparent commands
         // Don't forget to set the "transform" uniform to be equal the model-view-projection matrix for each render command
-        for (auto transparent : transparentCommands) {
-            transparent.material->setup();
-            transparent.material->shader->set("transform", VP * transparent.localToWorld);
+        // These are never instanced since they must be drawn in order from back to front
+        for (uint32_t index : transparentOrder) {
+            const RenderCommand& transparent = transparentCommands[index];
+            setupMaterial(transparent.material, false);
+            setObject(transparent, transparentObjectsOffset + index * objectBlockStride);
+            countMesh(transparent.mesh);
             transparent.mesh->draw();
+            ++statistics.drawCalls;
         }
 
         // If there is a postprocess material, apply postprocessing
@@ -256,10 +825,13 @@ namespace our {
             //TODO: (Req 11) Setup the postprocess material and draw the fullscreen triangle
             postprocessMaterial->setup();
             //bind vertex array to be able to draw
-            glBindVertexArray(postProcessVertexArray);
+            GLStateCache::get().bindVertexArray(postProcessVertexArray);
             glDrawArrays(GL_TRIANGLES, 0, 3);
             
         }
+        // All the draws reading this frame's uniform blocks were issued, so the ring buffer can fence them
+        uniformRing->end();
+        if(multiDrawIndirect) indirectRing->end();
     }
 
 }
\ No newline at end of file
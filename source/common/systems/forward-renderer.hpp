@@ -4,22 +4,79 @@
 #include "../components/camera.hpp"
 #include "../components/mesh-renderer.hpp"
 #include "../asset-loader.hpp"
+#include "../culling/frustum.hpp"
+#include "../culling/occlusion-buffer.hpp"
+#include "../culling/occlusion-queries.hpp"
+#include "spatial.hpp"
+#include "render-queue.hpp"
+#include "render-list.hpp"
+#include "../gl/ring-buffer.hpp"
+#include "../jobs/job-system.hpp"
 
 #include <glad/gl.h>
 #include <vector>
 #include <algorithm>
+#include <unordered_map>
 
 namespace our
 {
     
-    // The render command stores command that tells the renderer that it should draw
-    // the given mesh at the given localToWorld matrix using the given material
-    // The renderer will fill this struct using the mesh renderer components
-    struct RenderCommand {
-        glm::mat4 localToWorld;
-        glm::vec3 center;
-        Mesh* mesh;
-        Material* material;
+    // The statistics of the last frame drawn by the renderer
+    struct RendererStatistics {
+        size_t meshRenderers = 0; // The number of mesh renderers in the world
+        size_t culled = 0; // The number of mesh renderers that were skipped since they are outside the camera frustum
+        size_t visible = 0; // The number of mesh renderers that were drawn
+        size_t drawCalls = 0; // The number of draw calls issued for the mesh renderers (an instanced batch counts as one)
+        size_t instancedBatches = 0; // The number of groups of objects sharing a mesh and a material that were drawn as instances
+        size_t instances = 0; // The number of mesh renderers drawn as instances
+        size_t buckets = 0; // The number of buckets of instanced groups (see "DrawBucket")
+        size_t indirectDraws = 0; // The number of glMultiDrawElementsIndirect calls (one per bucket if indirect draws are supported)
+        size_t shaderChanges = 0; // The number of times a different shader program was used
+        size_t materialChanges = 0; // The number of times a material was set up (consecutive draws with the same material only set it up once)
+        size_t meshChanges = 0; // The number of times a different mesh was drawn
+        size_t uniformBlockBytes = 0; // The number of bytes of frame and per-draw uniform blocks written to the ring buffer
+        size_t patched = 0; // The number of render commands rebuilt since their mesh renderer changed (see "RenderList")
+        size_t triangles = 0; // The number of triangles of the visible objects at the level of detail they are drawn with
+        size_t trianglesWithoutLod = 0; // The number of triangles the visible objects would have if they were all drawn with their full mesh
+        size_t simplified = 0; // The number of visible objects drawn with a simplified level of detail
+        size_t occluders = 0; // The number of occluders drawn into the CPU occlusion buffer
+        size_t occluderTriangles = 0; // The number of occluder triangles rasterized on the CPU
+        size_t occluded = 0; // The number of objects inside the frustum that were skipped since they are hidden behind the occluders
+        double occlusionTime = 0.0; // The time spent drawing the occluders into the occlusion buffer (in milliseconds)
+        size_t queriedObjects = 0; // The number of expensive objects drawn with occlusion queries
+        size_t occlusionQueries = 0; // The number of occlusion queries issued
+        size_t queryHidden = 0; // The number of queried objects in the hidden state (not the draws skipped by the GPU, which are not known to the CPU)
+        size_t extractionThreads = 0; // The number of threads that extracted the render commands
+        double extractionTime = 0.0; // The time spent extracting the render commands (in milliseconds)
+    };
+
+    // A part of the opaque queue that is drawn at once. It is either:
+    // - a range of consecutive opaque commands (in the sorted order) which are drawn one at a time, or
+    // - a bucket (see "DrawBucket") which is drawn by instanced or indirect draws
+    struct RenderBatch {
+        size_t first, count; // The range of the batch commands in the sorted order of the opaque commands (if it is not instanced)
+        bool instanced;
+        size_t bucket; // The index of the bucket (if it is instanced)
+    };
+
+    // The layout of a draw read by glMultiDrawElementsIndirect from the indirect buffer (defined by OpenGL)
+    struct DrawElementsIndirectCommand {
+        GLuint count; // The number of elements
+        GLuint instanceCount;
+        GLuint firstIndex; // The index of the first element in the element buffer
+        GLint baseVertex;
+        GLuint baseInstance; // The index of the first instance in the instance buffer
+    };
+
+    // A bucket holds the opaque objects whose materials can share draws (see "Material::canShareDraws"), i.e. they use the same
+    // instanced shader, pipeline state and textures, so the bucket is drawn after setting up a single material.
+    // Each group of objects sharing a mesh and a material is an indirect command (with an instance per object) and the instances
+    // read their model matrix and the index of their material in the "Materials" table from the instance buffer.
+    // With GL 4.3, all the commands of a bucket are submitted by a single glMultiDrawElementsIndirect.
+    // Otherwise, they are submitted one by one in a loop.
+    struct DrawBucket {
+        const Material* material; // The material that is set up to draw the bucket
+        size_t firstCommand, commandCount; // The range of the bucket commands in the indirect commands of the frame
     };
 
     // A forward renderer is a renderer that draw the object final color directly to the framebuffer
@@ -33,6 +90,122 @@ namespace our
         // We define them here (instead of being local to the "render" function) as an optimization to prevent reallocating them every frame
         std::vector<RenderCommand> opaqueCommands;
         std::vector<RenderCommand> transparentCommands;
+        // The sort keys of the commands and the order in which they are drawn (the commands themselves are never moved)
+        std::vector<uint64_t> opaqueKeys, transparentKeys;
+        std::vector<uint32_t> opaqueOrder, transparentOrder;
+        RadixSorter sorter;
+        // The render commands of all the mesh renderers (only the ones that changed are rebuilt every frame)
+        RenderList renderList;
+        // If true, the opaque objects are sorted by their state then front to back ("state-sorting" in the renderer config, default: true)
+        // Otherwise, they are drawn in the order they are found in the world
+        bool stateSorting = true;
+        // If true, the objects outside the camera frustum are not drawn ("culling" in the renderer config, default: true)
+        bool frustumCulling = true;
+        // If true, the objects hidden behind the occluders (see "MeshRendererComponent::isOccluder") are not drawn
+        // ("occlusion.enabled" in the renderer config, default: false). The occluders are drawn every frame into a small
+        // depth buffer on the CPU (its size is "occlusion.width" x "occlusion.height", default: 256 x 128), and the bounds of
+        // the objects that pass the frustum test are tested against it.
+        bool occlusionCulling = false;
+        OcclusionBuffer occlusionBuffer;
+        // Only the occluders that look the largest on the screen are drawn ("occlusion.max-occluders", default: 32)
+        size_t maxOccluders = 32;
+        // The occluders inside the frustum with their size on the screen (kept to avoid reallocating them every frame)
+        std::vector<std::pair<float, uint32_t>> occluderCandidates;
+        // The triangles of the occluder meshes are read back from the geometry arena once, then kept on the RAM for the rasterizer
+        std::unordered_map<const Mesh*, OccluderGeometry> occluderGeometry;
+        // If true, the expensive opaque objects are tested on the GPU with occlusion queries ("occlusion-queries.enabled" in the
+        // renderer config, default: false). They are drawn one at a time after the rest of the opaque objects, from front to back,
+        // and an object whose samples were all hidden for "occlusion-queries.hysteresis" frames (default: 2) only draws its bounding box
+        // until a sample of the box passes again (see "OcclusionQueries").
+        bool occlusionQueries = false;
+        // An opaque object is expensive if the level of detail it is drawn with has at least this many triangles
+        // ("occlusion-queries.min-triangles", default: 1000)
+        size_t queryMinTriangles = 1000;
+        // If true, the hidden objects are still drawn under conditional rendering with the query of their box, so the GPU skips
+        // them without any delay ("occlusion-queries.conditional-rendering", default: true). Otherwise, they are skipped on the CPU
+        // using the results of the previous frames (which saves the draw calls, but an uncovered object shows up a frame or two late).
+        bool conditionalRendering = true;
+        OcclusionQueries queries;
+        // The expensive opaque objects of the frame, the keys that identify them in the queries (the handles of their owners)
+        // and the order in which they are drawn
+        std::vector<RenderCommand> queriedCommands;
+        std::vector<uint64_t> queriedKeys, queriedDepths;
+        std::vector<uint32_t> queriedOrder;
+        // The offset of the object blocks of the queried commands in the ring buffer
+        size_t queriedObjectsOffset = 0;
+        // A unit cube drawn at the bounding box of the hidden objects with a material that writes neither the color nor the depth
+        Mesh* queryBox = nullptr;
+        TintedMaterial* queryBoxMaterial = nullptr;
+        // If true, the meshes with levels of detail are drawn with the level that fits their size on the screen ("lod" in the renderer config, default: true)
+        bool lodSelection = true;
+        // The screen sizes of the objects are multiplied by this bias before picking their level ("lod-bias" in the renderer config, default: 1)
+        // so a larger bias keeps the detailed levels for longer
+        float lodBias = 1.0f;
+        // What the level of detail selection needs to know about the camera of the frame
+        // The screen size of an object (the fraction of the screen height covered by its bounding sphere) is:
+        // radius * scale / distance for a perspective camera, and radius * scale for an orthographic one
+        struct LodView {
+            glm::vec3 position;
+            float scale;
+            bool perspective;
+        } lodView;
+        // The commands extracted from a slice of the mesh renderers (see "extractCommands")
+        // Every slice fills its own lists, so the slices can be extracted by different threads without any locking
+        struct CommandList {
+            std::vector<RenderCommand> opaque, transparent;
+            size_t culled = 0; // The number of mesh renderers of the slice that are outside the frustum
+            size_t triangles = 0, trianglesWithoutLod = 0, simplified = 0; // The level of detail statistics of the slice
+            size_t occluded = 0; // The number of mesh renderers of the slice that are hidden behind the occluders
+            std::vector<RenderCommand> queried; // The expensive opaque commands (drawn with occlusion queries)
+            std::vector<uint64_t> queriedKeys;
+            size_t opaqueOffset = 0, transparentOffset = 0, queriedOffset = 0; // Where the lists of the slice start in the merged command lists
+            std::vector<uint8_t> sphereVisible; // The result of the SIMD frustum test of the slice's bounding spheres
+        };
+        // The lists of the slices (like the command lists, they are kept here to avoid reallocating them every frame)
+        std::vector<CommandList> commandLists;
+        // The smallest number of mesh renderers in a slice (smaller slices would cost more to schedule than to extract)
+        static constexpr size_t MIN_SLICE_SIZE = 256;
+        // The render list entries of the items found inside the frustum by the spatial system (if one is given to "render")
+        std::vector<uint32_t> visibleEntries;
+        // If true, the opaque objects sharing a mesh and a material are drawn together ("instancing" in the renderer config, default: true)
+        bool instancing = true;
+        // The smallest group that is drawn with an instanced draw call ("min-instances" in the renderer config, default: 2)
+        // Smaller groups (and materials without an instanced shader) are drawn one object at a time
+        size_t minInstances = 2;
+        // The batches of opaque commands and the instances of the buckets (which are uploaded to the instance buffer every frame)
+        std::vector<RenderBatch> opaqueBatches;
+        std::vector<InstanceData> instances;
+        GLuint instanceBuffer = 0;
+        size_t instanceBufferSize = 0; // The size of the instance buffer storage (in bytes)
+        // The buckets of the frame and their indirect commands (the commands of each bucket are contiguous)
+        std::vector<DrawBucket> buckets;
+        std::vector<DrawElementsIndirectCommand> indirectCommands;
+        // A group of objects sharing a mesh and a material found while building the batches (before the buckets are laid out)
+        struct BucketGroup {
+            uint32_t bucket;
+            size_t first, count; // The range of the group in the sorted order of the opaque commands
+            uint32_t material; // The index of the material in the "Materials" table
+        };
+        std::vector<BucketGroup> bucketGroups;
+        // The materials drawn by the buckets of the frame and their entries in the "Materials" table
+        std::unordered_map<const Material*, uint32_t> materialSlots;
+        std::vector<MaterialBlock> materialTable;
+        // If true, the buckets are submitted with glMultiDrawElementsIndirect ("multi-draw-indirect" in the renderer config, default: true)
+        // It is only used if the context supports it (GL 4.3), otherwise the commands are submitted one by one
+        bool multiDrawIndirect = false;
+        // The indirect commands are streamed through their own ring buffer (and the offset of the frame's commands in it)
+        RingBuffer* indirectRing = nullptr;
+        size_t indirectOffset = 0;
+        // The frame and per-draw uniform blocks (see "shader/uniform-blocks.hpp") are written to this ring buffer every frame,
+        // then each draw binds its block by offset instead of uploading its uniforms one by one.
+        // It is persistently mapped if the driver supports it ("persistent-mapping" in the renderer config, default: true)
+        // otherwise it is orphaned every frame. The shaders that don't declare the blocks still get the "transform" uniform.
+        RingBuffer* uniformRing = nullptr;
+        size_t objectBlockStride = 0; // The size of an object block in the ring buffer (rounded up to the uniform buffer offset alignment)
+        // The offsets of the object blocks of the opaque and transparent commands (the block of command i is at offset + i * objectBlockStride)
+        size_t opaqueObjectsOffset = 0, transparentObjectsOffset = 0;
+        // The statistics of the last frame
+        RendererStatistics statistics;
         // Objects used for rendering a skybox
         Mesh* skySphere;
         TexturedMaterial* skyMaterial;
@@ -40,6 +213,21 @@ namespace our
         GLuint postprocessFrameBuffer, postProcessVertexArray;
         Texture2D *colorTarget, *depthTarget;
         TexturedMaterial* postprocessMaterial;
+
+        // Fills the opaque and transparent commands with the commands of the render list inside the frustum (found by the spatial system if given)
+        // If a job system is given, the entries are split into slices which are extracted in parallel then merged in order
+        void extractCommands(World* world, const SpatialSystem* spatial, const Frustum& frustum, JobSystem* jobSystem);
+        // Draws the largest occluders inside the frustum into the occlusion buffer (after the render list is updated)
+        void drawOccluders(const Frustum& frustum, JobSystem* jobSystem);
+        // Computes the sort keys of the commands and sorts the render queues
+        // The depth of each command is its distance from the camera along the camera forward direction
+        void sortQueues(const glm::vec3& cameraPosition, const glm::vec3& cameraForward, float far);
+        // Groups the sorted opaque commands into batches and buckets, then uploads the instances and the indirect commands of the buckets
+        void buildOpaqueBatches();
+        // Returns the index of the bucket that the material can be drawn with (a new bucket is added if none fits)
+        uint32_t findBucket(const Material* material);
+        // Writes the frame block and the object block of every command to the ring buffer and binds the frame block
+        void writeUniformBlocks(const glm::mat4& VP, const glm::vec3& cameraPosition);
     public:
         // Initialize the renderer including the sky and the Postprocessing objects.
         // windowSize is the width & height of the window (in pixels).
@@ -47,7 +235,15 @@ namespace our
         // Clean up the renderer
         void destroy();
         // This function should be called every frame to draw the given world
-        void render(World* world);
+        // If a spatial system is given, the visible objects are found using its bounding volume hierarchy
+        // instead of testing every mesh renderer against the camera frustum
+        // If a job system is given, the render commands are built by its threads (the OpenGL calls are still issued by the calling thread).
+        // Since the world matrices are then read from several threads, they must be up to date (e.g. the transform system ran this frame).
+        void render(World* world, const SpatialSystem* spatial = nullptr, JobSystem* jobSystem = nullptr);
+        // Returns the statistics of the last frame drawn by "render"
+        const RendererStatistics& getStatistics() const { return statistics; }
+        // Returns the ring buffer holding the uniform blocks (or null before "initialize")
+        const RingBuffer* getUniformRing() const { return uniformRing; }
 
 
     };
@@ -30,18 +30,13 @@ namespace our
         // This should be called every frame to update all entities containing a FreeCameraControllerComponent 
         void update(World* world, float deltaTime) {
             // First of all, we search for an entity containing both a CameraComponent and a FreeCameraControllerComponent
-            // As soon as we find one, we break
-            CameraComponent* camera = nullptr;
-            FreeCameraControllerComponent *controller = nullptr;
-            for(auto entity : world->getEntities()){
-                camera = entity->getComponent<CameraComponent>();
-                controller = entity->getComponent<FreeCameraControllerComponent>();
-                if(camera && controller) break;
-            }
+            // The world keeps a cached view of such entities, so we just pick the first one
+            const auto& controlledCameras = world->view<CameraComponent, FreeCameraControllerComponent>();
             // If there is no entity with both a CameraComponent and a FreeCameraControllerComponent, we can do nothing so we return
-            if(!(camera && controller)) return;
-            // Get the entity that we found via getOwner of camera (we could use controller->getOwner())
-            Entity* entity = camera->getOwner();
+            if(controlledCameras.empty()) return;
+            Entity* entity = controlledCameras.front();
+            CameraComponent* camera = entity->getComponent<CameraComponent>();
+            FreeCameraControllerComponent *controller = entity->getComponent<FreeCameraControllerComponent>();
 
             // If the left mouse button is pressed, we lock and hide the mouse. This common in First Person Games.
             if(app->getMouse().isPressed(GLFW_MOUSE_BUTTON_1) && !mouse_locked){
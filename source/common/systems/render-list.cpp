@@ -0,0 +1,260 @@
+#include "render-list.hpp"
+
+#include <unordered_map>
+#include <atomic>
+
+namespace our {
+
+    void RenderList::build(size_t entry) {
+        MeshRendererComponent* renderer = renderers[entry];
+        RenderCommand& command = commands[entry];
+        command.localToWorld = owners[entry]->getLocalToWorldMatrix();
+        command.center = glm::vec3(command.localToWorld * glm::vec4(0, 0, 0, 1));
+        command.mesh = renderer->mesh;
+        command.material = renderer->material;
+        worldVersions[entry] = owners[entry]->getWorldVersion();
+        if(command.mesh){
+            boxes[entry] = transformBox(command.mesh->getBounds().box, command.localToWorld);
+            BoundingSphere sphere = transformSphere(command.mesh->getBounds().sphere, command.localToWorld);
+            sphereX[entry] = sphere.center.x;
+            sphereY[entry] = sphere.center.y;
+            sphereZ[entry] = sphere.center.z;
+            sphereRadius[entry] = sphere.radius;
+        } else {
+            // A mesh renderer without a mesh gets bounds that never intersect the frustum, so it is never drawn
+            boxes[entry] = BoundingBox();
+            sphereX[entry] = sphereY[entry] = sphereZ[entry] = 0.0f;
+            sphereRadius[entry] = -std::numeric_limits<float>::infinity();
+        }
+    }
+
+    void RenderList::packState(size_t entry) {
+        RenderCommand& command = commands[entry];
+        const ShaderProgram* shader = command.material ? command.material->shader : nullptr;
+        command.state = sort_key::packState(shaderIds.get(shader), materialIds.get(command.material), meshIds.get(command.mesh));
+    }
+
+    // Removes an entry from a list of entries in place using the position of each entry in the list
+    static void eraseFromList(std::vector<uint32_t>& list, std::vector<uint32_t>& slots, uint32_t entry) {
+        uint32_t slot = slots[entry];
+        if(slot == std::numeric_limits<uint32_t>::max()) return;
+        uint32_t moved = list.back();
+        list[slot] = moved;
+        slots[moved] = slot;
+        list.pop_back();
+        slots[entry] = std::numeric_limits<uint32_t>::max();
+    }
+
+    void RenderList::addToLists(uint32_t entry) {
+        if(renderers[entry]->isOccluder){
+            occluderSlots[entry] = static_cast<uint32_t>(occluders.size());
+            occluders.push_back(entry);
+        }
+        if(!renderers[entry]->isStatic){
+            dynamicSlots[entry] = static_cast<uint32_t>(dynamicEntries.size());
+            dynamicEntries.push_back(entry);
+        }
+    }
+
+    void RenderList::removeFromLists(uint32_t entry) {
+        eraseFromList(occluders, occluderSlots, entry);
+        eraseFromList(dynamicEntries, dynamicSlots, entry);
+    }
+
+    void RenderList::resizeEntries(size_t count) {
+        renderers.resize(count);
+        owners.resize(count);
+        handles.resize(count);
+        worldVersions.resize(count);
+        commands.resize(count);
+        boxes.resize(count);
+        sphereX.resize(count);
+        sphereY.resize(count);
+        sphereZ.resize(count);
+        sphereRadius.resize(count);
+        stateChanged.resize(count, 0);
+        occluderSlots.resize(count, NO_SLOT);
+        dynamicSlots.resize(count, NO_SLOT);
+    }
+
+    void RenderList::moveEntry(uint32_t from, uint32_t to) {
+        renderers[to] = renderers[from];
+        owners[to] = owners[from];
+        handles[to] = handles[from];
+        worldVersions[to] = worldVersions[from];
+        commands[to] = commands[from];
+        boxes[to] = boxes[from];
+        sphereX[to] = sphereX[from];
+        sphereY[to] = sphereY[from];
+        sphereZ[to] = sphereZ[from];
+        sphereRadius[to] = sphereRadius[from];
+        stateChanged[to] = stateChanged[from];
+        // The lists hold the entry by its index, so they are pointed at its new index
+        occluderSlots[to] = occluderSlots[from];
+        if(occluderSlots[to] != NO_SLOT) occluders[occluderSlots[to]] = to;
+        dynamicSlots[to] = dynamicSlots[from];
+        if(dynamicSlots[to] != NO_SLOT) dynamicEntries[dynamicSlots[to]] = to;
+    }
+
+    void RenderList::restructure(World* world) {
+        auto& storage = world->getStorage<MeshRendererComponent>();
+        const ComponentChange* changes = nullptr;
+        size_t changeCount = 0;
+        // A few added or removed renderers are patched in place, while a bulk change (or a cleared storage) matches all the entries again
+        if(storage.getChangesSince(storageVersion, changes, changeCount) && changeCount * BULK_CHANGE_RATIO <= commands.size())
+            applyChanges(storage, changes, changeCount);
+        else
+            rebuild(storage);
+        storageVersion = storage.getVersion();
+    }
+
+    void RenderList::applyChanges(ComponentStorage<MeshRendererComponent>& storage, const ComponentChange* changes, size_t changeCount) {
+        // The changes are replayed in the order in which they were made, so the entries end up in the order of the storage.
+        // The new entries are built after all the changes are replayed since a later removal may have moved their renderer.
+        touched.clear();
+        for(size_t index = 0; index < changeCount; ++index){
+            const ComponentChange& change = changes[index];
+            if(change.added){
+                resizeEntries(commands.size() + 1);
+                touched.push_back(change.index);
+                ++statistics.added;
+                continue;
+            }
+            uint32_t entry = change.index, last = static_cast<uint32_t>(commands.size() - 1);
+            // An entry that was added by an earlier change is not built yet, so it was never counted as an entry
+            if(handles[entry].generation != 0){
+                removeFromLists(entry);
+                ++statistics.removed;
+            } else {
+                --statistics.added;
+            }
+            // Like the storage, the last entry fills the hole
+            if(entry != last){
+                moveEntry(last, entry);
+                touched.push_back(entry);
+            }
+            resizeEntries(last);
+        }
+        for(uint32_t entry : touched){
+            if(entry >= commands.size()) continue;
+            // The renderer of a moved entry is at its new index in the storage
+            renderers[entry] = &storage[entry];
+            if(handles[entry].generation != 0) continue;
+            owners[entry] = renderers[entry]->getOwner();
+            handles[entry] = owners[entry]->getHandle();
+            build(entry);
+            packState(entry);
+            addToLists(entry);
+            ++statistics.patched;
+        }
+    }
+
+    void RenderList::rebuild(ComponentStorage<MeshRendererComponent>& storage) {
+        size_t count = storage.size();
+        // An entity has at most one mesh renderer, so the owner identifies the entry of a renderer (even if the storage moved it)
+        auto keyOf = [](EntityHandle handle){ return (uint64_t(handle.index) << 32) | handle.generation; };
+        std::unordered_map<uint64_t, uint32_t> previous;
+        previous.reserve(handles.size());
+        for(uint32_t entry = 0; entry < handles.size(); ++entry) previous.emplace(keyOf(handles[entry]), entry);
+
+        std::vector<MeshRendererComponent*> newRenderers(count);
+        std::vector<const Entity*> newOwners(count);
+        std::vector<EntityHandle> newHandles(count);
+        std::vector<uint32_t> newWorldVersions(count);
+        std::vector<RenderCommand> newCommands(count);
+        std::vector<BoundingBox> newBoxes(count);
+        std::vector<float> newX(count), newY(count), newZ(count), newRadius(count);
+        std::vector<uint8_t> built(count, 0);
+        size_t kept = 0;
+        for(size_t index = 0; index < count; ++index){
+            MeshRendererComponent* renderer = &storage[index];
+            newRenderers[index] = renderer;
+            newOwners[index] = renderer->getOwner();
+            newHandles[index] = renderer->getOwner()->getHandle();
+            auto it = previous.find(keyOf(newHandles[index]));
+            if(it == previous.end()) continue;
+            // The entry is moved as it was, the update checks it against its renderer like any other entry
+            uint32_t entry = it->second;
+            newWorldVersions[index] = worldVersions[entry];
+            newCommands[index] = commands[entry];
+            newBoxes[index] = boxes[entry];
+            newX[index] = sphereX[entry];
+            newY[index] = sphereY[entry];
+            newZ[index] = sphereZ[entry];
+            newRadius[index] = sphereRadius[entry];
+            built[index] = 1;
+            ++kept;
+        }
+        statistics.removed = owners.size() - kept;
+        statistics.added = count - kept;
+
+        renderers.swap(newRenderers);
+        owners.swap(newOwners);
+        handles.swap(newHandles);
+        worldVersions.swap(newWorldVersions);
+        commands.swap(newCommands);
+        boxes.swap(newBoxes);
+        sphereX.swap(newX);
+        sphereY.swap(newY);
+        sphereZ.swap(newZ);
+        sphereRadius.swap(newRadius);
+        stateChanged.assign(count, 0);
+        occluders.clear();
+        dynamicEntries.clear();
+        occluderSlots.assign(count, NO_SLOT);
+        dynamicSlots.assign(count, NO_SLOT);
+        for(uint32_t entry = 0; entry < count; ++entry) addToLists(entry);
+        // The new entries are built right away so that the update only has to check them
+        for(size_t entry = 0; entry < count; ++entry){
+            if(built[entry]) continue;
+            build(entry);
+            packState(entry);
+            ++statistics.patched;
+        }
+    }
+
+    void RenderList::update(World* world, JobSystem* jobSystem) {
+        statistics.patched = statistics.added = statistics.removed = 0;
+        if(world->getStorage<MeshRendererComponent>().getVersion() != storageVersion) restructure(world);
+        statistics.entries = commands.size();
+
+        // Reading the matrices makes sure the world versions are up to date even if the transform system did not run.
+        // It is done on the calling thread since refreshing an entity also refreshes its ancestors (which other entries share),
+        // so the threads below only read the cached matrices.
+        for(uint32_t entry : dynamicEntries) owners[entry]->getLocalToWorldMatrix();
+
+        // Checking an entry only compares its owner's world version and its mesh and material pointers,
+        // so the entries are only rebuilt when something changed. Each entry is only touched by one range.
+        std::atomic<size_t> patched{0}, packed{0};
+        auto check = [&](size_t begin, size_t end){
+            size_t patchedHere = 0, packedHere = 0;
+            for(size_t index = begin; index < end; ++index){
+                uint32_t entry = dynamicEntries[index];
+                MeshRendererComponent* renderer = renderers[entry];
+                const RenderCommand& command = commands[entry];
+                bool stateDirty = renderer->mesh != command.mesh || renderer->material != command.material;
+                if(!stateDirty && owners[entry]->getWorldVersion() == worldVersions[entry]) continue;
+                build(entry);
+                ++patchedHere;
+                if(stateDirty){
+                    stateChanged[entry] = 1;
+                    ++packedHere;
+                }
+            }
+            patched.fetch_add(patchedHere, std::memory_order_relaxed);
+            packed.fetch_add(packedHere, std::memory_order_relaxed);
+        };
+        if(jobSystem) jobSystem->parallelFor(0, dynamicEntries.size(), check, GRAIN);
+        else check(0, dynamicEntries.size());
+        statistics.patched += patched.load();
+
+        // The id tables are not thread safe, so the states are packed on the calling thread
+        if(packed.load() == 0) return;
+        for(uint32_t entry : dynamicEntries){
+            if(!stateChanged[entry]) continue;
+            stateChanged[entry] = 0;
+            packState(entry);
+        }
+    }
+
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "../ecs/world.hpp"
+#include "../components/mesh-renderer.hpp"
+#include "../culling/frustum.hpp"
+#include "../jobs/job-system.hpp"
+#include "render-queue.hpp"
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+#include <limits>
+
+namespace our
+{
+
+    // The render command stores command that tells the renderer that it should draw
+    // the given mesh at the given localToWorld matrix using the given material
+    // The renderer will fill this struct using the mesh renderer components
+    struct RenderCommand {
+        glm::mat4 localToWorld;
+        glm::vec3 center;
+        Mesh* mesh;
+        Material* material;
+        uint64_t state; // The shader, material and mesh ids packed for the sort key (see "sort_key::packState")
+        uint64_t sortKey; // The key that decides the order in which the command is drawn (see "render-queue.hpp")
+    };
+
+    // The statistics of the last update of a render list
+    struct RenderListStatistics {
+        size_t entries = 0; // The number of mesh renderers in the list
+        size_t patched = 0; // The number of entries rebuilt in the last update (their owner moved or their mesh or material changed)
+        size_t added = 0, removed = 0; // The number of mesh renderers added to and removed from the world since the last update
+    };
+
+    // The render list keeps a render command for every mesh renderer of a world from one frame to the next, along with its
+    // world space bounds and the state part of its sort key. Most of a scene does not move, so instead of rebuilding every
+    // command each frame, an entry is only rebuilt when its owner's world matrix changed (which we know from the owner's world
+    // version) or when its mesh or material changed. The renderer then culls and copies the ready commands.
+    // The entries are in the order of the world's mesh renderer storage (entry i belongs to the i-th mesh renderer),
+    // so the spatial system's items are mapped to entries by the storage index of their renderer.
+    // When a few mesh renderers are added or removed, the storage's changes are replayed on the entries (a removed entry is
+    // replaced by the last one, like in the storage), so only the new entries are built and the rest are not visited.
+    // After a bulk change, the entries are matched to the renderers again by the handle of their owner.
+    // The entries of the static mesh renderers (see "MeshRendererComponent::isStatic") are built once and never checked again.
+    class RenderList {
+        // The entries are checked in ranges of at least this many entries when a job system is given
+        static constexpr size_t GRAIN = 1024;
+        // If more than 1 / BULK_CHANGE_RATIO of the entries were added or removed since the last update, all the entries are matched again
+        static constexpr size_t BULK_CHANGE_RATIO = 4;
+        // Marks an entry that is not in "occluders" or "dynamicEntries"
+        static constexpr uint32_t NO_SLOT = std::numeric_limits<uint32_t>::max();
+
+        // The following arrays are indexed by the entry (which is the index of its mesh renderer in the storage)
+        std::vector<MeshRendererComponent*> renderers;
+        std::vector<const Entity*> owners;
+        std::vector<EntityHandle> handles; // The handle of each owner (the entities are pooled, so a new entity can reuse an old address)
+        std::vector<uint32_t> worldVersions; // The world version of the owner when the command was built
+        std::vector<RenderCommand> commands;
+        std::vector<BoundingBox> boxes; // The world space bounding box of each command
+        // The world space bounding spheres (stored as separate arrays for the SIMD frustum test)
+        std::vector<float> sphereX, sphereY, sphereZ, sphereRadius;
+        // Set for the entries whose mesh or material changed during the update (their state is packed again after the parallel part)
+        std::vector<uint8_t> stateChanged;
+        // The entries whose mesh renderer is an occluder (the flag is read when the entries are matched to the renderers)
+        std::vector<uint32_t> occluders;
+        // The entries whose mesh renderer is not static (the only ones checked by the update)
+        std::vector<uint32_t> dynamicEntries;
+        // The position of each entry in "occluders" and in "dynamicEntries" (or NO_SLOT), so an entry can be removed from them in place
+        std::vector<uint32_t> occluderSlots, dynamicSlots;
+        // The entries whose renderer was added or moved while the storage's changes were replayed (kept here to avoid reallocating it)
+        std::vector<uint32_t> touched;
+        // The version of the mesh renderer storage when the entries were matched to the renderers
+        uint64_t storageVersion = std::numeric_limits<uint64_t>::max();
+        // The ids of the shaders, materials and meshes in the sort keys
+        SortIdTable shaderIds, materialIds, meshIds;
+        RenderListStatistics statistics;
+
+        // Rebuilds the command and the bounds of an entry from its mesh renderer
+        void build(size_t entry);
+        // Packs the shader, material and mesh ids of an entry
+        void packState(size_t entry);
+        // Adds the entry to (or removes it from) the "occluders" and "dynamicEntries" lists that its renderer belongs to
+        void addToLists(uint32_t entry);
+        void removeFromLists(uint32_t entry);
+        // Resizes all the per-entry arrays (the new entries have a null handle until they are built)
+        void resizeEntries(size_t count);
+        // Moves an entry to another index (the entry at "to" is overwritten)
+        void moveEntry(uint32_t from, uint32_t to);
+        // Updates the entries after mesh renderers were added or removed
+        void restructure(World* world);
+        // Replays the given changes of the storage on the entries
+        void applyChanges(ComponentStorage<MeshRendererComponent>& storage, const ComponentChange* changes, size_t changeCount);
+        // Matches all the entries to the renderers of the storage by the handles of their owners
+        void rebuild(ComponentStorage<MeshRendererComponent>& storage);
+
+    public:
+        // This should be called every frame before the commands are read (after the transform system,
+        // since the world matrices are read from the job system's threads if one is given)
+        void update(World* world, JobSystem* jobSystem = nullptr);
+
+        size_t size() const { return commands.size(); }
+        const std::vector<RenderCommand>& getCommands() const { return commands; }
+        const std::vector<BoundingBox>& getBoxes() const { return boxes; }
+        const float* getSphereX() const { return sphereX.data(); }
+        const float* getSphereY() const { return sphereY.data(); }
+        const float* getSphereZ() const { return sphereZ.data(); }
+        const float* getSphereRadius() const { return sphereRadius.data(); }
+        const std::vector<uint32_t>& getOccluders() const { return occluders; }
+        // Returns the handle of each entry's owner (it identifies the object from one frame to the next unlike the entry index)
+        const std::vector<EntityHandle>& getHandles() const { return handles; }
+        // Returns the version of the mesh renderer storage that the entries match
+        uint64_t getStorageVersion() const { return storageVersion; }
+        const RenderListStatistics& getStatistics() const { return statistics; }
+    };
+
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+namespace our
+{
+
+    // The passes of the renderer in the order they are drawn
+    enum class RenderPass : uint64_t {
+        Opaque = 0,
+        Transparent = 1
+    };
+
+    // A sort key packs everything that decides the order of a draw into a single 64-bit integer,
+    // so sorting the render queues is just sorting integers (which a radix sort does in linear time).
+    // From the most to the least significant bits, an opaque key holds:
+    //      pass (2 bits) | shader (10 bits) | material (14 bits) | mesh (14 bits) | depth (24 bits)
+    // so the draws that share a shader, then a material, then a mesh end up next to each other (fewer state changes)
+    // and the draws with the same state are drawn front to back (so the depth test rejects more of the hidden fragments).
+    // A transparent key puts the depth first (inverted, so the farthest object comes first) since the transparent objects
+    // must be drawn back to front to be blended correctly, and only the draws at the same depth are ordered by their state:
+    //      pass (2 bits) | inverted depth (24 bits) | shader (10 bits) | material (14 bits) | mesh (14 bits)
+    // The shader, material and mesh ids are masked to their field width, so two objects can share an id if there are
+    // too many of them. This only makes the order less than ideal since the renderer still compares the actual objects.
+    // The lowest LOD_BITS of the mesh field hold the level of detail that is drawn (see "Mesh::selectLod"), so the levels of
+    // a mesh are next to each other and the renderer picks a level by adding it to the state without looking up an id.
+    namespace sort_key {
+        constexpr int PASS_BITS = 2, SHADER_BITS = 10, MATERIAL_BITS = 14, MESH_BITS = 14, DEPTH_BITS = 24;
+        constexpr int LOD_BITS = 3;
+        constexpr uint64_t mask(int bits) { return (uint64_t(1) << bits) - 1; }
+        constexpr uint64_t MAX_DEPTH = mask(DEPTH_BITS);
+
+        // Quantizes a view depth in [0, far] to DEPTH_BITS bits (the depths outside the range are clamped)
+        inline uint64_t quantizeDepth(float depth, float far) {
+            float normalized = glm::clamp(depth / far, 0.0f, 1.0f);
+            return static_cast<uint64_t>(normalized * static_cast<float>(MAX_DEPTH));
+        }
+
+        // Packs the shader, material and mesh ids into the lowest 38 bits (the level of detail is 0)
+        inline uint64_t packState(uint32_t shader, uint32_t material, uint32_t mesh) {
+            return ((shader & mask(SHADER_BITS)) << (MATERIAL_BITS + MESH_BITS))
+                 | ((material & mask(MATERIAL_BITS)) << MESH_BITS)
+                 | ((uint64_t(mesh) << LOD_BITS) & mask(MESH_BITS));
+        }
+
+        // Returns a state packed by "packState" with the given level of detail (which must be less than 2^LOD_BITS)
+        inline uint64_t withLod(uint64_t state, size_t level) {
+            return state | level;
+        }
+
+        // These take a state packed by "packState" (which does not change from frame to frame unlike the depth)
+        inline uint64_t opaque(uint64_t state, uint64_t depth) {
+            return (static_cast<uint64_t>(RenderPass::Opaque) << (64 - PASS_BITS))
+                 | (state << DEPTH_BITS)
+                 | depth;
+        }
+
+        inline uint64_t transparent(uint64_t state, uint64_t depth) {
+            return (static_cast<uint64_t>(RenderPass::Transparent) << (64 - PASS_BITS))
+                 | ((MAX_DEPTH - depth) << (SHADER_BITS + MATERIAL_BITS + MESH_BITS))
+                 | state;
+        }
+
+        inline uint64_t opaque(uint32_t shader, uint32_t material, uint32_t mesh, uint64_t depth) {
+            return opaque(packState(shader, material, mesh), depth);
+        }
+
+        inline uint64_t transparent(uint32_t shader, uint32_t material, uint32_t mesh, uint64_t depth) {
+            return transparent(packState(shader, material, mesh), depth);
+        }
+    }
+
+    // Gives each object a small id in the order they are first seen
+    // It is used to pack the shaders, materials and meshes into the sort keys (their addresses are too large to fit)
+    class SortIdTable {
+        std::unordered_map<const void*, uint32_t> ids;
+    public:
+        uint32_t get(const void* object) {
+            auto [it, inserted] = ids.try_emplace(object, static_cast<uint32_t>(ids.size()));
+            return it->second;
+        }
+        void clear() { ids.clear(); }
+    };
+
+    // Sorts 64-bit keys using a least significant digit radix sort with 8-bit digits.
+    // Instead of moving the sorted items, it returns the order in which they should be visited,
+    // so a queue of large commands is sorted without copying a single command.
+    // The sort is stable, and the digits that are the same in every key (e.g. the pass bits) are skipped.
+    class RadixSorter {
+        static constexpr int DIGIT_BITS = 8;
+        static constexpr int DIGIT_COUNT = 64 / DIGIT_BITS;
+        static constexpr size_t BUCKET_COUNT = size_t(1) << DIGIT_BITS;
+
+        // The keys and indices are sorted back and forth between these buffers (kept here to avoid reallocating them every frame)
+        std::vector<uint64_t> keys[2];
+        std::vector<uint32_t> indices[2];
+
+    public:
+        // Fills "order" with the indices of the keys in ascending order of the keys
+        void sort(const std::vector<uint64_t>& input, std::vector<uint32_t>& order) {
+            size_t count = input.size();
+            order.resize(count);
+            if(count == 0) return;
+
+            // We count the occurrences of every digit of every key in a single pass over the keys
+            size_t histograms[DIGIT_COUNT][BUCKET_COUNT] = {};
+            for(uint64_t key : input)
+                for(int digit = 0; digit < DIGIT_COUNT; ++digit)
+                    ++histograms[digit][(key >> (digit * DIGIT_BITS)) & (BUCKET_COUNT - 1)];
+
+            for(int buffer = 0; buffer < 2; ++buffer){
+                keys[buffer].resize(count);
+                indices[buffer].resize(count);
+            }
+            keys[0] = input;
+            for(uint32_t index = 0; index < count; ++index) indices[0][index] = index;
+
+            int current = 0;
+            for(int digit = 0; digit < DIGIT_COUNT; ++digit){
+                size_t* histogram = histograms[digit];
+                // If every key has the same value for this digit, this pass would not change anything
+                int shift = digit * DIGIT_BITS;
+                if(histogram[(input[0] >> shift) & (BUCKET_COUNT - 1)] == count) continue;
+                // The histogram is turned into the offset at which each bucket starts
+                size_t offset = 0;
+                for(size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket){
+                    size_t bucketCount = histogram[bucket];
+                    histogram[bucket] = offset;
+                    offset += bucketCount;
+                }
+                const uint64_t* sourceKeys = keys[current].data();
+                const uint32_t* sourceIndices = indices[current].data();
+                uint64_t* destinationKeys = keys[1 - current].data();
+                uint32_t* destinationIndices = indices[1 - current].data();
+                for(size_t index = 0; index < count; ++index){
+                    size_t position = histogram[(sourceKeys[index] >> shift) & (BUCKET_COUNT - 1)]++;
+                    destinationKeys[position] = sourceKeys[index];
+                    destinationIndices[position] = sourceIndices[index];
+                }
+                current = 1 - current;
+            }
+            order.assign(indices[current].begin(), indices[current].end());
+        }
+    };
+
+}
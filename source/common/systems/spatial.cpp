@@ -0,0 +1,156 @@
+#include "spatial.hpp"
+#include "../culling/frustum.hpp"
+
+namespace our {
+
+    // Returns the world space box of the mesh renderer (an empty box if it has no mesh, so it is never found by a query)
+    static BoundingBox computeWorldBox(MeshRendererComponent* renderer) {
+        if(!renderer->mesh) return BoundingBox();
+        return transformBox(renderer->mesh->getBounds().box, renderer->getOwner()->getLocalToWorldMatrix());
+    }
+
+    void SpatialSystem::rebuild(World* world) {
+        auto& storage = world->getStorage<MeshRendererComponent>();
+        size_t count = storage.size();
+        // The items are numbered again in the order of the storage
+        renderers.resize(count);
+        handles.resize(count);
+        boxes.resize(count);
+        worldVersions.resize(count);
+        meshes.resize(count);
+        storageIndices.resize(count);
+        freeItems.clear();
+        storageItems.resize(count);
+        for(size_t index = 0; index < count; ++index){
+            MeshRendererComponent* renderer = &storage[index];
+            renderers[index] = renderer;
+            handles[index] = renderer->getOwner()->getHandle();
+            boxes[index] = computeWorldBox(renderer);
+            worldVersions[index] = renderer->getOwner()->getWorldVersion();
+            meshes[index] = renderer->mesh;
+            storageIndices[index] = storageItems[index] = static_cast<uint32_t>(index);
+        }
+        bvh.build(boxes);
+        ++statistics.rebuilds;
+        statistics.rebuilt = true;
+    }
+
+    void SpatialSystem::applyChanges(ComponentStorage<MeshRendererComponent>& storage, const ComponentChange* changes, size_t changeCount) {
+        // The changes are replayed in the order in which they were made to find the item of each removed renderer.
+        // The new items are inserted after all the changes are replayed since a later removal may have moved their renderer.
+        touched.clear();
+        for(size_t index = 0; index < changeCount; ++index){
+            const ComponentChange& change = changes[index];
+            if(change.added){
+                uint32_t item;
+                if(!freeItems.empty()){
+                    item = freeItems.back();
+                    freeItems.pop_back();
+                } else {
+                    item = static_cast<uint32_t>(renderers.size());
+                    renderers.push_back(nullptr);
+                    handles.push_back({});
+                    boxes.push_back({});
+                    worldVersions.push_back(0);
+                    meshes.push_back(nullptr);
+                    storageIndices.push_back(0);
+                }
+                storageIndices[item] = static_cast<uint32_t>(storageItems.size());
+                storageItems.push_back(item);
+                touched.push_back(change.index);
+                continue;
+            }
+            uint32_t item = storageItems[change.index];
+            // An item added by an earlier change is not in the hierarchy yet
+            if(handles[item].generation != 0) bvh.remove(item, boxes);
+            renderers[item] = nullptr;
+            handles[item] = {};
+            boxes[item] = BoundingBox();
+            meshes[item] = nullptr;
+            storageIndices[item] = std::numeric_limits<uint32_t>::max();
+            freeItems.push_back(item);
+            // Like the storage, the last renderer fills the hole
+            if(change.index + 1 != storageItems.size()){
+                storageItems[change.index] = storageItems.back();
+                storageIndices[storageItems.back()] = change.index;
+                touched.push_back(change.index);
+            }
+            storageItems.pop_back();
+        }
+        for(uint32_t index : touched){
+            if(index >= storageItems.size()) continue;
+            uint32_t item = storageItems[index];
+            // The renderer of a moved item is at its new index in the storage
+            MeshRendererComponent* renderer = &storage[index];
+            renderers[item] = renderer;
+            if(handles[item].generation != 0) continue;
+            handles[item] = renderer->getOwner()->getHandle();
+            boxes[item] = computeWorldBox(renderer);
+            worldVersions[item] = renderer->getOwner()->getWorldVersion();
+            meshes[item] = renderer->mesh;
+            bvh.insert(item, boxes);
+        }
+    }
+
+    void SpatialSystem::update(World* world) {
+        statistics.rebuilt = false;
+        statistics.moved = 0;
+        auto& storage = world->getStorage<MeshRendererComponent>();
+        if(storage.getVersion() != storageVersion){
+            // A few added or removed renderers are inserted into and removed from the hierarchy,
+            // while a bulk change (or a cleared storage) rebuilds it from scratch
+            const ComponentChange* changes = nullptr;
+            size_t changeCount = 0;
+            bool replayed = storage.getChangesSince(storageVersion, changes, changeCount) && changeCount * BULK_CHANGE_RATIO <= storageItems.size();
+            if(replayed) applyChanges(storage, changes, changeCount);
+            else rebuild(world);
+            storageVersion = storage.getVersion();
+            if(!replayed){
+                statistics.items = storageItems.size();
+                statistics.moved = storageItems.size();
+                return;
+            }
+        }
+
+        // Otherwise, we only recompute the boxes of the entities whose matrix (or mesh) changed since the last update
+        changed.clear();
+        for(uint32_t item : storageItems){
+            MeshRendererComponent* renderer = renderers[item];
+            // Reading the matrix makes sure the world version is up to date even if the transform system did not run
+            renderer->getOwner()->getLocalToWorldMatrix();
+            uint32_t worldVersion = renderer->getOwner()->getWorldVersion();
+            if(worldVersion == worldVersions[item] && renderer->mesh == meshes[item]) continue;
+            worldVersions[item] = worldVersion;
+            meshes[item] = renderer->mesh;
+            BoundingBox box = computeWorldBox(renderer);
+            if(box == boxes[item]) continue;
+            boxes[item] = box;
+            changed.push_back(item);
+        }
+        statistics.items = storageItems.size();
+        statistics.moved = changed.size();
+
+        // Walking up from each item is cheaper when few items moved, but it visits the upper nodes many times when a lot of them did
+        if(changed.size() * FULL_REFIT_RATIO > storageItems.size()) bvh.refit(boxes);
+        else if(!changed.empty()) bvh.refit(boxes, changed);
+
+        // The refitted tree can be much worse than a new one if the items moved far from where they were when it was built
+        // (or after many insertions and removals)
+        if(bvh.needsRebuild()){
+            bvh.build(boxes, storageItems);
+            ++statistics.rebuilds;
+            statistics.rebuilt = true;
+        }
+    }
+
+    Entity* SpatialSystem::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float* distance) const {
+        glm::vec3 inverseDirection = 1.0f / direction;
+        RayHit hit = bvh.raycast(origin, direction, maxDistance, boxes, [&](uint32_t item, float maxDistance){
+            return intersectRay(boxes[item], origin, inverseDirection, maxDistance);
+        });
+        if(!hit.hit()) return nullptr;
+        if(distance) *distance = hit.distance;
+        return renderers[hit.item]->getOwner();
+    }
+
+}
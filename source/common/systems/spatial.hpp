@@ -0,0 +1,95 @@
+#pragma once
+
+#include "../ecs/world.hpp"
+#include "../components/mesh-renderer.hpp"
+#include "../culling/bvh.hpp"
+
+#include <vector>
+#include <cstdint>
+#include <limits>
+
+namespace our
+{
+
+    // The statistics of the last update of the spatial system
+    struct SpatialStatistics {
+        size_t items = 0; // The number of mesh renderers in the hierarchy
+        size_t moved = 0; // The number of mesh renderers whose bounds changed in the last update
+        size_t rebuilds = 0; // The number of times the hierarchy was rebuilt since the system was created
+        bool rebuilt = false; // True if the hierarchy was rebuilt (instead of refitted) in the last update
+    };
+
+    // The spatial system keeps a bounding volume hierarchy (see "common/culling/bvh.hpp") over the world space bounding boxes
+    // of all the mesh renderers in the world, so that the renderer and the gameplay code can find the objects inside a frustum,
+    // overlapping a box or hit by a ray without scanning the whole world.
+    // It should run every frame after the transform system (since it reads the cached local to world matrices).
+    // Each mesh renderer is an item of the hierarchy that belongs to the handle of its owner until the renderer is removed,
+    // so the storage moving the renderers around does not change the items. When a few mesh renderers are added or removed,
+    // their items are inserted into and removed from the hierarchy (the storage's changes are replayed to find them), and after
+    // bulk changes the hierarchy is rebuilt from scratch. Otherwise, only the boxes of the entities that moved are recomputed
+    // and the hierarchy is refitted, which is rebuilt only once its quality degrades too much.
+    class SpatialSystem {
+        // If more than 1 / FULL_REFIT_RATIO of the items moved, we refit the whole tree instead of walking up from each item
+        static constexpr size_t FULL_REFIT_RATIO = 4;
+        // If more than 1 / BULK_CHANGE_RATIO of the items were added or removed, we rebuild the tree instead of inserting and removing them
+        static constexpr size_t BULK_CHANGE_RATIO = 4;
+
+        BoundingVolumeHierarchy bvh;
+        // The following arrays are indexed by the item (the items of the removed renderers are reused by the new ones)
+        std::vector<MeshRendererComponent*> renderers; // The mesh renderer of each item
+        std::vector<EntityHandle> handles; // The handle of the owner of each item (a null handle if the item is free or not inserted yet)
+        std::vector<BoundingBox> boxes; // The world space bounding box of each item
+        std::vector<uint32_t> worldVersions; // The world version of the owner when its box was computed
+        std::vector<Mesh*> meshes; // The mesh used to compute the box (so that we notice if the mesh changes)
+        std::vector<uint32_t> storageIndices; // The index of the renderer of each item in the storage
+        std::vector<uint32_t> freeItems; // The items that are not used by any renderer
+        std::vector<uint32_t> storageItems; // The item of each mesh renderer in the order of the storage
+        std::vector<uint32_t> changed; // The items that moved in the last update (kept here to avoid reallocating it every frame)
+        std::vector<uint32_t> touched; // The storage indices whose renderer was added or moved while the storage's changes were replayed
+        // The version of the mesh renderer storage that the items were last matched to
+        uint64_t storageVersion = std::numeric_limits<uint64_t>::max();
+        SpatialStatistics statistics;
+
+        // Recomputes all the boxes and builds the hierarchy from scratch
+        void rebuild(World* world);
+        // Inserts and removes the items of the renderers added to and removed from the storage by the given changes
+        void applyChanges(ComponentStorage<MeshRendererComponent>& storage, const ComponentChange* changes, size_t changeCount);
+
+    public:
+        // This should be called every frame (after the transform system) to update the hierarchy
+        void update(World* world);
+
+        // Appends the mesh renderers whose bounding box is inside or intersects the frustum to "result"
+        void queryFrustum(const Frustum& frustum, std::vector<MeshRendererComponent*>& result) const {
+            bvh.queryFrustum(frustum, boxes, [&](uint32_t item){ result.push_back(renderers[item]); });
+        }
+
+        // Appends the items whose bounding box is inside or intersects the frustum to "items"
+        // The item of a mesh renderer stays the same until the renderer is removed (see "getStorageIndices" to find the renderer)
+        void queryFrustum(const Frustum& frustum, std::vector<uint32_t>& items) const {
+            bvh.queryFrustum(frustum, boxes, [&](uint32_t item){ items.push_back(item); });
+        }
+
+        // Appends the entities whose mesh renderer bounding box overlaps the given box to "result"
+        void queryOverlap(const BoundingBox& box, std::vector<Entity*>& result) const {
+            bvh.queryOverlap(box, boxes, [&](uint32_t item){ result.push_back(renderers[item]->getOwner()); });
+        }
+
+        // Returns the entity whose mesh renderer bounding box is the first to be hit by the ray (or nullptr if none is hit)
+        // If "distance" is given, it receives the hit distance (in units of the ray direction)
+        Entity* raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance = std::numeric_limits<float>::infinity(), float* distance = nullptr) const;
+
+        // Returns the world space bounding box of each item (in the same order as "getRenderers" and "getHandles")
+        // The free items have an empty box and a null handle
+        const std::vector<BoundingBox>& getBoxes() const { return boxes; }
+        const std::vector<MeshRendererComponent*>& getRenderers() const { return renderers; }
+        const std::vector<EntityHandle>& getHandles() const { return handles; }
+        // Returns the index of the mesh renderer of each item in the storage (as of "getStorageVersion"), which is also its render list entry
+        const std::vector<uint32_t>& getStorageIndices() const { return storageIndices; }
+        const BoundingVolumeHierarchy& getHierarchy() const { return bvh; }
+        // Returns the version of the mesh renderer storage when the items were last matched to the mesh renderers
+        uint64_t getStorageVersion() const { return storageVersion; }
+        const SpatialStatistics& getStatistics() const { return statistics; }
+    };
+
+}
@@ -0,0 +1,260 @@
+#include "static-batching.hpp"
+#include "../culling/frustum.hpp"
+#include "../asset-loader.hpp"
+
+#include <glm/gtc/matrix_inverse.hpp>
+#include <unordered_map>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+
+namespace our {
+
+    // The cache files start with this tag and version (the version is increased whenever the file layout changes)
+    static constexpr uint32_t CACHE_MAGIC = 0x54414253; // "SBAT"
+    static constexpr uint32_t CACHE_VERSION = 1;
+
+    // A 64-bit FNV-1a hash, which is more than enough to tell the scenes apart
+    struct KeyHasher {
+        uint64_t value = 14695981039346656037ull;
+        void add(const void* data, size_t size) {
+            const uint8_t* bytes = static_cast<const uint8_t*>(data);
+            for(size_t index = 0; index < size; ++index){
+                value ^= bytes[index];
+                value *= 1099511628211ull;
+            }
+        }
+        template<typename T>
+        void add(const T& data) { add(&data, sizeof(T)); }
+        void add(const std::string& text) {
+            add(text.size());
+            add(text.data(), text.size());
+        }
+    };
+
+    void StaticBatcher::split(const std::vector<Source>& sources, std::vector<uint32_t>& items, size_t begin, size_t end, std::vector<Batch>& batches) const {
+        BoundingBox box, centers;
+        size_t vertexCount = 0;
+        for(size_t index = begin; index < end; ++index){
+            const Source& source = sources[items[index]];
+            box.expand(source.box);
+            centers.expand(source.box.getCenter());
+            vertexCount += source.vertexCount;
+        }
+        glm::vec3 size = box.max - box.min;
+        float extent = glm::max(size.x, glm::max(size.y, size.z));
+        glm::vec3 spread = centers.max - centers.min;
+        // A part is kept when it is small enough or when it cannot be split anymore (a single source or sources at the same place)
+        bool small = vertexCount <= maxVertices && extent <= maxExtent;
+        if(end - begin == 1 || small || glm::max(spread.x, glm::max(spread.y, spread.z)) == 0.0f){
+            batches.push_back(Batch{ std::vector<uint32_t>(items.begin() + begin, items.begin() + end), {}, {} });
+            return;
+        }
+        int axis = spread.x >= spread.y && spread.x >= spread.z ? 0 : (spread.y >= spread.z ? 1 : 2);
+        size_t middle = begin + (end - begin) / 2;
+        std::nth_element(items.begin() + begin, items.begin() + middle, items.begin() + end, [&](uint32_t a, uint32_t b){
+            return sources[a].box.getCenter()[axis] < sources[b].box.getCenter()[axis];
+        });
+        split(sources, items, begin, middle, batches);
+        split(sources, items, middle, end, batches);
+    }
+
+    void StaticBatcher::merge(const std::vector<Source>& sources, Batch& batch) const {
+        // The sources often share a few meshes, so each mesh is only read back once
+        std::unordered_map<const Mesh*, std::pair<std::vector<Vertex>, std::vector<unsigned int>>> geometry;
+        for(uint32_t item : batch.sources){
+            const Source& source = sources[item];
+            auto [it, inserted] = geometry.try_emplace(source.mesh);
+            if(inserted) source.mesh->read(it->second.first, it->second.second);
+            const auto& [vertices, elements] = it->second;
+
+            // The normals are transformed by the inverse transpose, so they stay perpendicular to the surface under non-uniform scaling
+            glm::mat3 normalMatrix = glm::inverseTranspose(glm::mat3(source.localToWorld));
+            // A mirroring transform flips the winding of the triangles, so their order is reversed to keep the front faces
+            bool mirrored = glm::determinant(glm::mat3(source.localToWorld)) < 0.0f;
+            unsigned int first = static_cast<unsigned int>(batch.vertices.size());
+            for(Vertex vertex : vertices){
+                vertex.position = glm::vec3(source.localToWorld * glm::vec4(vertex.position, 1.0f));
+                glm::vec3 normal = normalMatrix * vertex.normal;
+                float length = glm::length(normal);
+                vertex.normal = length > 0.0f ? normal / length : normal;
+                batch.vertices.push_back(vertex);
+            }
+            for(size_t index = 0; index + 2 < elements.size(); index += 3){
+                batch.elements.push_back(first + elements[index]);
+                batch.elements.push_back(first + elements[index + (mirrored ? 2 : 1)]);
+                batch.elements.push_back(first + elements[index + (mirrored ? 1 : 2)]);
+            }
+        }
+    }
+
+    bool StaticBatcher::computeKey(const std::vector<Source>& sources, uint64_t& key) const {
+        KeyHasher hasher;
+        hasher.add(CACHE_VERSION);
+        hasher.add(maxVertices);
+        hasher.add(maxExtent);
+        hasher.add(minSources);
+        hasher.add(sources.size());
+        for(const Source& source : sources){
+            // The assets are identified by their names, along with the sizes and bounds of the meshes
+            // so that the cache is not used after a model file is replaced by another one
+            std::string meshName = AssetLoader<Mesh>::getName(source.mesh);
+            std::string materialName = AssetLoader<Material>::getName(source.material);
+            if(meshName.empty() || materialName.empty()) return false;
+            hasher.add(meshName);
+            hasher.add(materialName);
+            hasher.add(source.mesh->getVertexCount());
+            hasher.add(source.mesh->getElementCount());
+            hasher.add(source.mesh->getBounds().box);
+            hasher.add(source.localToWorld);
+        }
+        key = hasher.value;
+        return true;
+    }
+
+    // Returns the path of the cache file of the given key
+    static std::filesystem::path getCachePath(const std::string& directory, uint64_t key) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+        return std::filesystem::path(directory) / name;
+    }
+
+    bool StaticBatcher::readCache(uint64_t key, const std::vector<Source>& sources, std::vector<Batch>& batches) const {
+        std::ifstream file(getCachePath(cacheDirectory, key), std::ios::binary);
+        if(!file) return false;
+        auto read = [&](void* data, size_t size){ return bool(file.read(static_cast<char*>(data), size)); };
+        uint32_t magic = 0, version = 0, batchCount = 0;
+        uint64_t storedKey = 0;
+        if(!read(&magic, sizeof(magic)) || !read(&version, sizeof(version)) || !read(&storedKey, sizeof(storedKey)) || !read(&batchCount, sizeof(batchCount))) return false;
+        if(magic != CACHE_MAGIC || version != CACHE_VERSION || storedKey != key) return false;
+        batches.resize(batchCount);
+        for(Batch& batch : batches){
+            uint32_t sourceCount = 0, vertexCount = 0, elementCount = 0;
+            if(!read(&sourceCount, sizeof(sourceCount)) || sourceCount == 0 || sourceCount > sources.size()) return false;
+            batch.sources.resize(sourceCount);
+            if(!read(batch.sources.data(), sourceCount * sizeof(uint32_t))) return false;
+            if(!read(&vertexCount, sizeof(vertexCount))) return false;
+            batch.vertices.resize(vertexCount);
+            if(!read(batch.vertices.data(), vertexCount * sizeof(Vertex))) return false;
+            if(!read(&elementCount, sizeof(elementCount))) return false;
+            batch.elements.resize(elementCount);
+            if(!read(batch.elements.data(), elementCount * sizeof(unsigned int))) return false;
+            // The key covers the sources, but a damaged file must not make us remove the wrong mesh renderers
+            for(uint32_t item : batch.sources){
+                if(item >= sources.size() || sources[item].material != sources[batch.sources[0]].material) return false;
+            }
+            for(unsigned int element : batch.elements){
+                if(element >= vertexCount) return false;
+            }
+        }
+        return true;
+    }
+
+    void StaticBatcher::writeCache(uint64_t key, const std::vector<Batch>& batches) const {
+        std::error_code error;
+        std::filesystem::create_directories(cacheDirectory, error);
+        std::ofstream file(getCachePath(cacheDirectory, key), std::ios::binary | std::ios::trunc);
+        if(!file){
+            std::cerr << "Could not write the static batching cache to: " << cacheDirectory << std::endl;
+            return;
+        }
+        // The vertices are written as they are in memory, so the cache is only meant to be read by the same build
+        auto write = [&](const void* data, size_t size){ file.write(static_cast<const char*>(data), size); };
+        uint32_t batchCount = static_cast<uint32_t>(batches.size());
+        write(&CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        write(&CACHE_VERSION, sizeof(CACHE_VERSION));
+        write(&key, sizeof(key));
+        write(&batchCount, sizeof(batchCount));
+        for(const Batch& batch : batches){
+            uint32_t sourceCount = static_cast<uint32_t>(batch.sources.size());
+            uint32_t vertexCount = static_cast<uint32_t>(batch.vertices.size());
+            uint32_t elementCount = static_cast<uint32_t>(batch.elements.size());
+            write(&sourceCount, sizeof(sourceCount));
+            write(batch.sources.data(), sourceCount * sizeof(uint32_t));
+            write(&vertexCount, sizeof(vertexCount));
+            write(batch.vertices.data(), vertexCount * sizeof(Vertex));
+            write(&elementCount, sizeof(elementCount));
+            write(batch.elements.data(), elementCount * sizeof(unsigned int));
+        }
+    }
+
+    void StaticBatcher::build(World* world, const nlohmann::json& config) {
+        statistics = StaticBatchingStatistics();
+        if(!config.is_object() || !config.value("enabled", true)) return;
+        maxVertices = config.value("max-vertices", maxVertices);
+        maxExtent = config.value("max-extent", maxExtent);
+        minSources = std::max<size_t>(config.value("min-sources", minSources), 2);
+        cacheDirectory = config.value("cache", cacheDirectory);
+
+        // We collect the static mesh renderers in the storage order (which only depends on the scene file)
+        std::vector<Source> sources;
+        auto& storage = world->getStorage<MeshRendererComponent>();
+        for(size_t index = 0; index < storage.size(); ++index){
+            MeshRendererComponent& renderer = storage[index];
+            if(!renderer.isStatic || !renderer.mesh || !renderer.material || renderer.material->transparent) continue;
+            // The occluders keep their own mesh renderer: a batch would lose the flag, and the CPU rasterizer would draw
+            // every triangle of the batch instead of the few large occluders
+            if(renderer.isOccluder) continue;
+            Entity* owner = renderer.getOwner();
+            glm::mat4 localToWorld = owner->getLocalToWorldMatrix();
+            sources.push_back(Source{ owner, renderer.mesh, renderer.material, localToWorld,
+                transformBox(renderer.mesh->getBounds().box, localToWorld), static_cast<size_t>(renderer.mesh->getVertexCount()) });
+        }
+        statistics.candidates = sources.size();
+        if(sources.empty()) return;
+
+        std::vector<Batch> batches;
+        uint64_t key = 0;
+        bool cacheable = !cacheDirectory.empty() && computeKey(sources, key);
+        if(cacheable && readCache(key, sources, batches)){
+            statistics.cached = true;
+        } else {
+            batches.clear();
+            // The sources are grouped by material (in the order the materials are first found) and each group is split in space
+            std::vector<std::vector<uint32_t>> groups;
+            std::unordered_map<const Material*, size_t> groupOfMaterial;
+            for(uint32_t item = 0; item < sources.size(); ++item){
+                auto [it, inserted] = groupOfMaterial.try_emplace(sources[item].material, groups.size());
+                if(inserted) groups.emplace_back();
+                groups[it->second].push_back(item);
+            }
+            for(std::vector<uint32_t>& group : groups){
+                if(group.size() < minSources) continue;
+                split(sources, group, 0, group.size(), batches);
+            }
+            // A part with too few sources would not save any draw call, so its sources are left as they are
+            batches.erase(std::remove_if(batches.begin(), batches.end(), [&](const Batch& batch){ return batch.sources.size() < minSources; }), batches.end());
+            for(Batch& batch : batches) merge(sources, batch);
+            if(cacheable) writeCache(key, batches);
+        }
+
+        // Each batch is drawn by a new entity at the origin, then the mesh renderers of its sources are removed
+        // (the source entities are kept since they could have other components or children)
+        for(const Batch& batch : batches){
+            Mesh* mesh = new Mesh(batch.vertices, batch.elements);
+            meshes.push_back(mesh);
+            Entity* entity = world->add();
+            entity->name = "Static Batch";
+            MeshRendererComponent* renderer = entity->addComponent<MeshRendererComponent>();
+            renderer->mesh = mesh;
+            renderer->material = sources[batch.sources[0]].material;
+            renderer->isStatic = true;
+            statistics.sources += batch.sources.size();
+            statistics.vertices += batch.vertices.size();
+            statistics.elements += batch.elements.size();
+        }
+        for(const Batch& batch : batches){
+            for(uint32_t item : batch.sources) sources[item].owner->deleteComponent<MeshRendererComponent>();
+        }
+        statistics.batches = batches.size();
+    }
+
+    void StaticBatcher::destroy() {
+        for(Mesh* mesh : meshes) delete mesh;
+        meshes.clear();
+    }
+
+}
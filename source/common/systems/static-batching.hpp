@@ -0,0 +1,82 @@
+#pragma once
+
+#include "../ecs/world.hpp"
+#include "../components/mesh-renderer.hpp"
+#include "../mesh/bounds.hpp"
+
+#include <json/json.hpp>
+#include <glm/glm.hpp>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+namespace our
+{
+
+    // The statistics of the last call to "StaticBatcher::build"
+    struct StaticBatchingStatistics {
+        size_t candidates = 0; // The number of static mesh renderers found in the world
+        size_t sources = 0; // The number of mesh renderers that were merged into batches
+        size_t batches = 0; // The number of batches (each one replaces its sources by a single mesh renderer)
+        size_t vertices = 0, elements = 0; // The total size of the merged meshes
+        bool cached = false; // True if the batches were loaded from the cache instead of being merged
+    };
+
+    // The static batcher merges the level geometry (many small static mesh renderers sharing a material) into a few large meshes.
+    // The vertices of each source are transformed to the world space, so a batch is drawn at the identity with a single draw call.
+    // The mesh renderers of a material are split in space (at the median of their centers along the longest axis) until
+    // each batch is small enough, so the batches can still be culled.
+    // It runs once after the world is deserialized: a new entity is added for each batch and the mesh renderers of its sources
+    // are removed, while the source entities (and the scene file) stay as they are.
+    // Since merging needs the vertices of the sources (which are read back from the VRAM), the batches are saved to a cache
+    // directory and loaded from it next time if the scene did not change.
+    // Only the mesh renderers marked as "static" with an opaque material are merged (the transparent objects are sorted one by one).
+    // The occluders are never merged (see "MeshRendererComponent::isOccluder").
+    class StaticBatcher {
+        // A static mesh renderer that can be merged
+        struct Source {
+            Entity* owner;
+            Mesh* mesh;
+            Material* material;
+            glm::mat4 localToWorld;
+            BoundingBox box; // The world space bounding box
+            size_t vertexCount;
+        };
+        // The data of a merged batch (the sources are indices into the sources of the build)
+        struct Batch {
+            std::vector<uint32_t> sources;
+            std::vector<Vertex> vertices;
+            std::vector<unsigned int> elements;
+        };
+
+        // The options of the batching (read from the config given to "build")
+        size_t maxVertices = 65536; // A batch is split if it has more vertices ("max-vertices", default: 65536)
+        float maxExtent = 50.0f; // A batch is split if its bounding box is larger along any axis ("max-extent", default: 50)
+        size_t minSources = 2; // Smaller groups are left as they are ("min-sources", default: 2)
+        std::string cacheDirectory; // Where the batches are cached ("cache", an empty string disables the cache)
+
+        // The merged meshes are owned by the batcher (they are not assets)
+        std::vector<Mesh*> meshes;
+        StaticBatchingStatistics statistics;
+
+        // Splits the sources in items[begin, end) until every part is small enough and adds each part to the batches
+        void split(const std::vector<Source>& sources, std::vector<uint32_t>& items, size_t begin, size_t end, std::vector<Batch>& batches) const;
+        // Transforms the vertices of the batch sources to the world space and merges them
+        void merge(const std::vector<Source>& sources, Batch& batch) const;
+        // Computes the key of the cache entry from the assets, the world matrices and the options (returns false if a source asset has no name)
+        bool computeKey(const std::vector<Source>& sources, uint64_t& key) const;
+        // Reads or writes the batches of the given key (the read fails if the entry is missing or does not match the sources)
+        bool readCache(uint64_t key, const std::vector<Source>& sources, std::vector<Batch>& batches) const;
+        void writeCache(uint64_t key, const std::vector<Batch>& batches) const;
+
+    public:
+        // Merges the static mesh renderers of the world (the world matrices are computed if needed)
+        // The config holds the options above, and nothing is done if "enabled" is false (default: true)
+        void build(World* world, const nlohmann::json& config);
+        // Deletes the merged meshes (this should be called after the world is cleared since the batch entities draw them)
+        void destroy();
+
+        const StaticBatchingStatistics& getStatistics() const { return statistics; }
+    };
+
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "../ecs/world.hpp"
+#include "../jobs/job-system.hpp"
+
+namespace our
+{
+
+    // The transform system refreshes the local to world matrices of every entity in the world.
+    // It should run every frame after the systems that move the entities and before the renderer,
+    // so that the renderer (and anything else that calls "getLocalToWorldMatrix") only reads cached matrices.
+    // The matrices are computed level by level over the world's flattened transform hierarchy
+    // (see "common/ecs/transform-hierarchy.hpp"), and only the entities that moved (or whose ancestors moved) are recomputed.
+    class TransformSystem {
+        // The depth levels are split into chunks of at least this many entities (smaller levels are not worth splitting)
+        static constexpr size_t GRAIN = 1024;
+    public:
+
+        // This should be called every frame to update the transforms of all the entities
+        // If a job system is given, each depth level is split between its threads
+        void update(World* world, JobSystem* jobSystem = nullptr) {
+            if(!jobSystem){
+                world->updateTransforms();
+                return;
+            }
+            world->updateTransforms([jobSystem](size_t begin, size_t end, auto&& function){
+                jobSystem->parallelFor(begin, end, function, GRAIN);
+            });
+        }
+
+    };
+
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <glad/gl.h>
+#include "../gl/state-cache.hpp"
 #include <json/json.hpp>
 #include <glm/vec4.hpp>
 
@@ -26,6 +27,7 @@ namespace our {
             // this function will delete the sampler
             // first parameter is the number of samplers that i want to delete
             // second parameter is the pointer to the variable that will hold the name of the sampler
+            GLStateCache::get().forgetSampler(name);
             glDeleteSamplers(1, &name);
          }
 
@@ -35,7 +37,7 @@ namespace our {
             // this function will bind the sampler to the texture unit
             // first parameter is the texture unit that i want to bind the sampler to
             // second parameter is the name of the sampler that i want to bind
-            glBindSampler(textureUnit, name);
+            GLStateCache::get().bindSampler(textureUnit, name);
         }
 
         // This static method ensures that no sampler is bound to the given texture unit
@@ -43,8 +45,7 @@ namespace our {
             //TODO: (Req 6) Complete this function
             // this function will unbind the sampler from the texture unit
             // first parameter is the texture unit that i want to unbind the sampler from
-            
-            glBindSampler(textureUnit, 0);
+            GLStateCache::get().bindSampler(textureUnit, 0);
         }
 
         // This function sets a sampler paramter where the value is of type "GLint"
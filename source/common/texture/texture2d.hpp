@@ -1,6 +1,7 @@
 #pragma once
 
 #include <glad/gl.h>
+#include "../gl/state-cache.hpp"
 
 namespace our {
 
@@ -25,6 +26,7 @@ namespace our {
             // this function will delete the texture
             // first parameter is the number of textures that i want to delete
             // second parameter is the pointer to the variable that will hold the name of the texture
+            GLStateCache::get().forgetTexture(name);
             glDeleteTextures(1, &name);
         }
 
@@ -40,7 +42,8 @@ namespace our {
             // first parameter is the target that i want to bind the texture to which is GL_TEXTURE_2D creating a 2D texture
             // second parameter is the name of the texture that i want to bind
 
-            glBindTexture(GL_TEXTURE_2D, name);
+            // The texture is bound to the active texture unit (the state cache skips the call if it is already bound there)
+            GLStateCache::get().bindTexture(name);
         }
 
         // This static method ensures that no texture is bound to GL_TEXTURE_2D
@@ -48,7 +51,7 @@ namespace our {
              //TODO: (Req 5) Complete this function
             // this function will unbind the texture from the GL_TEXTURE_2D
             // first parameter is the target that i want to unbind the texture from which is GL_TEXTURE_2D creating a 2D texture
-            glBindTexture(GL_TEXTURE_2D, 0);
+            GLStateCache::get().bindTexture(0);
         }
 
         Texture2D(const Texture2D&) = delete;
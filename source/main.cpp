@@ -16,6 +16,8 @@
 #include "states/material-test-state.hpp"
 #include "states/entity-test-state.hpp"
 #include "states/renderer-test-state.hpp"
+#include "states/ecs-benchmark-state.hpp"
+#include "states/render-benchmark-state.hpp"
 
 int main(int argc, char** argv) {
     
@@ -53,6 +55,8 @@ int main(int argc, char** argv) {
     app.registerState<MaterialTestState>("material-test");
     app.registerState<EntityTestState>("entity-test");
     app.registerState<RendererTestState>("renderer-test");
+    app.registerState<EcsBenchmarkState>("ecs-benchmark");
+    app.registerState<RenderBenchmarkState>("render-benchmark");
     // Then choose the state to run based on the option "start-scene" in the config
     if(app_config.contains(std::string{"start-scene"})){
         app.changeState(app_config["start-scene"].get<std::string>());
@@ -0,0 +1,293 @@
+#pragma once
+
+#include <application.hpp>
+#include <ecs/world.hpp>
+#include <components/camera.hpp>
+#include <components/mesh-renderer.hpp>
+#include <components/free-camera-controller.hpp>
+#include <components/movement.hpp>
+#include <systems/transform.hpp>
+#include <systems/movement.hpp>
+#include <culling/bvh.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <cstring>
+
+// This state measures the cost of some ECS operations on a large world and prints the results to the console.
+// It does not draw anything and it closes the application as soon as the benchmarks are done.
+// The benchmark options are read from the "benchmark" object in the app config (see "config/benchmark/ecs.jsonc").
+class EcsBenchmarkState: public our::State {
+
+    our::World world;
+
+    // Runs the given function "iterations" times and prints the average time per operation
+    // where "operations" is the number of operations done by a single call of the function
+    template<typename Function>
+    static void measure(const std::string& name, int iterations, size_t operations, Function&& function){
+        auto start = std::chrono::high_resolution_clock::now();
+        for(int iteration = 0; iteration < iterations; ++iteration) function();
+        auto end = std::chrono::high_resolution_clock::now();
+        double total = std::chrono::duration<double, std::nano>(end - start).count();
+        std::cout << std::left << std::setw(40) << name << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(12) << total / (double(iterations) * operations) << " ns/op"
+                  << std::setw(12) << total / (iterations * 1e6) << " ms/iteration" << std::endl;
+    }
+
+    // Measures the cost of computing the world matrices of a large hierarchy of entities
+    static void benchmarkTransforms(const nlohmann::json& config, our::JobSystem& jobSystem){
+        int entityCount = config.value("entities", 100000);
+        int iterations = config.value("iterations", 20);
+        int maxDepth = config.value("hierarchy-depth", 16);
+
+        // We build a hierarchy where each entity gets a random depth in [0, maxDepth] and a random parent from the level above
+        our::World world;
+        std::mt19937 generator(config.value("seed", 0));
+        std::uniform_int_distribution<int> depthDistribution(0, maxDepth);
+        std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+        std::vector<std::vector<our::Entity*>> levels(maxDepth + 1);
+        for(int index = 0; index < entityCount; ++index){
+            int depth = depthDistribution(generator);
+            while(depth > 0 && levels[depth - 1].empty()) --depth;
+            our::Entity* entity = world.add();
+            if(depth > 0){
+                auto& parents = levels[depth - 1];
+                entity->setParent(parents[std::uniform_int_distribution<size_t>(0, parents.size() - 1)(generator)]);
+            }
+            entity->localTransform.position = glm::vec3(offset(generator), offset(generator), offset(generator));
+            entity->localTransform.rotation = glm::vec3(offset(generator), offset(generator), offset(generator));
+            levels[depth].push_back(entity);
+        }
+        std::cout << "Transform benchmark on " << entityCount << " entities (" << levels[0].size() << " roots, max depth "
+                  << maxDepth << ")" << std::endl;
+
+        // The old way: every call recomputes the matrices of the entity and all of its ancestors
+        glm::mat4 sum(0.0f);
+        measure("world matrices (parent-chain walk)", iterations, size_t(entityCount), [&](){
+            for(auto entity : world.getEntities()){
+                glm::mat4 matrix = entity->localTransform.toMat4();
+                for(our::Entity* current = entity->getParent(); current; current = current->getParent())
+                    matrix = current->localTransform.toMat4() * matrix;
+                sum += matrix;
+            }
+        });
+        // Moving the roots dirties every entity so the whole hierarchy is recomputed in one pass
+        world.updateTransforms(); // The first update builds the flattened hierarchy
+        measure("updateTransforms (all moved)", iterations, size_t(entityCount), [&](){
+            for(auto root : levels[0]) root->localTransform.position.x += 0.01f;
+            world.updateTransforms();
+        });
+        // The same update with each depth level split between the job system's threads
+        our::TransformSystem transformSystem;
+        std::string parallelName = "updateTransforms (all moved, " + std::to_string(jobSystem.getThreadCount()) + " threads)";
+        measure(parallelName, iterations, size_t(entityCount), [&](){
+            for(auto root : levels[0]) root->localTransform.position.x += 0.01f;
+            transformSystem.update(&world, &jobSystem);
+        });
+        // Nothing moved so every entity is just checked against its cache
+        measure("updateTransforms (none moved)", iterations, size_t(entityCount), [&](){
+            world.updateTransforms();
+        });
+        // After the update, reading the matrices only validates the caches
+        measure("getLocalToWorldMatrix (cached)", iterations, size_t(entityCount), [&](){
+            for(auto entity : world.getEntities()) sum += entity->getLocalToWorldMatrix();
+        });
+        std::cout << "(checksum " << sum[3][0] << ", hierarchy depth " << world.getTransformHierarchy().getDepth() << ")" << std::endl;
+    }
+
+    // Measures the cost of building, refitting and querying a bounding volume hierarchy against a linear scan over the same boxes
+    static void benchmarkSpatial(const nlohmann::json& config){
+        int boxCount = config.value("entities", 100000);
+        int iterations = config.value("iterations", 20);
+        const size_t queryCount = 1000;
+
+        // The boxes are small objects scattered in a large cube (like the objects of a big open scene)
+        std::mt19937 generator(config.value("seed", 0));
+        std::uniform_real_distribution<float> position(-500.0f, 500.0f), size(0.5f, 4.0f), unit(-1.0f, 1.0f);
+        auto randomBox = [&](){
+            glm::vec3 center(position(generator), position(generator), position(generator));
+            glm::vec3 extents(size(generator), size(generator), size(generator));
+            return our::BoundingBox{ center - extents, center + extents };
+        };
+        std::vector<our::BoundingBox> boxes(boxCount);
+        for(auto& box : boxes) box = randomBox();
+        std::cout << "Spatial benchmark on " << boxCount << " boxes" << std::endl;
+
+        our::BoundingVolumeHierarchy bvh;
+        measure("BVH build", iterations, size_t(boxCount), [&](){ bvh.build(boxes); });
+        measure("BVH refit (all moved)", iterations, size_t(boxCount), [&](){
+            for(auto& box : boxes){ box.min.x += 0.01f; box.max.x += 0.01f; }
+            bvh.refit(boxes);
+        });
+        // Only 1% of the boxes move, so only their paths to the root are refitted
+        std::vector<uint32_t> changed;
+        for(uint32_t item = 0; item < uint32_t(boxCount); item += 100) changed.push_back(item);
+        measure("BVH refit (1% moved)", iterations, changed.size(), [&](){
+            for(uint32_t item : changed){ boxes[item].min.y += 0.01f; boxes[item].max.y += 0.01f; }
+            bvh.refit(boxes, changed);
+        });
+        std::cout << "(" << bvh.getNodeCount() << " nodes, cost " << bvh.getCost() << ", needs rebuild: " << (bvh.needsRebuild() ? "yes" : "no") << ")" << std::endl;
+
+        // A camera at the center of the scene looking along -z with a far plane that only sees a part of the scene
+        glm::mat4 VP = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 300.0f) * glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        our::Frustum frustum = our::Frustum::fromMatrix(VP);
+        size_t linearVisible = 0, bvhVisible = 0;
+        measure("frustum query (linear scan)", iterations, size_t(boxCount), [&](){
+            linearVisible = 0;
+            for(const auto& box : boxes) linearVisible += frustum.intersects(box) ? 1 : 0;
+        });
+        measure("frustum query (BVH)", iterations, size_t(boxCount), [&](){
+            bvhVisible = 0;
+            bvh.queryFrustum(frustum, boxes, [&](uint32_t){ ++bvhVisible; });
+        });
+        std::cout << "(visible: linear " << linearVisible << ", BVH " << bvhVisible << ")" << std::endl;
+
+        std::vector<our::BoundingBox> queries(queryCount);
+        for(auto& query : queries) query = randomBox();
+        size_t linearOverlaps = 0, bvhOverlaps = 0;
+        measure("overlap queries (linear scan)", 1, queryCount, [&](){
+            for(const auto& query : queries)
+                for(const auto& box : boxes) linearOverlaps += box.overlaps(query) ? 1 : 0;
+        });
+        measure("overlap queries (BVH)", iterations, queryCount, [&](){
+            bvhOverlaps = 0;
+            for(const auto& query : queries) bvh.queryOverlap(query, boxes, [&](uint32_t){ ++bvhOverlaps; });
+        });
+        std::cout << "(overlaps: linear " << linearOverlaps << ", BVH " << bvhOverlaps << ")" << std::endl;
+
+        // Rays from random points in random directions
+        std::vector<std::pair<glm::vec3, glm::vec3>> rays(queryCount);
+        for(auto& ray : rays) ray = { glm::vec3(position(generator), position(generator), position(generator)),
+                                      glm::normalize(glm::vec3(unit(generator), unit(generator), unit(generator)) + glm::vec3(1e-4f)) };
+        size_t linearHits = 0, bvhHits = 0;
+        measure("ray casts (linear scan)", 1, queryCount, [&](){
+            for(const auto& [origin, direction] : rays){
+                glm::vec3 inverseDirection = 1.0f / direction;
+                float nearest = std::numeric_limits<float>::infinity();
+                for(const auto& box : boxes){
+                    float distance = our::intersectRay(box, origin, inverseDirection, nearest);
+                    if(distance >= 0) nearest = distance;
+                }
+                linearHits += nearest != std::numeric_limits<float>::infinity() ? 1 : 0;
+            }
+        });
+        measure("ray casts (BVH)", iterations, queryCount, [&](){
+            bvhHits = 0;
+            for(const auto& [origin, direction] : rays){
+                glm::vec3 inverseDirection = 1.0f / direction;
+                our::RayHit hit = bvh.raycast(origin, direction, std::numeric_limits<float>::infinity(), boxes, [&](uint32_t item, float maxDistance){
+                    return our::intersectRay(boxes[item], origin, inverseDirection, maxDistance);
+                });
+                bvhHits += hit.hit() ? 1 : 0;
+            }
+        });
+        std::cout << "(hits: linear " << linearHits << ", BVH " << bvhHits << ")" << std::endl;
+    }
+
+    void onInitialize() override {
+        const auto& config = getApp()->getConfig()["benchmark"];
+        int entityCount = config.value("entities", 100000);
+        int iterations = config.value("iterations", 20);
+
+        // We populate the world with entities holding a random mix of components
+        // Every entity has a mesh renderer so that some lookups always hit while others only hit sometimes
+        std::mt19937 generator(config.value("seed", 0));
+        std::bernoulli_distribution coin(0.5);
+        for(int index = 0; index < entityCount; ++index){
+            our::Entity* entity = world.add();
+            if(coin(generator)) entity->addComponent<our::CameraComponent>();
+            if(coin(generator)) entity->addComponent<our::FreeCameraControllerComponent>();
+            entity->addComponent<our::MeshRendererComponent>();
+            if(coin(generator)) entity->addComponent<our::MovementComponent>();
+        }
+        std::cout << "ECS benchmark on " << entityCount << " entities (" << iterations << " iterations)" << std::endl;
+
+        // Component lookup through the entities (this is what the systems used to do every frame)
+        size_t found = 0;
+        measure("getComponent (2 lookups per entity)", iterations, 2 * size_t(entityCount), [&](){
+            for(auto entity : world.getEntities()){
+                if(entity->getComponent<our::MovementComponent>()) ++found;
+                if(entity->getComponent<our::MeshRendererComponent>()) ++found;
+            }
+        });
+        measure("hasComponent (2 lookups per entity)", iterations, 2 * size_t(entityCount), [&](){
+            for(auto entity : world.getEntities()){
+                if(entity->hasComponent<our::MovementComponent>()) ++found;
+                if(entity->hasComponent<our::MeshRendererComponent>()) ++found;
+            }
+        });
+        std::cout << "(found " << found << " components)" << std::endl;
+
+        // Spawning and despawning entities (their slots are recycled by the world's entity pool)
+        const size_t spawnCount = 1000;
+        measure("spawn + despawn (1000 entities)", iterations, spawnCount, [&](){
+            for(size_t index = 0; index < spawnCount; ++index){
+                our::Entity* entity = world.add();
+                entity->addComponent<our::MovementComponent>();
+                world.markForRemoval(entity);
+            }
+            world.deleteMarkedEntities();
+        });
+
+        // Recording structural changes from all the threads then applying them at once
+        our::JobSystem& jobSystem = getApp()->getJobSystem();
+        measure("record on threads + playback (1000 entities)", iterations, spawnCount, [&](){
+            our::WorldCommandBuffer& commands = world.getCommandBuffer();
+            jobSystem.parallelFor(0, spawnCount, [&](size_t begin, size_t end){
+                for(size_t index = begin; index < end; ++index){
+                    our::EntityHandle entity = commands.createEntity();
+                    commands.addComponent<our::MovementComponent>(entity, [](our::MovementComponent* movement){
+                        movement->linearVelocity = glm::vec3(1.0f, 0.0f, 0.0f);
+                    });
+                    commands.destroy(entity);
+                }
+            }, 64);
+            world.playback();
+        });
+
+        // Moving the entities with the serial loop then with the parallel SIMD loop
+        our::MovementSystem movementSystem;
+        size_t moving = world.getStorage<our::MovementComponent>().size();
+        std::uniform_real_distribution<float> velocity(-1.0f, 1.0f);
+        world.getStorage<our::MovementComponent>().forEach([&](our::MovementComponent& movement){
+            movement.linearVelocity = glm::vec3(velocity(generator), velocity(generator), velocity(generator));
+            movement.angularVelocity = glm::vec3(velocity(generator), velocity(generator), velocity(generator));
+        });
+        // Both paths start from the same transforms and must reach exactly the same results
+        std::vector<our::Transform> initial, serial;
+        for(auto entity : world.getEntities()) initial.push_back(entity->localTransform);
+        const float deltaTime = 1.0f / 60.0f;
+        measure("MovementSystem (serial)", iterations, moving, [&](){ movementSystem.update(&world, deltaTime); });
+        for(auto entity : world.getEntities()) serial.push_back(entity->localTransform);
+        for(size_t index = 0; index < initial.size(); ++index) world.getEntities()[index]->localTransform = initial[index];
+        std::string parallelName = "MovementSystem (" + std::to_string(jobSystem.getThreadCount()) + " threads)";
+        measure(parallelName, iterations, moving, [&](){ movementSystem.update(&world, deltaTime, &jobSystem); });
+        bool identical = true;
+        for(size_t index = 0; index < serial.size(); ++index)
+            identical = identical && std::memcmp(&serial[index], &world.getEntities()[index]->localTransform, sizeof(our::Transform)) == 0;
+        std::cout << "(" << moving << " moving entities, parallel results " << (identical ? "are" : "are NOT") << " identical to serial)" << std::endl;
+
+        // Finally, we print the memory statistics of the component storages
+        for(const auto& statistics : world.getComponentStatistics()){
+            std::cout << std::left << std::setw(24) << statistics.name << std::right
+                      << " live: " << statistics.live << ", peak: " << statistics.peak
+                      << ", chunks: " << statistics.chunks << ", slabs: " << statistics.slabs
+                      << " (" << statistics.bytes / 1024 << " KB)" << std::endl;
+        }
+
+        benchmarkTransforms(config, getApp()->getJobSystem());
+        benchmarkSpatial(config);
+    }
+
+    void onDraw(double deltaTime) override {
+        // All the work is done in onInitialize, so we just leave
+        getApp()->close();
+    }
+
+    void onDestroy() override {
+        world.clear();
+    }
+};
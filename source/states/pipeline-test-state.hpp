@@ -5,6 +5,7 @@
 #include <mesh/mesh-utils.hpp>
 #include <ecs/transform.hpp>
 #include <material/pipeline-state.hpp>
+#include <gl/state-cache.hpp>
 #include <application.hpp>
 #include <deserialize-utils.hpp>
 
@@ -75,8 +76,9 @@ class PipelineTestState: public our::State {
     void onDraw(double deltaTime) override {
         // We make sure the color and depth masks are true (just in case the pipeline set any of them to false)
         // to make sure that glClear works correctly
-        glColorMask(true, true, true, true);
-        glDepthMask(true);
+        // (they go through the state cache since the pipeline state sets them through it too)
+        our::GLStateCache::get().colorMask(glm::bvec4(true));
+        our::GLStateCache::get().depthMask(true);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         shader->use();
         // Before drawing, we setup the pipeline state
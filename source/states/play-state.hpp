@@ -6,6 +6,9 @@
 #include <systems/forward-renderer.hpp>
 #include <systems/free-camera-controller.hpp>
 #include <systems/movement.hpp>
+#include <systems/transform.hpp>
+#include <systems/spatial.hpp>
+#include <systems/static-batching.hpp>
 #include <asset-loader.hpp>
 
 // This state shows how to use the ECS framework and deserialization.
@@ -15,6 +18,10 @@ class Playstate: public our::State {
     our::ForwardRenderer renderer;
     our::FreeCameraControllerSystem cameraController;
     our::MovementSystem movementSystem;
+    our::TransformSystem transformSystem;
+    our::SpatialSystem spatialSystem;
+    our::StaticBatcher staticBatcher;
+    our::JobSystem* jobSystem; // The job system used by the systems or null if they should run serially
 
     void onInitialize() override {
         // First of all, we get the scene configuration from the app config
@@ -27,6 +34,11 @@ class Playstate: public our::State {
         if(config.contains("world")){
             world.deserialize(config["world"]);
         }
+        // Then the static mesh renderers sharing a material are merged into a few large meshes (see "static-batching" in the scene config)
+        staticBatcher.build(&world, config.value("static-batching", nlohmann::json::object()));
+        // The systems use the app's job system unless "jobs.serial" is true in the app config
+        bool serial = getApp()->getConfig().value("jobs", nlohmann::json::object()).value("serial", false);
+        jobSystem = serial ? nullptr : &getApp()->getJobSystem();
         // We initialize the camera controller system since it needs a pointer to the app
         cameraController.enter(getApp());
         // Then we initialize the renderer
@@ -34,12 +46,51 @@ class Playstate: public our::State {
         renderer.initialize(size, config["renderer"]);
     }
 
+    void onImmediateGui() override {
+        // A small overlay that shows the renderer statistics of the last frame
+        const our::RendererStatistics& statistics = renderer.getStatistics();
+        ImGui::SetNextWindowPos(ImVec2(10, 10), ImGuiCond_FirstUseEver);
+        ImGui::Begin("Renderer", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+        ImGui::Text("Mesh renderers: %zu", statistics.meshRenderers);
+        ImGui::Text("Visible: %zu", statistics.visible);
+        ImGui::Text("Culled: %zu", statistics.culled);
+        ImGui::Text("Occlusion: %zu occluders (%zu triangles, %.3f ms), %zu hidden", statistics.occluders, statistics.occluderTriangles, statistics.occlusionTime, statistics.occluded);
+        // The hidden rate is the part of the queried objects whose last results found them hidden. It is not the part of the draws that
+        // the GPU skipped: with conditional rendering, the hidden objects are still submitted and drawn if the result of their box is not ready.
+        double hiddenRate = statistics.queriedObjects ? 100.0 * statistics.queryHidden / statistics.queriedObjects : 0.0;
+        ImGui::Text("Occlusion queries: %zu issued, %zu of %zu objects in the hidden state (%.1f%%)", statistics.occlusionQueries, statistics.queryHidden, statistics.queriedObjects, hiddenRate);
+        ImGui::Text("Command extraction: %.3f ms (%zu threads, %zu commands rebuilt)", statistics.extractionTime, statistics.extractionThreads, statistics.patched);
+        ImGui::Text("Triangles: %zu (%zu without LOD, %zu objects simplified)", statistics.triangles, statistics.trianglesWithoutLod, statistics.simplified);
+        ImGui::Text("Draw calls: %zu (instanced: %zu with %zu objects)", statistics.drawCalls, statistics.instancedBatches, statistics.instances);
+        ImGui::Text("Buckets: %zu (multi-draw indirect calls: %zu)", statistics.buckets, statistics.indirectDraws);
+        ImGui::Text("State changes: %zu shaders, %zu materials, %zu meshes", statistics.shaderChanges, statistics.materialChanges, statistics.meshChanges);
+        // The state cache counters still hold the calls of the last frame since they are reset right before drawing
+        const our::GLStateStatistics& glState = our::GLStateCache::get().getStatistics();
+        ImGui::Text("GL state calls: %zu (skipped %zu), binds: %zu (skipped %zu)", glState.stateCalls, glState.stateSkipped, glState.bindCalls, glState.bindSkipped);
+        ImGui::Text("Uniform uploads: %zu (skipped %zu)", glState.uniformCalls, glState.uniformSkipped);
+        if(const our::RingBuffer* ring = renderer.getUniformRing())
+            ImGui::Text("Uniform blocks: %zu KB (%s, waits: %zu)", statistics.uniformBlockBytes / 1024, ring->isPersistent() ? "persistent" : "orphaned", ring->getStatistics().waits);
+        const our::StaticBatchingStatistics& batching = staticBatcher.getStatistics();
+        ImGui::Text("Static batches: %zu from %zu mesh renderers (%zu vertices, %s)", batching.batches, batching.sources, batching.vertices, batching.cached ? "cached" : "merged");
+        ImGui::Text("BVH nodes: %zu (rebuilds: %zu)", spatialSystem.getHierarchy().getNodeCount(), spatialSystem.getStatistics().rebuilds);
+        our::GeometryArenaStatistics arena = our::GeometryArena::get().getStatistics();
+        ImGui::Text("Geometry arena: %zu meshes, %zu / %zu vertices, %zu / %zu indices", arena.meshes, arena.vertices, arena.vertexCapacity, arena.indices, arena.indexCapacity);
+        ImGui::End();
+    }
+
     void onDraw(double deltaTime) override {
         // Here, we just run a bunch of systems to control the world logic
-        movementSystem.update(&world, (float)deltaTime);
+        movementSystem.update(&world, (float)deltaTime, jobSystem);
         cameraController.update(&world, (float)deltaTime);
-        // And finally we use the renderer system to draw the scene
-        renderer.render(&world);
+        // Now that no system is iterating over the world, we apply the structural changes that the systems deferred
+        world.playback();
+        // Then we refresh the world matrices of the entities that moved
+        transformSystem.update(&world, jobSystem);
+        // and we refit the bounding volume hierarchy around the objects that moved
+        spatialSystem.update(&world);
+        // And finally we use the renderer system to draw the scene (it finds the visible objects using the hierarchy
+        // and builds the render commands on the job system's threads)
+        renderer.render(&world, &spatialSystem, jobSystem);
 
         // Get a reference to the keyboard object
         auto& keyboard = getApp()->getKeyboard();
@@ -57,6 +108,8 @@ class Playstate: public our::State {
         cameraController.exit();
         // Clear the world
         world.clear();
+        // The merged meshes are deleted once no entity draws them
+        staticBatcher.destroy();
         // and we delete all the loaded assets to free memory on the RAM and the VRAM
         our::clearAllAssets();
     }
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <application.hpp>
+#include <asset-loader.hpp>
+#include <ecs/world.hpp>
+#include <components/camera.hpp>
+#include <components/mesh-renderer.hpp>
+#include <systems/forward-renderer.hpp>
+#include <systems/spatial.hpp>
+#include <systems/transform.hpp>
+#include <jobs/job-system.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <thread>
+
+// This state measures how the frame time of the renderer scales with the number of threads on a large stress scene
+// and prints the results to the console. It closes the application as soon as the benchmark is done.
+// The assets and the renderer options come from the "scene" object in the app config and the benchmark options
+// from the "benchmark" object (see "config/benchmark/render.jsonc").
+class RenderBenchmarkState: public our::State {
+
+    our::World world;
+    our::ForwardRenderer renderer;
+    our::SpatialSystem spatialSystem;
+
+    // Fills the world with a camera at the center and mesh renderers scattered randomly in a cube around it
+    void buildScene(const nlohmann::json& config){
+        int entityCount = config.value("entities", 100000);
+        float extent = config.value("extent", 200.0f);
+        std::vector<std::string> meshes = config.value("meshes", std::vector<std::string>{});
+        std::vector<std::string> materials = config.value("materials", std::vector<std::string>{});
+
+        our::Entity* cameraEntity = world.add();
+        cameraEntity->addComponent<our::CameraComponent>()->deserialize(config.value("camera", nlohmann::json::object()));
+
+        std::mt19937 generator(config.value("seed", 0));
+        std::uniform_real_distribution<float> position(-extent, extent), angle(0.0f, 360.0f);
+        std::uniform_int_distribution<size_t> meshIndex(0, meshes.size() - 1), materialIndex(0, materials.size() - 1);
+        for(int index = 0; index < entityCount; ++index){
+            our::Entity* entity = world.add();
+            entity->localTransform.position = glm::vec3(position(generator), position(generator), position(generator));
+            entity->localTransform.rotation = glm::vec3(0.0f, angle(generator), 0.0f);
+            our::MeshRendererComponent* meshRenderer = entity->addComponent<our::MeshRendererComponent>();
+            meshRenderer->mesh = our::AssetLoader<our::Mesh>::get(meshes[meshIndex(generator)]);
+            meshRenderer->material = our::AssetLoader<our::Material>::get(materials[materialIndex(generator)]);
+        }
+
+        // The occluders are large walls scattered in the same cube (they hide the objects behind them if occlusion culling is enabled)
+        const nlohmann::json& occluders = config.value("occluders", nlohmann::json::object());
+        int occluderCount = occluders.value("count", 0);
+        glm::vec3 occluderScale = occluders.value("scale", glm::vec3(10.0f, 10.0f, 1.0f));
+        our::Mesh* occluderMesh = our::AssetLoader<our::Mesh>::get(occluders.value("mesh", "cube"));
+        our::Material* occluderMaterial = our::AssetLoader<our::Material>::get(occluders.value("material", "metal"));
+        for(int index = 0; index < occluderCount; ++index){
+            our::Entity* entity = world.add();
+            entity->localTransform.position = glm::vec3(position(generator), position(generator), position(generator));
+            entity->localTransform.rotation = glm::vec3(0.0f, angle(generator), 0.0f);
+            entity->localTransform.scale = occluderScale;
+            our::MeshRendererComponent* meshRenderer = entity->addComponent<our::MeshRendererComponent>();
+            meshRenderer->mesh = occluderMesh;
+            meshRenderer->material = occluderMaterial;
+            meshRenderer->isOccluder = true;
+        }
+    }
+
+    void onInitialize() override {
+        const auto& appConfig = getApp()->getConfig();
+        const auto& scene = appConfig["scene"];
+        const auto& config = appConfig["benchmark"];
+        if(scene.contains("assets")){
+            our::deserializeAllAssets(scene["assets"]);
+        }
+        buildScene(config);
+        // Nothing moves in this scene, so the world matrices and the hierarchy are only computed once
+        our::TransformSystem transformSystem;
+        transformSystem.update(&world);
+        spatialSystem.update(&world);
+        renderer.initialize(getApp()->getFrameBufferSize(), scene.value("renderer", nlohmann::json::object()));
+
+        // If the thread counts are not given, we try the powers of two up to the number of hardware threads
+        std::vector<int> threadCounts = config.value("threads", std::vector<int>{});
+        if(threadCounts.empty()){
+            int hardwareThreads = std::max(1, (int)std::thread::hardware_concurrency());
+            for(int threads = 1; threads < hardwareThreads; threads *= 2) threadCounts.push_back(threads);
+            threadCounts.push_back(hardwareThreads);
+        }
+        int frames = config.value("frames", 60);
+        std::cout << "Render benchmark on " << world.getStorage<our::MeshRendererComponent>().size() << " mesh renderers ("
+                  << frames << " frames per measurement)" << std::endl;
+
+        // Each thread count is measured with and without the spatial system (the frustum test of every mesh renderer is
+        // part of the extraction without it, while the hierarchy query stays on the calling thread with it)
+        for(bool useSpatial : { false, true }){
+            double baseline = 0.0;
+            for(int threads : threadCounts){
+                // The calling thread runs jobs too, so a job system with "threads - 1" workers uses "threads" threads
+                our::JobSystem jobSystem(std::max(threads - 1, 0));
+                const our::SpatialSystem* spatial = useSpatial ? &spatialSystem : nullptr;
+                // The first frame is not measured since it allocates the command lists and the buffers
+                renderer.render(&world, spatial, &jobSystem);
+                glFinish();
+                double extraction = 0.0, frame = 0.0;
+                for(int index = 0; index < frames; ++index){
+                    auto start = std::chrono::high_resolution_clock::now();
+                    renderer.render(&world, spatial, &jobSystem);
+                    auto end = std::chrono::high_resolution_clock::now();
+                    // We wait for the GPU outside the measured time so that a frame never waits for the previous one
+                    glFinish();
+                    frame += std::chrono::duration<double, std::milli>(end - start).count();
+                    extraction += renderer.getStatistics().extractionTime;
+                }
+                frame /= frames;
+                extraction /= frames;
+                if(baseline == 0.0) baseline = extraction;
+                std::cout << std::left << std::setw(12) << (useSpatial ? "BVH" : "full scan") << std::right
+                          << std::setw(3) << threads << " threads:" << std::fixed << std::setprecision(3)
+                          << " extraction " << std::setw(8) << extraction << " ms (x" << std::setprecision(2) << baseline / extraction << ")"
+                          << std::setprecision(3) << ", frame (CPU) " << std::setw(8) << frame << " ms"
+                          << " (" << renderer.getStatistics().visible << " visible, " << renderer.getStatistics().drawCalls << " draw calls, "
+                          << renderer.getStatistics().triangles << " triangles, " << renderer.getStatistics().trianglesWithoutLod << " without LOD, "
+                          << renderer.getStatistics().occluded << " hidden by " << renderer.getStatistics().occluders << " occluders)" << std::endl;
+            }
+        }
+    }
+
+    void onDraw(double deltaTime) override {
+        // All the work is done in onInitialize, so we just leave
+        getApp()->close();
+    }
+
+    void onDestroy() override {
+        renderer.destroy();
+        world.clear();
+        our::clearAllAssets();
+    }
+};
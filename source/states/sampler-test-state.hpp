@@ -5,6 +5,7 @@
 #include <texture/texture2d.hpp>
 #include <texture/texture-utils.hpp>
 #include <texture/sampler.hpp>
+#include <gl/state-cache.hpp>
 #include <application.hpp>
 
 
@@ -52,7 +53,7 @@ class SamplerTestState: public our::State {
         glClear(GL_COLOR_BUFFER_BIT);
         shader->use();
         // Here we set the active texture unit to 0 then bind the texture to it
-        glActiveTexture(GL_TEXTURE0);
+        our::GLStateCache::get().activeTexture(0);
         texture->bind();
         // Then we bind the sampler to unit 0
         sampler->bind(0);
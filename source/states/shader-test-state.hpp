@@ -2,6 +2,7 @@
 
 #include <shader/shader.hpp>
 #include <deserialize-utils.hpp>
+#include <gl/state-cache.hpp>
 #include <application.hpp>
 
 // This state tests and shows how to use the Shader Class.
@@ -54,12 +55,13 @@ class ShaderTestState: public our::State {
         glClear(GL_COLOR_BUFFER_BIT);
         // Use the shader then draw the mesh
         shader->use();
-        glBindVertexArray(vertex_array);
+        our::GLStateCache::get().bindVertexArray(vertex_array);
         glDrawArrays(GL_TRIANGLES, 0, 3);
     }
 
     void onDestroy() override {
         delete shader;
+        our::GLStateCache::get().forgetVertexArray(vertex_array);
         glDeleteVertexArrays(1, &vertex_array);
     }
 };
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <mesh/mesh.hpp>
 #include <texture/texture2d.hpp>
 #include <texture/texture-utils.hpp>
+#include <gl/state-cache.hpp>
 #include <application.hpp>
 
 
@@ -44,7 +45,7 @@ class TextureTestState: public our::State {
         glClear(GL_COLOR_BUFFER_BIT);
         shader->use();
         // Here we set the active texture unit to 0 then bind the texture to it
-        glActiveTexture(GL_TEXTURE0);
+        our::GLStateCache::get().activeTexture(0);
         texture->bind();
         // Then we send 0 (the index of the texture unit we used above) to the "tex" uniform
         shader->set("tex", 0);
@@ -0,0 +1,110 @@
+// Checks the CPU occlusion buffer (see "culling/occlusion-buffer.hpp") against scenes whose answers are known.
+// It does not need an OpenGL context, so it runs with ctest: it prints every failed check and returns 1 if any failed.
+#include <culling/occlusion-buffer.hpp>
+#include <jobs/job-system.hpp>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+namespace {
+
+    int failures = 0;
+
+    void check(bool condition, const char* description) {
+        if(condition) return;
+        std::printf("FAILED: %s\n", description);
+        ++failures;
+    }
+
+    // A wall facing the camera made of two triangles: x and y in [-halfSize, halfSize] at the given z
+    // (the diagonal shared by the triangles goes from (-halfSize, -halfSize) to (halfSize, halfSize))
+    our::OccluderGeometry wall(float halfSize, float z) {
+        our::OccluderGeometry geometry;
+        geometry.positions = { {-halfSize, -halfSize, z}, {halfSize, -halfSize, z}, {halfSize, halfSize, z}, {-halfSize, halfSize, z} };
+        geometry.indices = { 0, 1, 2, 0, 2, 3 };
+        return geometry;
+    }
+
+    our::BoundingBox box(const glm::vec3& min, const glm::vec3& max) {
+        our::BoundingBox result;
+        result.min = min;
+        result.max = max;
+        return result;
+    }
+
+}
+
+int main() {
+    // The camera is at the origin looking down -z, so a point (x, y, z) is at ndc (x / (-2 z), y / -z)
+    const int WIDTH = 256, HEIGHT = 128;
+    const float WALL_SIZE = 5.1f, WALL_Z = -10.0f;
+    glm::mat4 viewProjection = glm::perspective(glm::radians(90.0f), 2.0f, 0.1f, 100.0f);
+
+    our::OcclusionBuffer buffer;
+    buffer.resize(WIDTH, HEIGHT);
+    buffer.begin(viewProjection);
+    check(buffer.isVisible(box({-1, -1, -21}, {1, 1, -19})), "everything is visible without occluders");
+    buffer.addOccluder(wall(WALL_SIZE, WALL_Z), glm::mat4(1.0f));
+    buffer.rasterize();
+    check(buffer.getStatistics().occluders == 1 && buffer.getStatistics().triangles == 2, "the wall is added as 2 triangles");
+
+    check(!buffer.isVisible(box({2, -4, -21}, {3, -3, -20})), "a box behind the wall (away from its diagonal) is hidden");
+    check(buffer.isVisible(box({2, -4, -6}, {3, -3, -5})), "a box in front of the wall is visible");
+    check(buffer.isVisible(box({30, -1, -21}, {31, 1, -20})), "a box beside the wall is visible");
+    check(buffer.isVisible(box({8, -1, -21}, {12, 1, -20})), "a box behind the edge of the wall is visible");
+    check(buffer.isVisible(box({-1, -1, -1}, {1, 1, 1})), "a box around the camera is visible");
+    check(buffer.isVisible(box({2, -4, -9.8f}, {3, -3, -9.5f})), "a box touching the front of the wall is visible");
+
+    // The right edge of the wall is inside a pixel column (not on its border), and the box peeks past it by a third of a pixel.
+    // The center of that column is covered by the wall, but the column is not fully covered, so the box must stay visible.
+    float edgeNdc = WALL_SIZE / (-2.0f * WALL_Z);
+    float peekNdc = edgeNdc + 0.3f * 2.0f / WIDTH;
+    float boxZ = -20.0f;
+    check(buffer.isVisible(box({8, -2, boxZ - 0.01f}, {peekNdc * -2.0f * boxZ, -1, boxZ})), "a box peeking past the wall by less than a pixel is visible");
+    check(!buffer.isVisible(box({8, -2, boxZ - 0.01f}, {(edgeNdc - 2.0f * 2.0f / WIDTH) * -2.0f * boxZ, -1, boxZ})), "a box ending 2 pixels inside the wall is hidden");
+
+    // The bands drawn by the job system must give the same buffer as a single thread
+    {
+        our::JobSystem jobSystem(4);
+        our::OcclusionBuffer parallel;
+        parallel.resize(WIDTH, HEIGHT);
+        parallel.begin(viewProjection);
+        parallel.addOccluder(wall(WALL_SIZE, WALL_Z), glm::mat4(1.0f));
+        parallel.addOccluder(wall(2.0f, -4.0f), glm::translate(glm::mat4(1.0f), glm::vec3(-3.0f, 1.0f, 0.0f)));
+        parallel.rasterize(&jobSystem);
+        our::OcclusionBuffer serial;
+        serial.resize(WIDTH, HEIGHT);
+        serial.begin(viewProjection);
+        serial.addOccluder(wall(WALL_SIZE, WALL_Z), glm::mat4(1.0f));
+        serial.addOccluder(wall(2.0f, -4.0f), glm::translate(glm::mat4(1.0f), glm::vec3(-3.0f, 1.0f, 0.0f)));
+        serial.rasterize();
+        check(parallel.getDepths() == serial.getDepths(), "the job system draws the same depths as a single thread");
+    }
+
+    // A hidden box must be hidden for real: every ray from the camera to its corners goes through the wall before reaching it
+    std::mt19937 generator(1);
+    std::uniform_real_distribution<float> position(-40.0f, 40.0f), depth(-60.0f, 5.0f), size(0.1f, 3.0f);
+    int hidden = 0, wrong = 0;
+    for(int index = 0; index < 100000; ++index){
+        glm::vec3 center(position(generator), position(generator), depth(generator));
+        float halfSize = size(generator);
+        our::BoundingBox tested = box(center - halfSize, center + halfSize);
+        if(buffer.isVisible(tested)) continue;
+        ++hidden;
+        for(int corner = 0; corner < 8; ++corner){
+            glm::vec3 point((corner & 1) ? tested.max.x : tested.min.x, (corner & 2) ? tested.max.y : tested.min.y, (corner & 4) ? tested.max.z : tested.min.z);
+            glm::vec3 hit = point * (WALL_Z / point.z);
+            if(point.z > WALL_Z || std::abs(hit.x) > WALL_SIZE || std::abs(hit.y) > WALL_SIZE){
+                ++wrong;
+                break;
+            }
+        }
+    }
+    check(hidden > 0, "some random boxes are hidden");
+    check(wrong == 0, "no random box that can be seen is hidden");
+
+    std::printf("%d failed checks (%d of 100000 random boxes hidden)\n", failures, hidden);
+    return failures == 0 ? 0 : 1;
+}